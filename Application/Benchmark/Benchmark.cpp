@@ -0,0 +1,221 @@
+#include "Job/Job.h"
+#include "Application/SpatialPartitioning/SpatialPartitioning.hpp"
+#include "Application/Benchmark/Benchmark.hpp"
+#include "Application/Benchmark/SpatialTuner.hpp"
+
+#include <sstream>
+
+using namespace bk;
+
+// Builds every spatial partitioning structure over a scene and runs the same
+// queries against each, without a window or a device. Writes one CSV row per
+// structure to stdout, or appends them to a file so runs can be compared. With
+// --tune it first searches the octree and BSP parameters for the scene and keeps
+// them in <scene>.tuning, which the demo and later runs can load
+namespace
+{
+const char* Usage =
+	"SpatialBenchmark [options]\n"
+	"  --scene NAME          cubes, soup or demo, ignored when OBJ files are given (cubes)\n"
+	"  --objects N           cubes, or soup objects (1000)\n"
+	"  --triangles N         triangles per soup object (1000)\n"
+	"  --obj PATH            load an OBJ file as an entity, can be repeated\n"
+	"  --structures LIST     comma separated octree,bsp,bvh,two-level-bvh (all)\n"
+	"  --boxes N             box queries (10000)\n"
+	"  --rays N              ray queries (10000)\n"
+	"  --frusta N            frustum queries (100)\n"
+	"  --repeat N            builds per structure, the fastest is reported (3)\n"
+	"  --simd NAME           scalar, sse2 or avx2 mesh kernels, at most what the CPU has (best)\n"
+	"  --workload PATH       queries recorded in the demo instead of generated ones\n"
+	"  --seed N              random seed for the scene and queries (133333337)\n"
+	"  --tuning PATH         build with the parameters in a .tuning file\n"
+	"  --tune                search the octree and BSP parameters before running\n"
+	"  --tuning-dir DIR      where --tune writes <scene>.tuning (.)\n"
+	"  --build-weight W      build milliseconds per query millisecond for --tune (1)\n"
+	"  --label TEXT          first column of every row, e.g. the commit\n"
+	"  --csv PATH            append to PATH instead of writing to stdout\n";
+
+struct Options
+{
+	std::string scene = "cubes";
+	uint32_t objects = 1000;
+	uint32_t triangles = 1000;
+	std::vector<std::string> objPaths;
+	std::string structures = "octree,bsp,bvh,two-level-bvh";
+	uint32_t boxes = 10000;
+	uint32_t rays = 10000;
+	uint32_t frusta = 100;
+	uint32_t repeat = 3;
+	std::string workloadPath;
+	uint32_t seed = 133333337;
+	std::string tuningPath;
+	bool tune = false;
+	std::string tuningDir = ".";
+	std::string label;
+	std::string csvPath;
+};
+
+bool ParseOptions(int argc, char** argv, Options& options)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string arg = argv[i];
+		if (arg == "--tune")
+		{
+			options.tune = true;
+			continue;
+		}
+		if (i + 1 >= argc) return false;
+		const std::string value = argv[++i];
+
+		if (arg == "--scene") options.scene = value;
+		else if (arg == "--objects") options.objects = std::stoul(value);
+		else if (arg == "--triangles") options.triangles = std::stoul(value);
+		else if (arg == "--obj") options.objPaths.push_back(value);
+		else if (arg == "--structures") options.structures = value;
+		else if (arg == "--boxes") options.boxes = std::stoul(value);
+		else if (arg == "--rays") options.rays = std::stoul(value);
+		else if (arg == "--frusta") options.frusta = std::stoul(value);
+		else if (arg == "--repeat") options.repeat = std::stoul(value);
+		else if (arg == "--simd")
+		{
+			if (value == "scalar") MeshKernels::SetInstructionSet(MeshKernels::InstructionSet::Scalar);
+			else if (value == "sse2") MeshKernels::SetInstructionSet(MeshKernels::InstructionSet::SSE2);
+			else if (value == "avx2") MeshKernels::SetInstructionSet(MeshKernels::InstructionSet::AVX2);
+			else return false;
+		}
+		else if (arg == "--workload") options.workloadPath = value;
+		else if (arg == "--seed") options.seed = std::stoul(value);
+		else if (arg == "--tuning") options.tuningPath = value;
+		else if (arg == "--tuning-dir") options.tuningDir = value;
+		else if (arg == "--build-weight") SpatialTuner::BuildWeight = std::stof(value);
+		else if (arg == "--label") options.label = value;
+		else if (arg == "--csv") options.csvPath = value;
+		else return false;
+	}
+	return options.scene == "cubes" || options.scene == "soup" || options.scene == "demo";
+}
+
+bool Selected(const Options& options, const std::string& structure)
+{
+	std::stringstream list(options.structures);
+	std::string name;
+	while (std::getline(list, name, ','))
+	{
+		if (name == structure) return true;
+	}
+	return false;
+}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		std::cerr << Usage;
+		return EXIT_FAILURE;
+	}
+
+	// Files are read before anything is started, so a bad path just exits
+	BenchmarkWorkload workload;
+	if (!options.workloadPath.empty() && !BenchmarkWorkload::Load(options.workloadPath, workload))
+	{
+		std::cerr << "Failed to load workload " << options.workloadPath << "\n";
+		return EXIT_FAILURE;
+	}
+	if (!options.tuningPath.empty())
+	{
+		SpatialTuning tuning = SpatialTuning::Capture();
+		if (!tuning.Load(options.tuningPath))
+		{
+			std::cerr << "Failed to load tuning " << options.tuningPath << "\n";
+			return EXIT_FAILURE;
+		}
+		tuning.Apply();
+	}
+
+	ECS::CreateSystems();
+	JobSystem::Initialize();
+	Device device;
+
+	srand(options.seed);
+	BenchmarkScene scene = !options.objPaths.empty() ? BenchmarkScene::LoadObj(options.objPaths, device) :
+		options.scene == "soup" ? BenchmarkScene::CreateSoup(options.objects, options.triangles, device) :
+		options.scene == "demo" ? BenchmarkScene::CreateDemo(device) :
+		BenchmarkScene::CreateCubes(options.objects, device);
+	if (options.workloadPath.empty())
+		workload = BenchmarkWorkload::Generate(scene, options.boxes, options.rays, options.frusta);
+
+	if (options.tune)
+	{
+		// The rows below are then built with the tuned parameters
+		SpatialTuner::Repeat = options.repeat;
+		SpatialTuner tuner(scene, workload, device);
+		const SpatialTuning tuning = tuner.Tune(Selected(options, "octree"), Selected(options, "bsp"));
+		const std::string tuningPath = options.tuningDir + "/" + scene.name + ".tuning";
+		if (tuning.Save(tuningPath))
+			std::cerr << "Saved " << tuningPath << "\n";
+		else
+			std::cerr << "Failed to save " << tuningPath << "\n";
+	}
+
+	std::vector<BenchmarkResult> results;
+	if (Selected(options, "octree"))
+	{
+		// The octree always covers a cube around the scene
+		Octree octree;
+		const glm::vec3 center = scene.Center();
+		const float halfExtent = scene.HalfExtent();
+		results.push_back(Benchmark::Run("octree", octree, [&](Octree& structure)
+		{
+			structure.Create(center, halfExtent, 0, device);
+		}, workload, options.repeat));
+	}
+	if (Selected(options, "bsp"))
+	{
+		BSP bsp;
+		results.push_back(Benchmark::Run("bsp", bsp, [&](BSP& structure)
+		{
+			structure.Create(0, device);
+		}, workload, options.repeat));
+	}
+	if (Selected(options, "bvh"))
+	{
+		BVH bvh;
+		results.push_back(Benchmark::Run("bvh", bvh, [&](BVH& structure)
+		{
+			structure.Create(device);
+		}, workload, options.repeat));
+	}
+	if (Selected(options, "two-level-bvh"))
+	{
+		TwoLevelBVH twoLevelBvh;
+		results.push_back(Benchmark::Run("two-level-bvh", twoLevelBvh, [&](TwoLevelBVH& structure)
+		{
+			structure.Create(device);
+		}, workload, options.repeat));
+	}
+
+	if (options.csvPath.empty())
+	{
+		BenchmarkResult::WriteCsvHeader(std::cout);
+		for (const BenchmarkResult& result : results)
+			result.WriteCsv(std::cout, options.label, scene);
+	}
+	else
+	{
+		// Only a new file gets the header, so rows from several runs line up
+		const bool exists = std::ifstream(options.csvPath).good();
+		std::ofstream file(options.csvPath, std::ios::app);
+		if (!exists)
+			BenchmarkResult::WriteCsvHeader(file);
+		for (const BenchmarkResult& result : results)
+			result.WriteCsv(file, options.label, scene);
+	}
+
+	BenchmarkScene::Clear();
+	JobSystem::Destroy();
+	ECS::DestroySystems();
+	return EXIT_SUCCESS;
+}
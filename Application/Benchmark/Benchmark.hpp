@@ -0,0 +1,460 @@
+#pragma once
+
+// Pieces of the headless spatial partitioning benchmark: scenes made of ECS
+// entities, a fixed set of queries to run against every structure, and timing of
+// the builds and queries
+
+// Entities the structures are built from, created in the registry
+struct BenchmarkScene
+{
+	std::string name;
+	uint32_t objects = 0;
+	uint64_t triangles = 0;
+	glm::vec3 min = glm::vec3(FLT_MAX);
+	glm::vec3 max = glm::vec3(-FLT_MAX);
+
+	// Scaled and rotated cubes like the demo scene spawns, spread so that the
+	// density stays that of 1000 cubes in [-10, 10]
+	static BenchmarkScene CreateCubes(uint32_t count, Device& device)
+	{
+		static const std::vector<Vertex> cubeVerts = {
+			{{-1.0f, -1.0f, -1.0f}}, {{1.0f, -1.0f, -1.0f}}, {{1.0f, 1.0f, -1.0f}}, {{-1.0f, 1.0f, -1.0f}},
+			{{-1.0f, -1.0f, 1.0f}}, {{1.0f, -1.0f, 1.0f}}, {{1.0f, 1.0f, 1.0f}}, {{-1.0f, 1.0f, 1.0f}}
+		};
+		static const std::vector<uint32_t> cubeIndices = {
+			0, 2, 1, 2, 0, 3,
+			4, 5, 6, 6, 7, 4,
+			0, 1, 5, 5, 4, 0,
+			3, 6, 2, 6, 3, 7,
+			0, 4, 7, 7, 3, 0,
+			1, 2, 6, 6, 5, 1
+		};
+
+		BenchmarkScene scene;
+		scene.name = "cubes-" + std::to_string(count);
+		const float spread = 10.0f * std::cbrt(count / 1000.0f);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			TransformComponent transform;
+			transform.SetScale(glm::vec3(utils::Random() + 0.5f));
+			transform.SetPosition(glm::vec3(utils::Random(-spread, spread),
+											utils::Random(-spread, spread),
+											utils::Random(-spread, spread)));
+			transform.SetRotation(glm::vec3(utils::Random(0.0f, 360.0f),
+											utils::Random(0.0f, 360.0f),
+											utils::Random(0.0f, 360.0f)));
+			scene.Add(cubeVerts, cubeIndices, transform, device);
+		}
+		return scene;
+	}
+
+	// The quads the demo scene spawns, in the same order and from the same seed so
+	// that a workload recorded in the demo runs against the same entities
+	static BenchmarkScene CreateDemo(Device& device)
+	{
+		static const std::vector<Vertex> quadVerts = {
+			{{-1.0, 1.0,  0.5}, {0.0f, 0.0f, 1.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 1.0f}},
+			{{-1.0, -1.0, 0.5}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 1.0f}},
+			{{1.0,  -1.0, 0.5}, {0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f}},
+			{{1.0,  1.0,  0.5}, {0.0f, 0.0f, 1.0f}, {1.0f, 1.0f, 0.0f}, {0.0f, 1.0f}}
+		};
+		static const std::vector<uint32_t> quadIndices = {
+			0, 1, 2,
+			2, 3, 0
+		};
+
+		BenchmarkScene scene;
+		scene.name = "demo-1000";
+		srand(133333337);
+		for (uint32_t i = 0; i < 1000; ++i)
+		{
+			TransformComponent transform;
+			transform.SetScale(glm::vec3(utils::Random() + 0.5f));
+			transform.SetPosition(glm::vec3(utils::Random(-10.0f, 10.0f),
+											utils::Random(-10.0f, 10.0f),
+											utils::Random(-10.0f, 10.0f)));
+			transform.SetRotation(glm::vec3(utils::Random(0.0f, 360.0f),
+											utils::Random(0.0f, 360.0f),
+											utils::Random(0.0f, 360.0f)));
+			scene.Add(quadVerts, quadIndices, transform, device);
+		}
+		return scene;
+	}
+
+	// Objects of small random triangles crowded around points in [-10, 10]
+	static BenchmarkScene CreateSoup(uint32_t objects, uint32_t trianglesPerObject, Device& device)
+	{
+		BenchmarkScene scene;
+		scene.name = "soup-" + std::to_string(objects) + "x" + std::to_string(trianglesPerObject);
+		for (uint32_t i = 0; i < objects; ++i)
+		{
+			const glm::vec3 center = glm::vec3(utils::Random(-10.0f, 10.0f),
+											   utils::Random(-10.0f, 10.0f),
+											   utils::Random(-10.0f, 10.0f));
+			std::vector<Vertex> vertices(trianglesPerObject * 3);
+			std::vector<uint32_t> indices(trianglesPerObject * 3);
+			for (uint32_t v = 0; v < vertices.size(); v += 3)
+			{
+				const glm::vec3 corner = center + glm::vec3(utils::Random(-2.0f, 2.0f),
+															utils::Random(-2.0f, 2.0f),
+															utils::Random(-2.0f, 2.0f));
+				for (uint32_t k = 0; k < 3; ++k)
+				{
+					vertices[v + k].pos = corner + glm::vec3(utils::Random(-0.25f, 0.25f),
+															 utils::Random(-0.25f, 0.25f),
+															 utils::Random(-0.25f, 0.25f));
+					indices[v + k] = v + k;
+				}
+			}
+			scene.Add(vertices, indices, TransformComponent(), device);
+		}
+		return scene;
+	}
+
+	// One entity per file, left where the file puts it
+	static BenchmarkScene LoadObj(const std::vector<std::string>& paths, Device& device)
+	{
+		BenchmarkScene scene;
+		for (const std::string& path : paths)
+		{
+			auto data = Mesh<Vertex>::LoadModel(path);
+			if (data.indices.empty()) continue;
+			scene.Add(data.vertices, data.indices, TransformComponent(), device);
+
+			const size_t slash = path.find_last_of("/\\");
+			scene.name += (scene.name.empty() ? "" : "+") + path.substr(slash == std::string::npos ? 0 : slash + 1);
+		}
+		return scene;
+	}
+
+	void Add(const std::vector<Vertex>& vertices,
+			 const std::vector<uint32_t>& indices,
+			 TransformComponent transform,
+			 Device& device)
+	{
+		auto& registry = ECS::Get();
+		transform.UpdateModel();
+		for (const Vertex& vertex : vertices)
+		{
+			const glm::vec3 position = glm::vec3(transform.model * glm::vec4(vertex.pos, 1.0f));
+			min = glm::min(min, position);
+			max = glm::max(max, position);
+		}
+
+		auto entity = registry.create();
+		registry.emplace<TransformComponent>(entity, transform);
+		registry.emplace<DeferredRenderComponent>(entity).mesh = Mesh<Vertex>(vertices, indices, &device);
+		++objects;
+		triangles += indices.size() / 3;
+	}
+
+	static void Clear()
+	{
+		auto& registry = ECS::Get();
+		std::vector<entt::entity> entities;
+		registry.view<TransformComponent>().each([&entities](const entt::entity entity, TransformComponent&)
+		{
+			entities.push_back(entity);
+		});
+		for (entt::entity entity : entities)
+			registry.destroy(entity);
+	}
+
+	glm::vec3 Center() const { return (min + max) * 0.5f; }
+	float Radius() const { return glm::length(max - min) * 0.5f; }
+	// Of the cube around the scene the octree covers
+	float HalfExtent() const { return glm::max(glm::max(max.x - min.x, max.y - min.y), max.z - min.z) * 0.5f * 1.01f; }
+};
+
+// Queries every structure answers, the same for all of them
+struct BenchmarkWorkload
+{
+	std::vector<Primitives::Box> boxes;
+	std::vector<Primitives::Ray> rays;
+	std::vector<glm::mat4> viewProjections;
+	// Where each camera is, for the queries that order by distance instead of culling
+	std::vector<glm::vec3> eyes;
+	float maxT = FLT_MAX;
+
+	// One frame of a running scene: what the camera saw and picked, and where the
+	// colliders were
+	void Record(const glm::mat4& view,
+				const glm::mat4& projection,
+				const std::vector<Primitives::Box>& colliders)
+	{
+		const glm::mat4 invView = glm::inverse(view);
+		viewProjections.push_back(projection * view);
+		eyes.push_back(glm::vec3(invView[3]));
+		rays.push_back({ glm::vec3(invView[3]), -glm::vec3(invView[2]) });
+		boxes.insert(boxes.end(), colliders.begin(), colliders.end());
+	}
+
+	void Clear()
+	{
+		boxes.clear();
+		rays.clear();
+		viewProjections.clear();
+		eyes.clear();
+	}
+
+	// One query per line, its kind followed by its numbers
+	bool Save(const std::string& path) const
+	{
+		std::ofstream file(path);
+		if (!file) return false;
+
+		file.precision(9);
+		file << "maxT " << maxT << '\n';
+		for (const Primitives::Box& box : boxes)
+			file << "box " << box.position.x << ' ' << box.position.y << ' ' << box.position.z << ' '
+				 << box.halfExtent.x << ' ' << box.halfExtent.y << ' ' << box.halfExtent.z << '\n';
+		for (const Primitives::Ray& ray : rays)
+			file << "ray " << ray.position.x << ' ' << ray.position.y << ' ' << ray.position.z << ' '
+				 << ray.direction.x << ' ' << ray.direction.y << ' ' << ray.direction.z << '\n';
+		for (size_t i = 0; i < viewProjections.size(); ++i)
+		{
+			file << "frustum " << eyes[i].x << ' ' << eyes[i].y << ' ' << eyes[i].z;
+			const float* values = &viewProjections[i][0][0];
+			for (uint32_t j = 0; j < 16; ++j)
+				file << ' ' << values[j];
+			file << '\n';
+		}
+		return static_cast<bool>(file);
+	}
+
+	static bool Load(const std::string& path, BenchmarkWorkload& workload)
+	{
+		std::ifstream file(path);
+		if (!file) return false;
+
+		workload = BenchmarkWorkload();
+		std::string kind;
+		while (file >> kind)
+		{
+			if (kind == "maxT")
+			{
+				file >> workload.maxT;
+			}
+			else if (kind == "box")
+			{
+				Primitives::Box& box = workload.boxes.emplace_back();
+				file >> box.position.x >> box.position.y >> box.position.z
+					 >> box.halfExtent.x >> box.halfExtent.y >> box.halfExtent.z;
+			}
+			else if (kind == "ray")
+			{
+				Primitives::Ray& ray = workload.rays.emplace_back();
+				file >> ray.position.x >> ray.position.y >> ray.position.z
+					 >> ray.direction.x >> ray.direction.y >> ray.direction.z;
+			}
+			else if (kind == "frustum")
+			{
+				glm::vec3& eye = workload.eyes.emplace_back();
+				file >> eye.x >> eye.y >> eye.z;
+				float* values = &workload.viewProjections.emplace_back()[0][0];
+				for (uint32_t j = 0; j < 16; ++j)
+					file >> values[j];
+			}
+			else
+			{
+				return false;
+			}
+		}
+		return !file.bad();
+	}
+
+	// Boxes inside the scene, rays and cameras from around it looking into it
+	static BenchmarkWorkload Generate(const BenchmarkScene& scene,
+									  uint32_t boxCount,
+									  uint32_t rayCount,
+									  uint32_t frustumCount)
+	{
+		BenchmarkWorkload workload;
+		const glm::vec3 center = scene.Center();
+		const float radius = glm::max(scene.Radius(), 0.001f);
+		workload.maxT = radius * 4.0f;
+
+		auto inside = [&scene]()
+		{
+			return glm::vec3(utils::Random(scene.min.x, scene.max.x),
+							 utils::Random(scene.min.y, scene.max.y),
+							 utils::Random(scene.min.z, scene.max.z));
+		};
+		auto around = [center, radius]()
+		{
+			const glm::vec3 direction = glm::normalize(glm::vec3(utils::Random(-1.0f, 1.0f),
+																 utils::Random(-1.0f, 1.0f),
+																 utils::Random(-1.0f, 1.0f)) + glm::vec3(0.0f, 0.0f, 0.001f));
+			return center + direction * radius * 1.5f;
+		};
+
+		for (uint32_t i = 0; i < boxCount; ++i)
+			workload.boxes.push_back({ inside(), glm::vec3(radius * 0.02f) });
+
+		for (uint32_t i = 0; i < rayCount; ++i)
+		{
+			const glm::vec3 origin = around();
+			workload.rays.push_back({ origin, glm::normalize(inside() - origin) });
+		}
+
+		const glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, radius * 4.0f);
+		for (uint32_t i = 0; i < frustumCount; ++i)
+		{
+			const glm::vec3 eye = around();
+			workload.viewProjections.push_back(projection * glm::lookAt(eye, inside(), glm::vec3(0.0f, 1.0f, 0.0f)));
+			workload.eyes.push_back(eye);
+		}
+		return workload;
+	}
+};
+
+// One row of the output, queries a structure doesn't have are left empty
+struct BenchmarkResult
+{
+	std::string structure;
+	float buildMilliseconds = 0.0f;
+	size_t memoryBytes = 0;
+	uint32_t nodes = 0;
+	uint32_t leaves = 0;
+	// The build stopped splitting over its triangle budget, no queries were run
+	bool overBudget = false;
+
+	// Queries per second and what they found, negative when not run
+	double boxRate = -1.0;
+	uint64_t boxPairs = 0;
+	double rayRate = -1.0;
+	uint64_t rayHits = 0;
+	double frustumRate = -1.0;
+	uint64_t visibleEntities = 0;
+	// All queries together, what the tuner weighs the build against
+	float queryMilliseconds = 0.0f;
+
+	static void WriteCsvHeader(std::ostream& out)
+	{
+		out << "label,scene,objects,triangles,structure,build_ms,memory_bytes,nodes,leaves,"
+			   "box_queries_per_s,box_pairs,ray_queries_per_s,ray_hits,frustum_queries_per_s,visible_entities\n";
+	}
+
+	void WriteCsv(std::ostream& out, const std::string& label, const BenchmarkScene& scene) const
+	{
+		auto rate = [&out](double value)
+		{
+			if (value >= 0.0) out << value;
+			out << ',';
+		};
+
+		out << label << ',' << scene.name << ',' << scene.objects << ',' << scene.triangles << ','
+			<< structure << ',' << buildMilliseconds << ',' << memoryBytes << ',' << nodes << ',' << leaves << ',';
+		rate(boxRate);
+		out << (boxRate >= 0.0 ? std::to_string(boxPairs) : "") << ',';
+		rate(rayRate);
+		out << (rayRate >= 0.0 ? std::to_string(rayHits) : "") << ',';
+		rate(frustumRate);
+		out << (frustumRate >= 0.0 ? std::to_string(visibleEntities) : "") << '\n';
+	}
+};
+
+class Benchmark
+{
+public:
+	// Build the structure repeat times and keep the fastest build, then run the
+	// workload against the last one. Build is called with the structure destroyed
+	template <typename Structure, typename BuildFunc>
+	static BenchmarkResult Run(const std::string& name,
+							   Structure& structure,
+							   BuildFunc&& build,
+							   const BenchmarkWorkload& workload,
+							   uint32_t repeat)
+	{
+		BenchmarkResult result;
+		result.structure = name;
+		result.buildMilliseconds = FLT_MAX;
+		for (uint32_t i = 0; i < std::max(repeat, 1u); ++i)
+		{
+			if (structure.IsInitialized())
+				structure.Destroy();
+			const float milliseconds = Time([&]() { build(structure); });
+			result.buildMilliseconds = std::min(result.buildMilliseconds, milliseconds);
+			if (structure.GetStats().overBudget)
+				break;
+		}
+
+		const SpatialStats& stats = structure.GetStats();
+		result.memoryBytes = stats.memoryBytes;
+		result.nodes = stats.nodeCount;
+		result.leaves = stats.leafCount;
+		if (stats.overBudget)
+		{
+			result.overBudget = true;
+			structure.Destroy();
+			return result;
+		}
+		stats.ResetQueries();
+
+		if constexpr (std::is_same_v<Structure, BSP>)
+		{
+			// The BSP doesn't cull, it orders what each camera draws. What it visits
+			// stands in for the visible entities, unreported as there is no frustum rate
+			result.queryMilliseconds = Time([&]()
+			{
+				for (const glm::vec3& eye : workload.eyes)
+					structure.TraverseOrdered(eye, [&result](const auto&) { ++result.visibleEntities; });
+			});
+		}
+		else
+		{
+			RunQueries(structure, workload, result);
+		}
+
+		structure.Destroy();
+		return result;
+	}
+
+	template <typename Func>
+	static float Time(Func&& func)
+	{
+		auto start = std::chrono::steady_clock::now();
+		func();
+		std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		return elapsed.count();
+	}
+
+private:
+	template <typename Structure>
+	static void RunQueries(Structure& structure, const BenchmarkWorkload& workload, BenchmarkResult& result)
+	{
+		auto rate = [](size_t count, float milliseconds)
+		{
+			return count == 0 ? 0.0 : count / (std::max(milliseconds, 0.001f) / 1000.0);
+		};
+
+		std::vector<typename Structure::CollisionPair> pairs;
+		float milliseconds = Time([&]() { structure.CollisionQuery(workload.boxes, pairs); });
+		result.boxRate = rate(workload.boxes.size(), milliseconds);
+		result.boxPairs = pairs.size();
+		result.queryMilliseconds += milliseconds;
+
+		milliseconds = Time([&]()
+		{
+			for (const Primitives::Ray& ray : workload.rays)
+			{
+				if (structure.RayCast(ray, workload.maxT))
+					++result.rayHits;
+			}
+		});
+		result.rayRate = rate(workload.rays.size(), milliseconds);
+		result.queryMilliseconds += milliseconds;
+
+		std::vector<entt::entity> visible;
+		milliseconds = Time([&]()
+		{
+			for (const glm::mat4& viewProjection : workload.viewProjections)
+			{
+				structure.FrustumQuery(viewProjection, visible);
+				result.visibleEntities += visible.size();
+			}
+		});
+		result.frustumRate = rate(workload.viewProjections.size(), milliseconds);
+		result.queryMilliseconds += milliseconds;
+	}
+};
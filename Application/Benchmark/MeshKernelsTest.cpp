@@ -0,0 +1,151 @@
+#include <random>
+
+using namespace bk;
+
+// Runs the mesh kernels on random positions and planes with every instruction set
+// the CPU has, and checks each result against plain glm code. Exits with a failure
+// on the first case that differs, for ctest
+namespace
+{
+constexpr uint32_t CaseCount = 20000;
+constexpr uint32_t MaxPositions = 67;
+
+struct Case
+{
+	std::vector<PosVertex> vertices;
+	PositionArrays arrays;
+	Primitives::Plane planes[MeshKernels::MaxPlanes];
+	uint32_t planeCount = 0;
+	// Read through the vertices or through the arrays
+	bool interleaved = false;
+
+	PositionView View() const
+	{
+		return interleaved ? PositionView::FromVertices(vertices.data(), vertices.size()) : arrays.View();
+	}
+};
+
+Case GenerateCase(std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	// Counts below and around the vector widths hit the scalar tails
+	std::uniform_int_distribution<uint32_t> counts(0, MaxPositions);
+	std::uniform_int_distribution<uint32_t> planeCounts(1, MeshKernels::MaxPlanes);
+
+	Case test;
+	test.interleaved = rng() & 1;
+	test.vertices.resize(counts(rng));
+	// Clustered positions are often entirely on one side of a plane
+	const glm::vec3 center(unit(rng) * 10.0f, unit(rng) * 10.0f, unit(rng) * 10.0f);
+	const float spread = (rng() & 1) ? 0.5f : 10.0f;
+	for (auto& vertex : test.vertices)
+		vertex.pos = center + glm::vec3(unit(rng), unit(rng), unit(rng)) * spread;
+	test.arrays.Assign(test.vertices.data(), test.vertices.size());
+
+	test.planeCount = planeCounts(rng);
+	for (uint32_t p = 0; p < test.planeCount; ++p)
+	{
+		Primitives::Plane& plane = test.planes[p];
+		glm::vec3 normal(unit(rng), unit(rng), unit(rng));
+		// Axis aligned planes, like the octree's, put positions exactly on the plane
+		if (rng() % 4 == 0)
+			normal = glm::vec3(0.0f);
+		normal[rng() % 3] += 1.0f;
+		plane.normal = glm::normalize(normal);
+		plane.position = (rng() % 4 == 0 && !test.vertices.empty()) ?
+			test.vertices[rng() % test.vertices.size()].pos :
+			center + glm::vec3(unit(rng), unit(rng), unit(rng)) * spread;
+		plane.D = glm::dot(plane.normal, plane.position);
+	}
+	return test;
+}
+
+void ReferenceClassify(const Case& test, uint32_t planeIndex, int& result, float& minDistance)
+{
+	const Primitives::Plane& plane = test.planes[planeIndex];
+	bool positive = false, negative = false;
+	minDistance = FLT_MAX;
+	for (const auto& vertex : test.vertices)
+	{
+		const float distance = glm::dot(plane.normal, vertex.pos - plane.position);
+		positive |= distance > Primitives::Plane::thickness;
+		negative |= distance < -Primitives::Plane::thickness;
+		minDistance = std::min(minDistance, std::abs(distance));
+	}
+	// Nothing off the plane counts as in front
+	result = (positive && negative) ? 0 : (negative ? -1 : 1);
+}
+
+void ReferenceBounds(const Case& test, glm::vec3& min, glm::vec3& max)
+{
+	min = glm::vec3(FLT_MAX);
+	max = glm::vec3(-FLT_MAX);
+	for (const auto& vertex : test.vertices)
+	{
+		min = glm::min(min, vertex.pos);
+		max = glm::max(max, vertex.pos);
+	}
+}
+
+// Distances are the same sums in the same order, so they match to the bit
+bool CheckCase(const Case& test, uint32_t index, MeshKernels::InstructionSet set)
+{
+	const PositionView view = test.View();
+	const char* name = MeshKernels::GetName(set);
+
+	int results[MeshKernels::MaxPlanes];
+	float minDistances[MeshKernels::MaxPlanes];
+	MeshKernels::ClassifyPlanes(view, test.planes, test.planeCount, results, minDistances);
+	for (uint32_t p = 0; p < test.planeCount; ++p)
+	{
+		int expected;
+		float expectedDistance;
+		ReferenceClassify(test, p, expected, expectedDistance);
+
+		float distance;
+		const int result = MeshKernels::ClassifyPlane(view, test.planes[p], &distance);
+		if (results[p] != expected || result != expected ||
+			minDistances[p] != expectedDistance || distance != expectedDistance)
+		{
+			std::cerr << name << " case " << index << " plane " << p << " of " << test.planeCount
+					  << ": classified " << results[p] << " and " << result << ", expected " << expected
+					  << ", min distance " << minDistances[p] << " and " << distance
+					  << ", expected " << expectedDistance << "\n";
+			return false;
+		}
+	}
+
+	glm::vec3 min, max, expectedMin, expectedMax;
+	MeshKernels::GetBounds(view, min, max);
+	ReferenceBounds(test, expectedMin, expectedMax);
+	if (min != expectedMin || max != expectedMax)
+	{
+		std::cerr << name << " case " << index << ": bounds differ over "
+				  << test.vertices.size() << " positions\n";
+		return false;
+	}
+	return true;
+}
+}
+
+int main()
+{
+	const auto supported = MeshKernels::GetSupportedInstructionSet();
+	std::mt19937 rng(133333337);
+
+	for (uint32_t i = 0; i < CaseCount; ++i)
+	{
+		const Case test = GenerateCase(rng);
+		for (int set = 0; set <= static_cast<int>(supported); ++set)
+		{
+			MeshKernels::SetInstructionSet(static_cast<MeshKernels::InstructionSet>(set));
+			if (!CheckCase(test, i, static_cast<MeshKernels::InstructionSet>(set)))
+				return EXIT_FAILURE;
+		}
+	}
+
+	for (int set = 0; set <= static_cast<int>(supported); ++set)
+		std::cout << MeshKernels::GetName(static_cast<MeshKernels::InstructionSet>(set)) << " ";
+	std::cout << "match the reference over " << CaseCount << " cases\n";
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+// Searches the build parameters of the octree and the BSP for a scene, one
+// parameter at a time over a few candidates, keeping whichever makes the build
+// and the workload cheapest together. Builds and queries run through Benchmark
+class SpatialTuner
+{
+public:
+	SpatialTuner(const BenchmarkScene& scene, const BenchmarkWorkload& workload, Device& device)
+		: m_scene(scene), m_workload(workload), m_device(&device)
+	{
+	}
+
+	// Starts from the parameters the structures currently have, leaves the best applied
+	SpatialTuning Tune(bool octree, bool bsp)
+	{
+		SpatialTuning best = SpatialTuning::Capture();
+		if (octree)
+		{
+			float cost = OctreeCost(best);
+			Descend(best, &SpatialTuning::octreeMinimumTriangles, TriangleCandidates,
+					"Octree::MinimumTriangles", cost, [this](const SpatialTuning& tuning) { return OctreeCost(tuning); });
+		}
+		if (bsp)
+		{
+			// The BSP parameters trade against each other, so go over them again
+			// until none of them changes
+			auto cost = [this](const SpatialTuning& tuning) { return BspCost(tuning); };
+			float bestCost = cost(best);
+			for (uint32_t pass = 0; pass < MaxPasses; ++pass)
+			{
+				bool changed = Descend(best, &SpatialTuning::bspMinimumTriangles, TriangleCandidates,
+									   "BSP::MinimumTriangles", bestCost, cost);
+				changed |= Descend(best, &SpatialTuning::bspSplitBlend, SplitBlendCandidates,
+								   "BSP::SplitBlend", bestCost, cost);
+				changed |= Descend(best, &SpatialTuning::bspPlaneSamples, PlaneSampleCandidates,
+								   "BSP::PlaneSamples", bestCost, cost);
+				if (!changed) break;
+			}
+		}
+		best.Apply();
+		return best;
+	}
+
+	// A millisecond of build costs this many milliseconds of queries. Above 1 for
+	// scenes that rebuild often, below for ones that build once and query for long
+	inline static float BuildWeight = 1.0f;
+	// Builds per candidate, the fastest counts
+	inline static uint32_t Repeat = 3;
+	inline static uint32_t MaxPasses = 3;
+	// A candidate has to be this much cheaper to replace the current value, so
+	// that timing noise doesn't move the parameters around
+	inline static float Tolerance = 0.02f;
+	// Candidates whose builds store more than this many times the scene's triangles
+	// are rejected, and their builds stop splitting as soon as they do
+	inline static float MaxTriangleGrowth = 8.0f;
+
+	inline static std::vector<uint32_t> TriangleCandidates = { 16, 32, 64, 128, 256, 500, 1000, 2000, 4000 };
+	inline static std::vector<float> SplitBlendCandidates = { 0.0f, 0.2f, 0.4f, 0.6f, 0.8f, 1.0f };
+	inline static std::vector<uint32_t> PlaneSampleCandidates = { 1, 3, 5, 9, 17 };
+
+private:
+	// Try every candidate for one parameter with the others fixed
+	template <typename T, typename CostFunc>
+	bool Descend(SpatialTuning& tuning,
+				 T SpatialTuning::* parameter,
+				 const std::vector<T>& candidates,
+				 const char* name,
+				 float& bestCost,
+				 CostFunc&& cost)
+	{
+		const T start = tuning.*parameter;
+		T bestValue = start;
+		for (const T& candidate : candidates)
+		{
+			if (candidate == start) continue;
+
+			SpatialTuning trial = tuning;
+			trial.*parameter = candidate;
+			const float trialCost = cost(trial);
+			std::cerr << name << " " << candidate << ": " << trialCost << " ms\n";
+			if (trialCost < bestCost * (1.0f - Tolerance))
+			{
+				bestCost = trialCost;
+				bestValue = candidate;
+			}
+		}
+		tuning.*parameter = bestValue;
+		std::cerr << name << " = " << bestValue << " (" << bestCost << " ms)\n";
+		return bestValue != start;
+	}
+
+	float OctreeCost(const SpatialTuning& tuning)
+	{
+		const glm::vec3 center = m_scene.Center();
+		const float halfExtent = m_scene.HalfExtent();
+		return Cost<Octree>(tuning, "octree", [&](Octree& structure)
+		{
+			structure.Create(center, halfExtent, 0, *m_device);
+		});
+	}
+
+	float BspCost(const SpatialTuning& tuning)
+	{
+		return Cost<BSP>(tuning, "bsp", [&](BSP& structure)
+		{
+			structure.Create(0, *m_device);
+		});
+	}
+
+	template <typename Structure, typename BuildFunc>
+	float Cost(const SpatialTuning& tuning, const char* name, BuildFunc&& build)
+	{
+		tuning.Apply();
+		// Clipping can keep splitting slivers until memory runs out, such settings
+		// are never the cheapest
+		const float growth = Structure::MaxTriangleGrowth;
+		Structure::MaxTriangleGrowth = MaxTriangleGrowth;
+		Structure structure;
+		const BenchmarkResult result = Benchmark::Run(name, structure, build, m_workload, Repeat);
+		Structure::MaxTriangleGrowth = growth;
+		if (result.overBudget)
+			return FLT_MAX;
+		return result.buildMilliseconds * BuildWeight + result.queryMilliseconds;
+	}
+
+	const BenchmarkScene& m_scene;
+	const BenchmarkWorkload& m_workload;
+	Device* m_device;
+};
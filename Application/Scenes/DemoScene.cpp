@@ -4,7 +4,10 @@
 #include "imgui_impl_glfw.h"
 #include "Camera/Camera.h"
 #include "Overlay/Blocks/EntityEditorBlock.h"
+#include "Overlay/Blocks/SpatialStatsEditorBlock.h"
 #include "Job/Job.h"
+#include "Application/SpatialPartitioning/SpatialPartitioning.hpp"
+#include "Application/Benchmark/Benchmark.hpp"
 
 constexpr glm::uvec2 FB_SIZE = {1600, 900};
 
@@ -140,8 +143,21 @@ public:
 	bool cursorActive = false;
 
 	RenderComponentSystem* renderSystem = nullptr;
-	//Octree octree;
-	//BSP bsp;
+	Octree octree;
+	bool frustumCulling = true;
+	std::vector<entt::entity> visibleEntities;
+	BSP bsp;
+	bool frontToBack = true;
+	std::vector<entt::entity> orderedEntities;
+	std::unordered_set<entt::entity> pendingEntities;
+	BVH bvh;
+	TwoLevelBVH twoLevelBvh;
+	// Structure the frustum is culled with
+	enum class Culling { Octree, BVH, TwoLevelBVH };
+	Culling culling = Culling::Octree;
+	// Camera and collider traffic for SpatialBenchmark --workload to tune against
+	BenchmarkWorkload recordedWorkload;
+	bool recordWorkload = false;
 
 	entt::entity sphere;
 	float sphereSpeed = 1.0f;
@@ -242,6 +258,14 @@ public:
 	void Destroy() override
 	{
 		device.waitIdle();
+		if (octree.IsInitialized())
+			octree.Destroy();
+		if (bsp.IsInitialized())
+			bsp.Destroy();
+		if (bvh.IsInitialized())
+			bvh.Destroy();
+		if (twoLevelBvh.IsInitialized())
+			twoLevelBvh.Destroy();
 
 		commandPool.FreeCommandBuffers(
 				gBuffer.drawBuffers,
@@ -361,6 +385,18 @@ public:
 		);
 		entityWindow->AddBlock(entityEditor);
 		overlay->PushEditorWindow(entityWindow);
+
+		auto spatialWindow = new EditorWindow("Spatial Partitioning");
+		auto spatialStats = new SpatialStatsEditorBlock();
+		spatialStats->AddStats("Octree", octree.GetStats());
+		spatialStats->AddStats("BSP", bsp.GetStats());
+		spatialStats->AddStats("BVH", bvh.GetStats());
+		spatialStats->AddStats("Two-Level BVH", twoLevelBvh.GetStats());
+		auto& physicsSystem = ECS::GetSystem<PhysicsComponentSystem>();
+		spatialStats->AddStats("Spatial Hash Grid", physicsSystem.GetSpatialHashGrid().GetStats());
+		spatialStats->AddStats("Sweep and Prune", physicsSystem.GetSweepAndPrune().GetStats());
+		spatialWindow->AddBlock(spatialStats);
+		overlay->PushEditorWindow(spatialWindow);
 	}
 
 
@@ -1513,7 +1549,28 @@ public:
 		inherit.setFramebuffer(gBuffer.frameBuffers[imageIndex].VkType());
 		inherit.setRenderPass(gBuffer.renderPass.VkType());
 
-		if (gBuffer.render) {
+		const bool culled = frustumCulling &&
+			(culling == Culling::Octree ? octree.IsInitialized() :
+			 culling == Culling::BVH ? bvh.IsInitialized() : twoLevelBvh.IsInitialized());
+		const bool ordered = frontToBack && bsp.IsInitialized();
+		if (gBuffer.render && (culled || ordered)) {
+			const glm::mat4 viewProjection = uboViewProjection.projection * uboViewProjection.view;
+			if (culled && culling == Culling::Octree)
+				octree.FrustumQuery(viewProjection, visibleEntities);
+			else if (culled && culling == Culling::BVH)
+				bvh.FrustumQuery(viewProjection, visibleEntities);
+			else if (culled)
+				twoLevelBvh.FrustumQuery(viewProjection, visibleEntities);
+			if (ordered)
+				OrderFrontToBack(culled);
+			renderSystem->RenderEntities<DeferredRenderComponent>(
+					cmdBuf,
+					descriptors.sets[imageIndex],
+					gBuffer.pipelineLayout.VkType(),
+					ordered ? orderedEntities : visibleEntities
+			);
+		}
+		else if (gBuffer.render) {
 			renderSystem->RenderEntities<DeferredRenderComponent>(
 					cmdBuf,
 					descriptors.sets[imageIndex],
@@ -1691,6 +1748,32 @@ public:
 		cmdBuf.End();
 	}
 
+	// Order the entities to draw front-to-back through the BSP for early depth
+	// rejection, the visible ones if culled. Entities the BSP was built without go last
+	void OrderFrontToBack(bool culled)
+	{
+		pendingEntities.clear();
+		if (culled)
+		{
+			pendingEntities.insert(visibleEntities.begin(), visibleEntities.end());
+		}
+		else
+		{
+			auto view = ECS::Get().view<TransformComponent, DeferredRenderComponent>();
+			for (entt::entity entity : view)
+				pendingEntities.insert(entity);
+		}
+
+		orderedEntities.clear();
+		const glm::vec3 eye = glm::vec3(glm::inverse(uboViewProjection.view)[3]);
+		bsp.TraverseOrdered(eye, [this](const BSP::Object& obj)
+		{
+			if (pendingEntities.erase(obj.entity))
+				orderedEntities.push_back(obj.entity);
+		});
+		orderedEntities.insert(orderedEntities.end(), pendingEntities.begin(), pendingEntities.end());
+	}
+
 	void RecordForward(uint32_t imageIndex)
 	{
 		auto& cmdBuf = drawBuffers[imageIndex];
@@ -1820,7 +1903,9 @@ public:
 			//	debugLineList.pipelineLayout,
 			//	&debugLineList.mesh
 			//);
-			//octree.RenderCells(cmdBuf, debugLineList.pipelineLayout);
+			octree.RenderCells(cmdBuf, debugLineList.pipelineLayout);
+			bvh.RenderCells(cmdBuf, debugLineList.pipelineLayout);
+			twoLevelBvh.RenderCells(cmdBuf, debugLineList.pipelineLayout);
 		}
 		cmdBuf.endRenderPass();
 		cmdBuf.end();
@@ -1862,14 +1947,22 @@ public:
 			//		debugLineStrip.pipelineLayout
 			//		);
 			//}
-//			if (octree.IsInitialized())
-//			{
-//				octree.RenderObjects(cmdBuf, debugLineStrip.pipelineLayout);
-//			}
-//			if (bsp.IsInitialized())
-//			{
-//				bsp.RenderObjects(cmdBuf, debugLineStrip.pipelineLayout);
-//			}
+			if (octree.IsInitialized())
+			{
+				octree.RenderObjects(cmdBuf, debugLineStrip.pipelineLayout);
+			}
+			if (bsp.IsInitialized())
+			{
+				bsp.RenderObjects(cmdBuf, debugLineStrip.pipelineLayout);
+			}
+			if (bvh.IsInitialized())
+			{
+				bvh.RenderObjects(cmdBuf, debugLineStrip.pipelineLayout);
+			}
+			if (twoLevelBvh.IsInitialized())
+			{
+				twoLevelBvh.RenderObjects(cmdBuf, debugLineStrip.pipelineLayout);
+			}
 
 			//auto* sphereRender = &ECS::Get().get<DebugRenderComponent>(sphere);
 			//sphereRender->mesh.Bind(cmdBuf);
@@ -2188,7 +2281,24 @@ public:
 		static float speed = 90.0f;
 		UpdateInput(dt);
 		UpdateObjects(dt);
-		//bsp.Update(dt);
+		octree.Update(ECS::GetSystem<TransformComponentSystem>().GetUpdated());
+		bsp.Update(dt);
+		bvh.Update(ECS::GetSystem<TransformComponentSystem>().GetUpdated());
+		twoLevelBvh.Update(ECS::GetSystem<TransformComponentSystem>().GetUpdated());
+
+		if (recordWorkload)
+		{
+			std::vector<Primitives::Box> colliders;
+			ECS::Get().view<TransformComponent, PhysicsComponent>().each([&colliders](const TransformComponent& transform,
+																					   const PhysicsComponent& physics)
+			{
+				glm::vec3 min, max;
+				physics.GetWorldBounds(transform.model, min, max);
+				colliders.push_back({ (min + max) * 0.5f, (max - min) * 0.5f });
+			});
+			recordedWorkload.Record(uboViewProjection.view, uboViewProjection.projection, colliders);
+			recordedWorkload.maxT = camera.GetFarClip();
+		}
 
 		//static auto sphereBox = ECS::Get().get<DebugRenderComponent>(sphere).mesh.GetBoundingBox();
 		//static glm::vec3 localPosition = sphereBox.position;
@@ -2199,7 +2309,7 @@ public:
 
 		//sphereBox.position = sphereTranslate * glm::vec4(localPosition, 1.0f);
 		//sphereBox.halfExtent = sphereScale * glm::vec4(localScale, 1.0f);
-		//if (octree.CollisionTest(sphereBox, sphereTransform->model))
+		//if (octree.CollisionTest(sphereBox))
 		//	ECS::Get().get<PhysicsComponent>(sphere).velocity = glm::vec3(0.0f);
 
 		camera.Update(dt, !cursorActive);
@@ -2240,63 +2350,260 @@ public:
 			ImGui::TreePop();
 		}
 
-//		if (ImGui::TreeNode("Octree Settings"))
-//		{
-//			static int depth = 1;
-//			static glm::vec3 position = glm::vec3(0.0f);
-//			static float halfExtent = 10.0f;
-//
-//			ImGui::InputInt("Minimum Triangles", (int*) &Octree::MinimumTriangles);
-//			//ImGui::SliderInt("Depth", &depth, 0, 6);
-//			ImGui::InputFloat3("Position", &position[0]);
-//			ImGui::InputFloat("Half-Extent", &halfExtent);
-//			ImGui::Checkbox("Display Cells", &debugLineList.render);
-//			ImGui::Checkbox("Display Objects", &debugLineStrip.render);
-//
-//			if (!octree.IsInitialized())
-//			{
-//				if (ImGui::Button("Create"))
-//				{
-//					octree.Create(position, halfExtent, depth);
-//				}
-//			}
-//			else
-//			{
-//				if (ImGui::Button("Destroy"))
-//				{
-//					octree.Destroy();
-//				}
-//			}
-//
-//			ImGui::TreePop();
-//		}
+		if (ImGui::TreeNode("Octree Settings"))
+		{
+			static int depth = 1;
+			static glm::vec3 position = glm::vec3(0.0f);
+			static float halfExtent = 10.0f;
+			static bool useCache = true;
+
+			ImGui::InputInt("Minimum Triangles", (int*) &Octree::MinimumTriangles);
+			//ImGui::SliderInt("Depth", &depth, 0, 6);
+			ImGui::InputFloat3("Position", &position[0]);
+			ImGui::InputFloat("Half-Extent", &halfExtent);
+			ImGui::Checkbox("Display Cells", &debugLineList.render);
+			ImGui::Checkbox("Display Objects", &debugLineStrip.render);
+			ImGui::Checkbox("Frustum Culling", &frustumCulling);
+			ImGui::Combo("Cull With", (int*) &culling, "Octree\0BVH\0Two-Level BVH\0");
+			if (octree.IsInitialized())
+			{
+				ImGui::Text("Visible Entities: %d", (int) visibleEntities.size());
+
+				// Pick through the center of the screen
+				const glm::mat4 invView = glm::inverse(uboViewProjection.view);
+				Primitives::Ray ray = { glm::vec3(invView[3]), -glm::vec3(invView[2]) };
+				if (auto hit = octree.RayCast(ray, camera.GetFarClip()))
+					ImGui::Text("Picked Entity: %d, Triangle: %d, t: %.2f",
+								(int) hit->entity, (int) hit->triangle, hit->t);
+				else
+					ImGui::Text("Picked Entity: None");
+			}
 
-		//if(ImGui::TreeNode("BSP Settings"))
-		//{
-		//	static int depth = 1;
+			if (!octree.IsInitialized())
+			{
+				// Changing the mode of a built tree would break its updates
+				ImGui::Checkbox("Loose", &Octree::Loose);
+				if (Octree::Loose)
+					ImGui::SliderFloat("Looseness", &Octree::Looseness, 1.0f, 3.0f);
+				ImGui::Checkbox("Use Cache", &useCache);
+				if (ImGui::Button("Create"))
+				{
+					// The cache is only used if it was built from this scene and these settings
+					static const std::string cachePath = "octree.cache";
+					if (!useCache || !octree.Load(cachePath, position, halfExtent, depth, device))
+					{
+						octree.Create(position, halfExtent, depth, device);
+						if (useCache)
+							octree.Save(cachePath);
+					}
+				}
+			}
+			else
+			{
+				if (ImGui::Button("Destroy"))
+				{
+					octree.Destroy();
+				}
+			}
 
-		//	ImGui::InputInt("Minimum Triangles", (int*)&BSP::MinimumTriangles);
-		//	ImGui::SliderFloat("Split Blend", &BSP::SplitBlend, 0.0f, 1.0f);
-		//	ImGui::SliderInt("Plane Samples", (int*)&BSP::PlaneSamples, 1, 32);
-		//	ImGui::Checkbox("Display Objects", &debugLineStrip.render);
+			ImGui::TreePop();
+		}
 
-		//	if (!bsp.IsInitialized())
-		//	{
-		//		if (ImGui::Button("Create"))
-		//		{
-		//			bsp.Create(depth);
-		//		}
-		//	}
-		//	else
-		//	{
-		//		if (ImGui::Button("Destroy"))
-		//		{
-		//			bsp.Destroy();
-		//		}
-		//	}
+		if(ImGui::TreeNode("BSP Settings"))
+		{
+			// 0 splits until nodes are under the minimum triangles
+			static int depth = 0;
+
+			ImGui::SliderInt("Maximum Depth", &depth, 0, 63);
+			ImGui::InputInt("Minimum Triangles", (int*)&BSP::MinimumTriangles);
+			ImGui::SliderFloat("Split Blend", &BSP::SplitBlend, 0.0f, 1.0f);
+			ImGui::SliderInt("Plane Samples", (int*)&BSP::PlaneSamples, 1, 32);
+			ImGui::InputInt("Score Samples", (int*)&BSP::ScoreSamples);
+			ImGui::Checkbox("Front-to-Back Deferred Pass", &frontToBack);
+			ImGui::Checkbox("Display Objects", &debugLineStrip.render);
+
+			if (!bsp.IsInitialized())
+			{
+				if (ImGui::Button("Create"))
+				{
+					bsp.Create(depth, device);
+				}
+			}
+			else
+			{
+				if (ImGui::Button("Destroy"))
+				{
+					bsp.Destroy();
+				}
+			}
 
-		//	ImGui::TreePop();
-		//}
+			ImGui::TreePop();
+		}
+
+		if (ImGui::TreeNode("BVH Settings"))
+		{
+			ImGui::InputInt("Minimum Triangles", (int*)&BVH::MinimumTriangles);
+			ImGui::InputInt("Maximum Triangles", (int*)&BVH::MaximumTriangles);
+			ImGui::SliderInt("Bins", (int*)&BVH::BinCount, 2, 64);
+			ImGui::SliderFloat("Traversal Cost", &BVH::TraversalCost, 0.0f, 4.0f);
+			ImGui::SliderInt("Parallel Depth", (int*)&BVH::ParallelDepth, 0, 8);
+			ImGui::SliderInt("Display Depth", &BVH::DisplayDepth, 0, 16);
+			ImGui::SliderFloat("Rebuild Threshold", &BVH::RebuildThreshold, 1.0f, 4.0f);
+			ImGui::Checkbox("Display Cells", &debugLineList.render);
+			ImGui::Checkbox("Display Objects", &debugLineStrip.render);
+			if (bvh.IsInitialized())
+			{
+				// Pick through the center of the screen
+				const glm::mat4 invView = glm::inverse(uboViewProjection.view);
+				Primitives::Ray ray = { glm::vec3(invView[3]), -glm::vec3(invView[2]) };
+				if (auto hit = bvh.RayCast(ray, camera.GetFarClip()))
+					ImGui::Text("Picked Entity: %d, Triangle: %d, t: %.2f",
+								(int) hit->entity, (int) hit->triangle, hit->t);
+				else
+					ImGui::Text("Picked Entity: None");
+			}
+
+			if (!bvh.IsInitialized())
+			{
+				if (ImGui::Button("Create"))
+				{
+					bvh.Create(device);
+				}
+			}
+			else
+			{
+				if (ImGui::Button("Destroy"))
+				{
+					bvh.Destroy();
+				}
+			}
+
+			ImGui::TreePop();
+		}
+
+		if (ImGui::TreeNode("Two-Level BVH Settings"))
+		{
+			// Shares the BVH's build settings and display depth
+			ImGui::Checkbox("Display Cells", &debugLineList.render);
+			ImGui::Checkbox("Display Objects", &debugLineStrip.render);
+			if (twoLevelBvh.IsInitialized())
+			{
+				ImGui::Text("Instances: %d, Meshes: %d",
+							(int) twoLevelBvh.GetInstances().size(), (int) twoLevelBvh.GetBlases().size());
+
+				// Pick through the center of the screen
+				const glm::mat4 invView = glm::inverse(uboViewProjection.view);
+				Primitives::Ray ray = { glm::vec3(invView[3]), -glm::vec3(invView[2]) };
+				if (auto hit = twoLevelBvh.RayCast(ray, camera.GetFarClip()))
+					ImGui::Text("Picked Entity: %d, Triangle: %d, t: %.2f",
+								(int) hit->entity, (int) hit->triangle, hit->t);
+				else
+					ImGui::Text("Picked Entity: None");
+			}
+
+			if (!twoLevelBvh.IsInitialized())
+			{
+				if (ImGui::Button("Create"))
+				{
+					twoLevelBvh.Create(device);
+				}
+			}
+			else
+			{
+				if (ImGui::Button("Destroy"))
+				{
+					twoLevelBvh.Destroy();
+				}
+			}
+
+			ImGui::TreePop();
+		}
+
+		if (ImGui::TreeNode("Broad-Phase Settings"))
+		{
+			static float speed = 1.0f;
+			auto& physicsSystem = ECS::GetSystem<PhysicsComponentSystem>();
+
+			auto broadPhase = physicsSystem.GetBroadPhase();
+			if (ImGui::Combo("Broad-Phase", (int*) &broadPhase, "Spatial Hash Grid\0Sweep and Prune\0"))
+				physicsSystem.SetBroadPhase(broadPhase);
+			ImGui::SliderFloat("Speed", &speed, 0.0f, 10.0f);
+			if (broadPhase == PhysicsComponentSystem::BroadPhase::SpatialHashGrid)
+			{
+				ImGui::SliderFloat("Cell Size", &SpatialHashGrid::CellSize, 0.25f, 16.0f);
+				ImGui::InputInt("Max Body Cells", (int*) &SpatialHashGrid::MaxBodyCells);
+				ImGui::Text("Overlapping Pairs: %d", (int) physicsSystem.GetSpatialHashGrid().GetPairs().size());
+			}
+			else
+			{
+				const SweepAndPrune& sweepAndPrune = physicsSystem.GetSweepAndPrune();
+				ImGui::InputInt("Rebuild Ratio", (int*) &SweepAndPrune::RebuildRatio);
+				ImGui::Text("Overlapping Pairs: %d, Added: %d, Removed: %d", (int) sweepAndPrune.GetPairCount(),
+							(int) sweepAndPrune.GetAddedPairs().size(), (int) sweepAndPrune.GetRemovedPairs().size());
+			}
+
+			// Send the rendered entities drifting so the broad-phase has moving bodies
+			if (ImGui::Button("Scatter"))
+			{
+				auto& reg = ECS::Get();
+				std::vector<entt::entity> entities;
+				reg.view<DeferredRenderComponent>().each([&entities](const entt::entity entity, DeferredRenderComponent&)
+				{
+					entities.push_back(entity);
+				});
+				for (entt::entity entity : entities)
+				{
+					auto* physics = reg.try_get<PhysicsComponent>(entity);
+					if (physics == nullptr)
+						physics = &reg.emplace<PhysicsComponent>(entity);
+					physics->velocity = glm::vec3(utils::Random(-1.0f, 1.0f),
+												  utils::Random(-1.0f, 1.0f),
+												  utils::Random(-1.0f, 1.0f)) * speed;
+				}
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Stop"))
+			{
+				ECS::Get().view<PhysicsComponent>().each([](PhysicsComponent& physics)
+				{
+					physics.velocity = glm::vec3(0.0f);
+				});
+			}
+
+			ImGui::TreePop();
+		}
+
+		if (ImGui::TreeNode("Tuning"))
+		{
+			// The scene is SpatialBenchmark's demo scene, so these files work with
+			// --scene demo --workload demo-1000.workload --tune
+			static char workloadPath[256] = "demo-1000.workload";
+			static char tuningPath[256] = "demo-1000.tuning";
+
+			ImGui::Checkbox("Record Workload", &recordWorkload);
+			ImGui::Text("Frames: %d, Collider Boxes: %d",
+						(int) recordedWorkload.viewProjections.size(), (int) recordedWorkload.boxes.size());
+			ImGui::InputText("Workload", workloadPath, sizeof(workloadPath));
+			if (ImGui::Button("Save Workload"))
+				recordedWorkload.Save(workloadPath);
+			ImGui::SameLine();
+			if (ImGui::Button("Clear Workload"))
+				recordedWorkload.Clear();
+
+			// Applies to the next Create of the octree and BSP
+			ImGui::InputText("Tuning", tuningPath, sizeof(tuningPath));
+			if (ImGui::Button("Load Tuning"))
+			{
+				SpatialTuning tuning = SpatialTuning::Capture();
+				if (tuning.Load(tuningPath))
+					tuning.Apply();
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Save Tuning"))
+				SpatialTuning::Capture().Save(tuningPath);
+
+			ImGui::TreePop();
+		}
 
 		if (ImGui::TreeNode("Sphere Collider Settings")) {
 			static float scale = 1.0f;
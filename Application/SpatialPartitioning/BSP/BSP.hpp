@@ -3,227 +3,504 @@ class BSP
 {
 
 public:
+	// Objects only hold ranges into the tree's geometry pools
+	struct Object
+	{
+		entt::entity entity;
+		uint32_t firstVertex = 0;
+		uint32_t vertexCount = 0;
+		uint32_t firstIndex = 0;
+		uint32_t indexCount = 0;
+	};
+
+	// Nodes are stored depth-first, the front child of a node directly follows it
+	// and back is the index of the back child. Only leaves hold objects, the plane
+	// is only valid if the node has children
 	struct Node
 	{
-		Node* left = nullptr;
-		Node* right = nullptr;
-		std::list<Mesh<PosVertex>> objects;
+		Primitives::Plane plane = {};
+		// The root is never a child, so 0 marks a leaf
+		uint32_t back = 0;
+		uint32_t firstObject = 0;
+		uint32_t objectCount = 0;
+
+		bool IsLeaf() const { return back == 0; }
 	};
 
+	// Nodes at the given depth become leaves, 0 only stops at MaxDepth
 	void Create(int depth, Device& owner)
 	{
 		m_owner = &owner;
+		m_stats.ResetBuild();
+		auto start = std::chrono::steady_clock::now();
 		auto view = ECS::Get().view<TransformComponent,
 			DeferredRenderComponent>();
 
-		std::vector<Mesh<PosVertex>::Data> meshData;
-		meshData.resize(view.size_hint());
-
-		int i = 0;
-		view.each([this, depth, &meshData, &i](const entt::entity entity, 
-						 const TransformComponent& transform,
-						 DeferredRenderComponent& render)
+		std::vector<Fragment> meshData;
+		view.each([&meshData](const entt::entity entity,
+							  const TransformComponent& transform,
+							  const DeferredRenderComponent& render)
 		{
-			auto& mesh = render.mesh;
 			const glm::mat4 model = transform.model;
-
-			auto verts = render.mesh.GetVertexBufferDataCopy<glm::vec3>(0);
-			auto indices = render.mesh.GetIndexBufferDataCopy();
+			auto data = render.mesh.GetDataView();
 
 			// Turn into world space
-			for (auto& vertex : verts)
-				vertex = static_cast<glm::vec3>(model * glm::vec4(vertex,1.0f));
-
-			auto vertexCount = verts.size();
-			meshData[i].vertices = std::move(reinterpret_cast<std::vector<PosVertex>&>(verts));
-			meshData[i].indices = std::move(indices);
-			++i;
+			auto& d = meshData.emplace_back();
+			d.entity = entity;
+			d.vertices.resize(data.vertexCount);
+			for (uint32_t i = 0; i < data.vertexCount; ++i)
+				d.vertices[i].pos = static_cast<glm::vec3>(model * glm::vec4(data.vertices[i].pos, 1.0f));
+			d.indices.assign(data.indices, data.indices + data.indexCount);
 		});
+		m_stats.AddPhase("Gather", start);
+		for (const auto& d : meshData)
+			m_stats.sourceTriangles += d.indices.size() / 3;
+		m_budget.Reset(m_stats.sourceTriangles, MaxTriangleGrowth);
 
+		start = std::chrono::steady_clock::now();
 		srand(timer * 10.0f);
-		head = Build(meshData);
+		const uint32_t depthLimit = depth > 0 ? std::min<uint32_t>(depth, MaxDepth - 1) : MaxDepth - 1;
+		Build(std::move(meshData), depthLimit);
+		m_stats.AddPhase("Build", start);
+		GatherStats();
+		m_stats.overBudget = m_budget.IsExceeded();
 	}
 
+#ifndef BK_HEADLESS
 	void RenderObjects(vk::CommandBuffer commandBuffer,
 				vk::PipelineLayout pipelineLayout)
 	{
-		//ASSERT(head != nullptr, "Attempting to render octree without creating it");
-		if (head == nullptr) return;
+		if (m_nodes.empty()) return;
 		srand(1305871305);
 		utils::PushIdentityModel(commandBuffer, pipelineLayout);
-		RenderRecursively(head, commandBuffer, pipelineLayout);
+
+		// Every object is a range of one mesh, only created once objects are drawn
+		if (m_debugMesh.GetVertexCount() == 0)
+		{
+			std::vector<PosVertex> vertices(m_vertices.begin(), m_vertices.end());
+			std::vector<uint32_t> indices(m_indices.begin(), m_indices.end());
+			m_debugMesh = Mesh<PosVertex>(vertices, indices, m_owner);
+		}
+		m_debugMesh.Bind(commandBuffer);
+
+		for (const Object& obj : m_objects)
+		{
+			glm::vec3 color = { utils::Random(), utils::Random(), utils::Random() };
+
+			commandBuffer.pushConstants(
+				pipelineLayout,
+				vk::ShaderStageFlagBits::eFragment,
+				sizeof(glm::mat4), sizeof(utils::UBOColor), &color
+			);
+
+			m_debugMesh.Draw(commandBuffer, obj.indexCount, obj.firstIndex, obj.firstVertex);
+		}
 	}
+#endif
 
 	void Update(float dt)
 	{
 		timer += dt;
 	}
 
+	// Visit every object ordered by distance from the eye, nearest first unless
+	// backToFront is set. At each node the side of the plane holding the eye is
+	// nearer, so no sorting is needed. An object split by a plane is visited once
+	// for each of its pieces
+	template <typename Visitor>
+	void TraverseOrdered(const glm::vec3& eyePosition, Visitor&& visitor, bool backToFront = false) const
+	{
+		if (m_nodes.empty()) return;
+
+		uint32_t stack[MaxDepth];
+		uint32_t top = 0;
+		stack[top++] = 0;
+		while (top != 0)
+		{
+			const uint32_t nodeIndex = stack[--top];
+			const Node& node = m_nodes[nodeIndex];
+			if (node.IsLeaf())
+			{
+				for (uint32_t i = 0; i < node.objectCount; ++i)
+					visitor(m_objects[node.firstObject + i]);
+				continue;
+			}
+
+			// On the plane counts as in front, like coplanar triangles do
+			bool eyeInFront = glm::dot(node.plane.normal, eyePosition) >= node.plane.D;
+			bool frontFirst = eyeInFront != backToFront;
+
+			// The near side is pushed last so that it is visited first
+			stack[top++] = frontFirst ? node.back : nodeIndex + 1;
+			stack[top++] = frontFirst ? nodeIndex + 1 : node.back;
+		}
+	}
+
 	void Destroy()
 	{
-		ASSERT(head != nullptr, "Attempting to destroy BSP tree without creating it");
+		ASSERT(!m_nodes.empty(), "Attempting to destroy BSP tree without creating it");
 		m_owner->waitIdle();
-		DestroyRecursively(head);
-		head = nullptr;
+		// Everything the tree built lives in these pools, release them at once
+		m_nodes = Pool<Node>();
+		m_objects = Pool<Object>();
+		m_vertices = Pool<PosVertex>();
+		m_indices = Pool<uint32_t>();
+		m_debugMesh = Mesh<PosVertex>();
+		m_stats.ResetBuild();
 	}
 
 	bool IsInitialized()
 	{
-		return head != nullptr;
+		return !m_nodes.empty();
 	}
 
+	const Pool<Node>& GetNodes() const { return m_nodes; }
+	const Pool<Object>& GetObjects() const { return m_objects; }
+	const SpatialStats& GetStats() const { return m_stats; }
+
 	inline static uint32_t MinimumTriangles = 500;
+	// Weight of straddling triangles against the front and back imbalance
 	inline static float SplitBlend = 0.8f;
+	// Random triangle-supporting and random two-point planes each, on top of the axis planes
 	inline static uint32_t PlaneSamples = 5;
-	inline static float PlaneAreaTestScale = 5.0f;
+	// Triangles each candidate plane is scored against, bounds the work per node
+	inline static uint32_t ScoreSamples = 4096;
+	// Builds stop splitting once clipping stored this many times the source triangles
+	inline static float MaxTriangleGrowth = FLT_MAX;
 
 private:
-	void RenderRecursively(Node* node,
-								  vk::CommandBuffer commandBuffer,
-								  vk::PipelineLayout layout)
+	// Nodes deeper than this become leaves, so that traversal stacks are fixed size
+	static constexpr uint32_t MaxDepth = 64;
+
+	// Geometry being split through the tree, along with the entity it came from
+	struct Fragment : Mesh<PosVertex>::Data
 	{
-		if (node->left)
-			RenderRecursively(node->left, commandBuffer, layout);
-		if (node->right)
-			RenderRecursively(node->right, commandBuffer, layout);
+		entt::entity entity;
+	};
 
-		for (auto& obj : node->objects)
-		{
-			obj.Bind(commandBuffer);
-			
-			glm::vec3 color = { utils::Random(), utils::Random(), utils::Random() };
+	// Sampled triangles laid out per vertex component, so that a plane
+	// classifies all of them in one pass
+	struct TriangleSet
+	{
+		std::vector<float> x0, y0, z0;
+		std::vector<float> x1, y1, z1;
+		std::vector<float> x2, y2, z2;
+		uint32_t count = 0;
 
-			commandBuffer.pushConstants(
-				layout,
-				vk::ShaderStageFlagBits::eFragment,
-				sizeof(glm::mat4), sizeof(utils::UBOColor), &color
-			);
+		void Push(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+		{
+			x0.push_back(a.x); y0.push_back(a.y); z0.push_back(a.z);
+			x1.push_back(b.x); y1.push_back(b.y); z1.push_back(b.z);
+			x2.push_back(c.x); y2.push_back(c.y); z2.push_back(c.z);
+			++count;
+		}
 
-			obj.Draw(commandBuffer);
+		glm::vec3 Vertex(uint32_t triangle, uint32_t corner) const
+		{
+			switch (corner)
+			{
+			case 0: return { x0[triangle], y0[triangle], z0[triangle] };
+			case 1: return { x1[triangle], y1[triangle], z1[triangle] };
+			default: return { x2[triangle], y2[triangle], z2[triangle] };
+			}
 		}
+	};
 
-	}
+	struct PlaneScore
+	{
+		uint32_t front = 0;
+		uint32_t back = 0;
+		uint32_t straddling = 0;
+		float cost = FLT_MAX;
+	};
 
-	void DestroyRecursively(Node* node)
+	// Count the triangles in front, behind and straddling the plane, with the same
+	// rules as IsStraddlingPlane. Written branch-free so the lanes vectorize
+	static PlaneScore ClassifyTriangles(const TriangleSet& set, const Primitives::Plane& plane)
 	{
-		if (node->left)
-			DestroyRecursively(node->left);
-		if (node->right)
-			DestroyRecursively(node->right);
+		const float nx = plane.normal.x, ny = plane.normal.y, nz = plane.normal.z;
+		const float D = glm::dot(plane.normal, plane.position);
+		const float thickness = Primitives::Plane::thickness;
 
-		for (auto& obj : node->objects)
-			obj.Destroy();
-		delete node;
-	}
+		uint32_t front = 0, back = 0;
+		for (uint32_t i = 0; i < set.count; ++i)
+		{
+			float d0 = nx * set.x0[i] + ny * set.y0[i] + nz * set.z0[i] - D;
+			float d1 = nx * set.x1[i] + ny * set.y1[i] + nz * set.z1[i] - D;
+			float d2 = nx * set.x2[i] + ny * set.y2[i] + nz * set.z2[i] - D;
+			float lo = std::min(d0, std::min(d1, d2));
+			float hi = std::max(d0, std::max(d1, d2));
+
+			// Coplanar triangles go to the front, like they do when clipping
+			front += static_cast<uint32_t>(lo >= -thickness);
+			back += static_cast<uint32_t>((hi <= thickness) & (lo < -thickness));
+		}
 
+		PlaneScore score;
+		score.front = front;
+		score.back = back;
+		score.straddling = set.count - front - back;
+		return score;
+	}
 
-	Primitives::Plane FindSplittingPlane(Mesh<PosVertex>::Data& d)
+	// Pick the plane that best trades straddling triangles, which are clipped into
+	// both sides, against the imbalance between the sides. Candidates are the median
+	// planes of each axis, planes supporting random triangles and planes between
+	// random vertices. Returns false if no candidate separates anything
+	bool FindSplittingPlane(const std::vector<Fragment>& data,
+							uint32_t triangleCount,
+							Primitives::Plane& bestPlane)
 	{
-		Primitives::Plane bestPlane;
-		float bestScore = std::numeric_limits<float>::max();
+		// Evenly spaced triangles, at most ScoreSamples of them
+		const uint64_t sampleCount = std::min(triangleCount, std::max(ScoreSamples, 1u));
+		TriangleSet set;
+		uint64_t triangle = 0;
+		for (const auto& d : data)
+		{
+			for (uint32_t i = 0; i + 2 < d.indices.size(); i += 3, ++triangle)
+			{
+				if (triangle * sampleCount / triangleCount == (triangle + 1) * sampleCount / triangleCount)
+					continue;
+
+				set.Push(d.vertices[d.indices[i + 0]].pos,
+						 d.vertices[d.indices[i + 1]].pos,
+						 d.vertices[d.indices[i + 2]].pos);
+			}
+		}
+		if (set.count == 0) return false;
+
+		std::vector<Primitives::Plane> candidates;
+		auto AddCandidate = [&candidates](const glm::vec3& position, const glm::vec3& normal)
+		{
+			float length = glm::length(normal);
+			if (!(length > FLT_EPSILON)) return;
+
+			Primitives::Plane plane;
+			plane.position = position;
+			plane.normal = normal / length;
+			plane.D = glm::dot(plane.normal, plane.position);
+			candidates.push_back(plane);
+		};
 
-		int numVertices = d.vertices.size();
+		// Split each axis at the median centroid
+		std::vector<float> centroids(set.count);
+		const std::vector<float>* axes[3][3] = {
+			{ &set.x0, &set.x1, &set.x2 },
+			{ &set.y0, &set.y1, &set.y2 },
+			{ &set.z0, &set.z1, &set.z2 }
+		};
+		for (uint32_t axis = 0; axis < 3; ++axis)
+		{
+			for (uint32_t i = 0; i < set.count; ++i)
+				centroids[i] = ((*axes[axis][0])[i] + (*axes[axis][1])[i] + (*axes[axis][2])[i]) / 3.0f;
+			std::nth_element(centroids.begin(), centroids.begin() + set.count / 2, centroids.end());
 
+			glm::vec3 normal(0.0f);
+			normal[axis] = 1.0f;
+			AddCandidate(normal * centroids[set.count / 2], normal);
+		}
 
-		for (int j = 0; j < PlaneSamples; ++j)
+		for (uint32_t i = 0; i < PlaneSamples; ++i)
 		{
-			int numFront = 0, numBack = 0, numStraddling = 0;
-			glm::vec3 randomPoints[2];
-			randomPoints[0] = d.vertices[utils::RandomInt(0, numVertices)].pos;
-			randomPoints[1] = d.vertices[utils::RandomInt(0, numVertices)].pos;
+			uint32_t t = utils::RandomInt(0, set.count);
+			glm::vec3 a = set.Vertex(t, 0);
+			AddCandidate(a, glm::cross(set.Vertex(t, 1) - a, set.Vertex(t, 2) - a));
 
-			Primitives::Plane plane = Primitives::GeneratePlaneBetweenTwoPoints(randomPoints[0], randomPoints[1]);
+			glm::vec3 p0 = set.Vertex(utils::RandomInt(0, set.count), utils::RandomInt(0, 3));
+			glm::vec3 p1 = set.Vertex(utils::RandomInt(0, set.count), utils::RandomInt(0, 3));
+			AddCandidate((p0 + p1) * 0.5f, p1 - p0);
+		}
 
-			int straddling = Mesh<PosVertex>::IsStraddlingPlane(d.vertices.data(), d.vertices.size(), plane);
-			switch (straddling)
+		// Every candidate only reads the set, so they are scored as separate jobs
+		std::vector<PlaneScore> scores(candidates.size());
+		JobSystem::ParallelFor(candidates.size(), 1,
+			[&set, &candidates, &scores](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; ++i)
 			{
-			case -1:
-				++numBack;
-				break;
-			case 0:
-				++numStraddling;
-				break;
-			case 1:
-				++numFront;
-				break;
-			default:
-				ASSERT(false, "Invalid case when splitting BSP by plane");
+				PlaneScore& score = scores[i];
+				score = ClassifyTriangles(set, candidates[i]);
+				if (score.front == set.count || score.back == set.count)
+					continue;
+
+				const float n = static_cast<float>(set.count);
+				const float imbalance = std::abs(static_cast<float>(score.front) - static_cast<float>(score.back));
+				score.cost = SplitBlend * score.straddling / n + (1.0f - SplitBlend) * imbalance / n;
 			}
+		});
 
-			float score = SplitBlend * numStraddling + (1.0f - SplitBlend) * std::abs(numFront - numBack);
-			if (score < bestScore)
+		float bestCost = FLT_MAX;
+		for (uint32_t i = 0; i < candidates.size(); ++i)
+		{
+			if (scores[i].cost < bestCost)
 			{
-				bestPlane = plane;
-				bestScore = score;
+				bestCost = scores[i].cost;
+				bestPlane = candidates[i];
 			}
-
 		}
-
-		return bestPlane;
+		return bestCost != FLT_MAX;
 	}
 
-	Node* Build(std::vector<Mesh<PosVertex>::Data>& data)
+	// Geometry still to be split below a node
+	struct BuildTask
 	{
-		Node* node = new Node();
-		int numMeshes = data.size();
+		std::vector<Fragment> data;
+		// Node whose back child this is, the front child needs no patching
+		uint32_t parent = 0;
+		bool isBack = false;
+		uint32_t depth = 0;
+	};
 
-		
-		std::vector<Mesh<PosVertex>::Data> frontList, backList;
-		auto EmplaceObject =
-			[this, node](Mesh<PosVertex>::Data& d)
-		{
-			node->objects.emplace_back();
-			auto& obj = node->objects.back();
-			obj.CreateStatic(d.vertices, d.indices, *m_owner);
-		};
-		
-		for (int i = 0; i < numMeshes; ++i)
+	// Split depth-first with an explicit stack, nodes are appended to the pool as they
+	// are popped. The front task is pushed last, so a front child always directly
+	// follows its parent. Fragments are moved down the tree and only clipping copies
+	void Build(std::vector<Fragment>&& meshData, uint32_t depthLimit)
+	{
+		std::vector<BuildTask> stack;
+		stack.push_back({ std::move(meshData), 0, false, 0 });
+
+		while (!stack.empty())
 		{
-			auto& d = data[i];
-			uint32_t triangleCount = d.indices.size() / 3;
-			if (triangleCount < MinimumTriangles)
+			BuildTask task = std::move(stack.back());
+			stack.pop_back();
+
+			const uint32_t nodeIndex = m_nodes.size();
+			m_nodes.emplace_back();
+			if (task.isBack)
+				m_nodes[task.parent].back = nodeIndex;
+
+			uint32_t triangleCount = 0;
+			for (const auto& d : task.data)
+				triangleCount += d.indices.size() / 3;
+
+			Primitives::Plane splitPlane;
+			if (triangleCount < MinimumTriangles || task.depth >= depthLimit ||
+				!FindSplittingPlane(task.data, triangleCount, splitPlane))
 			{
-				EmplaceObject(d);
+				EmplaceObjects(nodeIndex, task.data);
 				continue;
 			}
 
-			Primitives::Plane splitPlane = FindSplittingPlane(d);
-			int straddle = Mesh<PosVertex>::IsStraddlingPlane(d.vertices.data(), d.vertices.size(), splitPlane);
-			if (straddle != 0)
-			{
-				frontList.emplace_back(d);
-			}
-			else
+			std::vector<Fragment> frontList, backList;
+			for (auto& d : task.data)
 			{
-				Mesh<PosVertex>::Data front, back;
-				Mesh<PosVertex>::Clip(d, splitPlane, front, back);
-
-				int frontTriangleCount = front.indices.size() / 3;
-				int backTriangleCount = back.indices.size() / 3;
-				// BAIL if we're at the point where splitting increases
-				// our triangle count
-				if (frontTriangleCount >= triangleCount ||
-					backTriangleCount >= triangleCount)
+				int straddle = Mesh<PosVertex>::IsStraddlingPlane(d.vertices.data(), d.vertices.size(), splitPlane);
+				if (straddle == 1)
 				{
-					EmplaceObject(d);
-					continue;
+					frontList.emplace_back(std::move(d));
+				}
+				else if (straddle == -1)
+				{
+					backList.emplace_back(std::move(d));
 				}
+				else
+				{
+					Fragment front, back;
+					front.entity = back.entity = d.entity;
+					Mesh<PosVertex>::Clip(d, splitPlane, front, back);
+					// Release the source before its pieces go further down
+					d = Fragment();
+					if (!front.indices.empty())
+						frontList.emplace_back(std::move(front));
+					if (!back.indices.empty())
+						backList.emplace_back(std::move(back));
+				}
+			}
+
+			// The plane was scored on a sample, stop if it separated nothing after all
+			if (frontList.empty() || backList.empty())
+			{
+				EmplaceObjects(nodeIndex, frontList.empty() ? backList : frontList);
+				continue;
+			}
+
+			// Splitting slivers can leave a side with more triangles than the node had.
+			// Like the octree, stop there, as further splits would only multiply them.
+			// The same goes for every split once the build is over its budget
+			uint32_t frontTriangles = 0, backTriangles = 0;
+			for (const auto& d : frontList)
+				frontTriangles += d.indices.size() / 3;
+			for (const auto& d : backList)
+				backTriangles += d.indices.size() / 3;
+			if (frontTriangles > triangleCount || backTriangles > triangleCount ||
+				!m_budget.Take(static_cast<int64_t>(frontTriangles) + backTriangles - triangleCount))
+			{
+				for (auto& d : backList)
+					frontList.emplace_back(std::move(d));
+				EmplaceObjects(nodeIndex, frontList);
+				continue;
+			}
 
+			m_nodes[nodeIndex].plane = splitPlane;
+			stack.push_back({ std::move(backList), nodeIndex, true, task.depth + 1 });
+			stack.push_back({ std::move(frontList), nodeIndex, false, task.depth + 1 });
+		}
+	}
+
+	// Append a leaf's fragments to the pools, leaves are created in order so
+	// their objects end up contiguous
+	void EmplaceObjects(uint32_t nodeIndex, std::vector<Fragment>& data)
+	{
+		Node& node = m_nodes[nodeIndex];
+		node.firstObject = m_objects.size();
+		node.objectCount = data.size();
+		for (auto& d : data)
+		{
+			Object& obj = m_objects.emplace_back();
+			obj.entity = d.entity;
+			obj.firstVertex = m_vertices.size();
+			obj.vertexCount = d.vertices.size();
+			m_vertices.append(d.vertices.begin(), d.vertices.end());
+			obj.firstIndex = m_indices.size();
+			obj.indexCount = d.indices.size();
+			m_indices.append(d.indices.begin(), d.indices.end());
+			d = Fragment();
+		}
+	}
 
-				frontList.emplace_back(front);
-				backList.emplace_back(back);
+	void GatherStats()
+	{
+		m_stats.nodeCount = m_nodes.size();
+		m_stats.objectCount = m_objects.size();
+		m_stats.storedTriangles = m_indices.size() / 3;
+
+		// Depth-first with the front child next, so depths follow from the back links
+		std::vector<uint32_t> depths(m_nodes.size(), 0);
+		for (uint32_t i = 0; i < m_nodes.size(); ++i)
+		{
+			const Node& node = m_nodes[i];
+			if (m_stats.nodesPerDepth.size() <= depths[i])
+				m_stats.nodesPerDepth.resize(depths[i] + 1, 0);
+			++m_stats.nodesPerDepth[depths[i]];
+
+			if (!node.IsLeaf())
+			{
+				depths[i + 1] = depths[node.back] = depths[i] + 1;
+				continue;
 			}
+
+			uint64_t triangles = 0;
+			for (uint32_t j = 0; j < node.objectCount; ++j)
+				triangles += m_objects[node.firstObject + j].indexCount / 3;
+			m_stats.AddLeaf(triangles);
 		}
 
-		if (frontList.size() > 0)
-			node->left = Build(frontList);
-		if (backList.size() > 0)
-			node->right = Build(backList);
-		return node;
+		m_stats.memoryBytes = m_nodes.size() * sizeof(Node) +
+			m_objects.size() * sizeof(Object) +
+			m_vertices.size() * sizeof(PosVertex) +
+			m_indices.size() * sizeof(uint32_t);
 	}
 
-	Node* head;
-	Device* m_owner;
+	Pool<Node> m_nodes;
+	Pool<Object> m_objects;
+	// Geometry of every object
+	Pool<PosVertex> m_vertices;
+	Pool<uint32_t> m_indices;
+	// Every object's geometry in one buffer, only created when objects are drawn
+	Mesh<PosVertex> m_debugMesh;
+	SpatialStats m_stats;
+	TriangleBudget m_budget;
+	Device* m_owner = nullptr;
 	float timer = 0.0f;
 };
 
@@ -0,0 +1,1212 @@
+#pragma once
+
+// Bounding volume hierarchy over the triangles of every rendered entity. Nodes are
+// split where the surface area heuristic, evaluated over a fixed number of bins,
+// is lowest. Triangles are never clipped, so each is stored exactly once
+class BVH
+{
+public:
+	// Two nodes to a cache line. Interior nodes have a count of 0 and their children
+	// at leftFirst and leftFirst + 1, leaves hold the triangles [leftFirst, leftFirst + count)
+	struct Node
+	{
+		glm::vec3 min = glm::vec3(FLT_MAX);
+		uint32_t leftFirst = 0;
+		glm::vec3 max = glm::vec3(-FLT_MAX);
+		uint32_t count = 0;
+
+		bool IsLeaf() const { return count != 0; }
+	};
+	static_assert(sizeof(Node) == 32, "BVH nodes are expected to be 32 bytes");
+
+	struct Triangle
+	{
+		Primitives::Triangle triangle;
+		entt::entity entity;
+		// Triangle index in the entity's mesh
+		uint32_t index;
+		// Entities are numbered from 0 when the tree is created, to flag them in queries
+		uint32_t entityIndex;
+	};
+
+	struct CollisionPair
+	{
+		// Index into the queried colliders
+		uint32_t collider;
+		// Index into GetTriangles()
+		uint32_t triangle;
+		entt::entity entity;
+	};
+
+	struct RayHit
+	{
+		entt::entity entity;
+		// Triangle index in the entity's mesh
+		uint32_t triangle;
+		float t;
+		glm::vec3 normal;
+	};
+
+	void Create(Device& owner)
+	{
+		m_owner = &owner;
+		m_stats.ResetBuild();
+		auto start = std::chrono::steady_clock::now();
+		auto view = ECS::Get().view<TransformComponent,
+			DeferredRenderComponent>();
+
+		// Gather the meshes here, the jobs below only read from them
+		std::vector<Source> sources;
+		std::vector<entt::entity> entities;
+		uint32_t triangleCount = 0;
+		view.each([this, &sources, &entities, &triangleCount](const entt::entity entity,
+															  const TransformComponent& transform,
+															  const DeferredRenderComponent& render)
+		{
+			const uint32_t count = render.mesh.GetIndexCount() / 3;
+			sources.push_back({ &render.mesh, transform.model, triangleCount });
+			entities.push_back(entity);
+			m_entityTriangles[entity] = { triangleCount, count };
+			triangleCount += count;
+		});
+
+		// Until the tree is built each triangle is in its source slot
+		m_triangles.resize(triangleCount);
+		m_slots.resize(triangleCount);
+		for (uint32_t e = 0; e < entities.size(); ++e)
+		{
+			const auto& range = m_entityTriangles[entities[e]];
+			for (uint32_t t = 0; t < range.second; ++t)
+			{
+				m_slots[range.first + t] = range.first + t;
+				m_triangles[range.first + t].entity = entities[e];
+				m_triangles[range.first + t].index = t;
+				m_triangles[range.first + t].entityIndex = e;
+			}
+		}
+		m_entities = std::move(entities);
+		m_visibleQueries.assign(m_entities.size(), 0);
+		m_visibleQuery = 0;
+		Bake(sources);
+		m_stats.AddPhase("Bake", start);
+		m_stats.sourceTriangles = triangleCount;
+
+		Build();
+		GatherStats();
+	}
+
+	// Move the triangles of entities whose model changed and refit the bounds.
+	// Once refitting has worn the tree down past RebuildThreshold a new one is
+	// built in the background and swapped in by a later update
+	void Update(const std::vector<entt::entity>& moved)
+	{
+		if (m_nodes.empty()) return;
+		FinishRebuild(false);
+
+		auto& registry = ECS::Get();
+		std::vector<Source> sources;
+		for (entt::entity entity : moved)
+		{
+			auto it = m_entityTriangles.find(entity);
+			if (it == m_entityTriangles.end() || !registry.valid(entity)) continue;
+			const auto* transform = registry.try_get<TransformComponent>(entity);
+			const auto* render = registry.try_get<DeferredRenderComponent>(entity);
+			// Meshes that changed their triangle count need a new tree
+			if (transform == nullptr || render == nullptr ||
+				render->mesh.GetIndexCount() / 3 != it->second.second) continue;
+
+			sources.push_back({ &render->mesh, transform->model, it->second.first });
+		}
+		if (sources.empty()) return;
+
+		Bake(sources);
+		Refit();
+		m_debugDirty = true;
+
+		if (m_rebuild == nullptr && m_stats.cost > RebuildThreshold * m_stats.buildCost)
+			StartRebuild();
+	}
+
+#ifndef BK_HEADLESS
+	void RenderCells(vk::CommandBuffer commandBuffer,
+				vk::PipelineLayout pipelineLayout)
+	{
+		if (m_nodes.empty()) return;
+		SimpleMesh<PosVertex>::CubeList->Bind(commandBuffer);
+
+		// Every node down to DisplayDepth
+		std::vector<std::pair<uint32_t, uint32_t>> stack = { { 0, 0 } };
+		while (!stack.empty())
+		{
+			auto [nodeIndex, depth] = stack.back();
+			stack.pop_back();
+			const Node& node = m_nodes[nodeIndex];
+
+			glm::mat4 model = glm::translate(utils::identity, (node.min + node.max) * 0.5f);
+			model = glm::scale(model, node.max - node.min);
+			commandBuffer.pushConstants(
+				pipelineLayout,
+				vk::ShaderStageFlagBits::eVertex,
+				0, sizeof(glm::mat4), &model
+			);
+			SimpleMesh<PosVertex>::CubeList->Draw(commandBuffer);
+
+			if (node.IsLeaf() || depth >= static_cast<uint32_t>(DisplayDepth)) continue;
+			stack.push_back({ node.leftFirst, depth + 1 });
+			stack.push_back({ node.leftFirst + 1, depth + 1 });
+		}
+	}
+
+	void RenderObjects(vk::CommandBuffer commandBuffer,
+				vk::PipelineLayout pipelineLayout)
+	{
+		if (m_nodes.empty()) return;
+		srand(1305871305);
+		utils::PushIdentityModel(commandBuffer, pipelineLayout);
+
+		UpdateDebugMesh();
+		m_debugMesh.Bind(commandBuffer);
+
+		// The triangles below a node are contiguous, so each subtree at DisplayDepth
+		// is drawn as one range in its own color
+		std::vector<std::pair<uint32_t, uint32_t>> stack = { { 0, 0 } };
+		while (!stack.empty())
+		{
+			auto [nodeIndex, depth] = stack.back();
+			stack.pop_back();
+			const Node& node = m_nodes[nodeIndex];
+			if (!node.IsLeaf() && depth < static_cast<uint32_t>(DisplayDepth))
+			{
+				stack.push_back({ node.leftFirst, depth + 1 });
+				stack.push_back({ node.leftFirst + 1, depth + 1 });
+				continue;
+			}
+
+			uint32_t first, count;
+			TriangleRange(nodeIndex, first, count);
+			glm::vec3 color = { utils::Random(), utils::Random(), utils::Random() };
+			commandBuffer.pushConstants(
+				pipelineLayout,
+				vk::ShaderStageFlagBits::eFragment,
+				sizeof(glm::mat4), sizeof(utils::UBOColor), &color
+			);
+			m_debugMesh.Draw(commandBuffer, count * 3, first * 3, 0);
+		}
+	}
+#endif
+
+	void Destroy()
+	{
+		if (m_rebuild != nullptr)
+		{
+			JobSystem::Wait(m_rebuild->job);
+			m_rebuild.reset();
+		}
+
+		m_owner->waitIdle();
+		m_nodes.clear();
+		m_triangles.clear();
+		m_slots.clear();
+		m_entityTriangles.clear();
+		m_entities.clear();
+		m_visibleQueries.clear();
+		m_nodeEntities.clear();
+		m_nodeEntityIndices.clear();
+		m_levels = Levels();
+		m_debugMesh = Mesh<PosVertex>();
+		m_retired.clear();
+		m_debugDirty = true;
+		m_stats.ResetBuild();
+	}
+
+	bool IsInitialized()
+	{
+		return !m_nodes.empty();
+	}
+
+	// Ranges with this many triangles or fewer always become leaves
+	inline static uint32_t MinimumTriangles = 2;
+	// Ranges with more triangles are split even if the heuristic prefers a leaf
+	inline static uint32_t MaximumTriangles = 16;
+	inline static uint32_t BinCount = 16;
+	// Cost of visiting a node relative to intersecting a triangle
+	inline static float TraversalCost = 1.0f;
+	// Levels split up front before the remaining subtrees are built as jobs
+	inline static uint32_t ParallelDepth = 4;
+	inline static int DisplayDepth = 4;
+	// Rebuild once refitting has raised the SAH cost this many times over the built tree's
+	inline static float RebuildThreshold = 1.5f;
+	// Nodes with at most this many entities list them, so frustum queries can settle
+	// the whole subtree at once
+	inline static uint32_t MaxNodeEntities = 8;
+
+	// Every (collider, triangle) pair whose boxes overlap. Only reads the tree,
+	// so queries can run from several threads at once
+	void CollisionQuery(const std::vector<Primitives::Box>& colliders,
+						std::vector<CollisionPair>& pairs) const
+	{
+		pairs.clear();
+		if (m_nodes.empty()) return;
+
+		SpatialStats::Counters counters;
+		for (uint32_t c = 0; c < colliders.size(); ++c)
+		{
+			OverlapTriangles(m_nodes.data(), m_triangles.data(),
+							 colliders[c].position - colliders[c].halfExtent,
+							 colliders[c].position + colliders[c].halfExtent,
+							 counters, [this, &pairs, c](uint32_t i)
+			{
+				pairs.push_back({ c, i, m_triangles[i].entity });
+			});
+		}
+		m_stats.collision.Add(counters);
+	}
+
+	// Gather the entities with geometry inside the frustum of a perspective
+	// view-projection, nearer subtrees first and each entity once
+	void FrustumQuery(const glm::mat4& viewProjection, std::vector<entt::entity>& visible)
+	{
+		visible.clear();
+		if (m_nodes.empty()) return;
+
+		// An entity is visible once its stamp is this query's
+		if (++m_visibleQuery == 0)
+		{
+			std::fill(m_visibleQueries.begin(), m_visibleQueries.end(), 0);
+			m_visibleQuery = 1;
+		}
+
+		const Primitives::Frustum frustum = Primitives::GenerateFrustum(viewProjection);
+		// The eye is the only point projected to x = y = w = 0
+		const glm::vec4 eyeW = glm::inverse(viewProjection) * glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+		const glm::vec3 eye = glm::vec3(eyeW) / eyeW.w;
+
+		SpatialStats::Counters counters;
+		// Each entry carries the planes its parent still straddled
+		std::pair<uint32_t, uint32_t> stack[MaxDepth];
+		uint32_t top = 0;
+		stack[top++] = { 0, 0x3Fu };
+		while (top != 0)
+		{
+			auto [nodeIndex, planeMask] = stack[--top];
+			const Node& node = m_nodes[nodeIndex];
+			// A subtree whose entities are all visible already has nothing left to find
+			const EntityList list = m_nodeEntities[nodeIndex];
+			if (list.count != 0 && AllVisible(list)) continue;
+			++counters.visitedNodes;
+
+			bool outside = false;
+			if (planeMask != 0)
+				planeMask = Primitives::FrustumBox(frustum, planeMask, node.min, node.max, outside);
+			if (outside) continue;
+
+			// Fully inside, so are its entities
+			if (planeMask == 0 && list.count != 0)
+			{
+				for (uint32_t i = list.first; i < list.first + list.count; ++i)
+				{
+					uint32_t& stamp = m_visibleQueries[m_nodeEntityIndices[i]];
+					if (stamp == m_visibleQuery) continue;
+					stamp = m_visibleQuery;
+					visible.push_back(m_entities[m_nodeEntityIndices[i]]);
+				}
+				continue;
+			}
+
+			if (node.IsLeaf())
+			{
+				// With no planes left the leaf is fully inside and nothing is tested.
+				// Triangles of entities that are already visible are skipped
+				for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+				{
+					uint32_t& stamp = m_visibleQueries[m_triangles[i].entityIndex];
+					if (stamp == m_visibleQuery) continue;
+					if (planeMask != 0)
+					{
+						++counters.narrowPhaseTests;
+						const Primitives::Triangle& triangle = m_triangles[i].triangle;
+						Primitives::FrustumBox(frustum, planeMask,
+											   glm::min(triangle.positions[0], glm::min(triangle.positions[1], triangle.positions[2])),
+											   glm::max(triangle.positions[0], glm::max(triangle.positions[1], triangle.positions[2])),
+											   outside);
+						if (outside) continue;
+					}
+					stamp = m_visibleQuery;
+					visible.push_back(m_triangles[i].entity);
+				}
+				continue;
+			}
+
+			// The nearer child is pushed last so that it is visited first
+			const Node& left = m_nodes[node.leftFirst];
+			const Node& right = m_nodes[node.leftFirst + 1];
+			const glm::vec3 toLeft = (left.min + left.max) * 0.5f - eye;
+			const glm::vec3 toRight = (right.min + right.max) * 0.5f - eye;
+			bool leftNearer = glm::dot(toLeft, toLeft) <= glm::dot(toRight, toRight);
+			stack[top++] = { leftNearer ? node.leftFirst + 1 : node.leftFirst, planeMask };
+			stack[top++] = { leftNearer ? node.leftFirst : node.leftFirst + 1, planeMask };
+		}
+		m_stats.frustum.Add(counters);
+	}
+
+	// Nearest triangle hit within maxT, t is in units of the ray direction.
+	// Only reads the tree, so rays can be cast from several threads at once
+	std::optional<RayHit> RayCast(const Primitives::Ray& ray, float maxT) const
+	{
+		if (m_nodes.empty()) return std::nullopt;
+
+		float t = maxT;
+		uint32_t hit = UINT32_MAX;
+		SpatialStats::Counters counters;
+		IntersectTriangles(m_nodes.data(), m_triangles.data(), ray, t, hit, counters);
+
+		m_stats.ray.Add(counters);
+		if (hit == UINT32_MAX) return std::nullopt;
+
+		const Primitives::Triangle& triangle = m_triangles[hit].triangle;
+		RayHit result;
+		result.entity = m_triangles[hit].entity;
+		result.triangle = m_triangles[hit].index;
+		result.t = t;
+		result.normal = glm::normalize(glm::cross(triangle.positions[1] - triangle.positions[0],
+												  triangle.positions[2] - triangle.positions[0]));
+		return result;
+	}
+
+	// Cast a batch of rays across the job system, must be called from the main thread
+	void RayCast(const std::vector<Primitives::Ray>& rays,
+				 float maxT,
+				 std::vector<std::optional<RayHit>>& hits) const
+	{
+		hits.resize(rays.size());
+		JobSystem::ParallelFor(rays.size(), 64,
+			[this, &rays, &hits, maxT](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; ++i)
+				hits[i] = RayCast(rays[i], maxT);
+		});
+	}
+
+	// Nearest triangle hit by the ray before t, the traversal shared by every
+	// hierarchy of nodes over triangles. Returns false and leaves t and hit as
+	// they were if nothing closer is hit
+	static bool IntersectTriangles(const Node* nodes,
+								   const Triangle* triangles,
+								   const Primitives::Ray& ray,
+								   float& t,
+								   uint32_t& hit,
+								   SpatialStats::Counters& counters)
+	{
+		const glm::vec3 invDirection = 1.0f / ray.direction;
+		bool found = false;
+
+		// Entries are skipped if a closer hit was found since they were pushed
+		std::pair<uint32_t, float> stack[MaxDepth];
+		uint32_t top = 0;
+		float entry;
+		if (RaySlab(ray.position, invDirection, nodes[0], t, entry))
+			stack[top++] = { 0, entry };
+
+		while (top != 0)
+		{
+			auto [nodeIndex, nodeEntry] = stack[--top];
+			if (nodeEntry > t) continue;
+			const Node& node = nodes[nodeIndex];
+			++counters.visitedNodes;
+
+			if (node.IsLeaf())
+			{
+				counters.narrowPhaseTests += node.count;
+				for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+				{
+					float triangleT;
+					if (Primitives::RayTriangle(ray, triangles[i].triangle, triangleT) && triangleT < t)
+					{
+						t = triangleT;
+						hit = i;
+						found = true;
+					}
+				}
+				continue;
+			}
+
+			// Nearest child first
+			float leftEntry, rightEntry;
+			bool hitLeft = RaySlab(ray.position, invDirection, nodes[node.leftFirst], t, leftEntry);
+			bool hitRight = RaySlab(ray.position, invDirection, nodes[node.leftFirst + 1], t, rightEntry);
+			if (hitLeft && hitRight)
+			{
+				bool leftFirst = leftEntry <= rightEntry;
+				stack[top++] = leftFirst ? std::make_pair(node.leftFirst + 1, rightEntry) : std::make_pair(node.leftFirst, leftEntry);
+				stack[top++] = leftFirst ? std::make_pair(node.leftFirst, leftEntry) : std::make_pair(node.leftFirst + 1, rightEntry);
+			}
+			else if (hitLeft)
+			{
+				stack[top++] = { node.leftFirst, leftEntry };
+			}
+			else if (hitRight)
+			{
+				stack[top++] = { node.leftFirst + 1, rightEntry };
+			}
+		}
+		return found;
+	}
+
+	// Call onTriangle with the index of every triangle whose bounds overlap the box
+	template <typename Func>
+	static void OverlapTriangles(const Node* nodes,
+								 const Triangle* triangles,
+								 const glm::vec3& min,
+								 const glm::vec3& max,
+								 SpatialStats::Counters& counters,
+								 Func&& onTriangle)
+	{
+		uint32_t stack[MaxDepth];
+		uint32_t top = 0;
+		stack[top++] = 0;
+		while (top != 0)
+		{
+			const Node& node = nodes[stack[--top]];
+			++counters.visitedNodes;
+			if (!Overlap(node.min, node.max, min, max)) continue;
+
+			if (!node.IsLeaf())
+			{
+				stack[top++] = node.leftFirst;
+				stack[top++] = node.leftFirst + 1;
+				continue;
+			}
+
+			counters.narrowPhaseTests += node.count;
+			for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+			{
+				const Primitives::Triangle& triangle = triangles[i].triangle;
+				glm::vec3 triangleMin = glm::min(triangle.positions[0], glm::min(triangle.positions[1], triangle.positions[2]));
+				glm::vec3 triangleMax = glm::max(triangle.positions[0], glm::max(triangle.positions[1], triangle.positions[2]));
+				if (Overlap(triangleMin, triangleMax, min, max))
+					onTriangle(i);
+			}
+		}
+	}
+
+	// Bounds of the primitives a hierarchy is built over, triangles or whole instances
+	struct BuildData
+	{
+		std::vector<glm::vec3> min;
+		std::vector<glm::vec3> max;
+		std::vector<glm::vec3> centroid;
+		// Primitive order, every node's primitives are a contiguous range of it
+		std::vector<uint32_t> order;
+
+		void Resize(uint32_t count)
+		{
+			min.resize(count);
+			max.resize(count);
+			centroid.resize(count);
+			order.resize(count);
+		}
+	};
+
+	// Build the nodes over the primitives in data, leaves index into data.order.
+	// The top levels are split here, the remaining subtrees as jobs. Called from
+	// a job the whole build runs inline on that job's thread
+	static std::vector<Node> BuildNodes(BuildData& data, SpatialStats* stats)
+	{
+		auto start = std::chrono::steady_clock::now();
+		const uint32_t count = data.order.size();
+		if (count == 0) return {};
+
+		// Split the top levels here, their ranges are binned across the job system
+		std::vector<Node> nodes(1);
+		std::vector<BuildRange> stack = { { 0, 0, count, 0 } };
+		std::vector<BuildRange> deferred;
+		BuildRanges(data, nodes, stack, ParallelDepth, &deferred);
+		if (stats)
+			stats->AddPhase("Build Top Levels", start);
+
+		// Build the remaining subtrees as separate jobs, their ranges don't overlap
+		start = std::chrono::steady_clock::now();
+		std::vector<std::vector<Node>> subtrees(deferred.size());
+		JobSystem::ParallelFor(deferred.size(), 1,
+			[&data, &deferred, &subtrees](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; ++i)
+			{
+				std::vector<BuildRange> subtreeStack = { deferred[i] };
+				subtreeStack[0].node = 0;
+				subtrees[i].resize(1);
+				BuildRanges(data, subtrees[i], subtreeStack, 0, nullptr);
+			}
+		});
+
+		// Graft each subtree in place of its root, children stay pairwise adjacent
+		for (uint32_t i = 0; i < deferred.size(); ++i)
+		{
+			const std::vector<Node>& subtree = subtrees[i];
+			const uint32_t offset = nodes.size() - 1;
+			for (uint32_t j = 0; j < subtree.size(); ++j)
+			{
+				Node node = subtree[j];
+				if (!node.IsLeaf())
+					node.leftFirst += offset;
+				if (j == 0)
+					nodes[deferred[i].node] = node;
+				else
+					nodes.push_back(node);
+			}
+		}
+		if (stats)
+			stats->AddPhase("Build Subtrees", start);
+		return nodes;
+	}
+
+	// Node indices by depth, deepest level first, so that refitting a level
+	// only reads levels refit before it
+	struct Levels
+	{
+		std::vector<uint32_t> nodes;
+		// Start of each level in nodes, followed by the end of the last one
+		std::vector<uint32_t> offsets;
+	};
+
+	// Distinct entities of a node's triangles, in m_nodeEntityIndices. A count of
+	// 0 means there are more than MaxNodeEntities of them
+	struct EntityList
+	{
+		uint32_t first;
+		uint32_t count;
+	};
+
+	// Entities of every node's triangles, bottom-up so children are done before their parent
+	void GatherNodeEntities()
+	{
+		m_nodeEntities.assign(m_nodes.size(), { 0, 0 });
+		m_nodeEntityIndices.clear();
+		std::vector<uint32_t> merged;
+		// Levels are grouped deepest first
+		for (uint32_t level = 0; level + 1 < m_levels.offsets.size(); ++level)
+		{
+			for (uint32_t i = m_levels.offsets[level]; i < m_levels.offsets[level + 1]; ++i)
+			{
+				const uint32_t nodeIndex = m_levels.nodes[i];
+				const Node& node = m_nodes[nodeIndex];
+				merged.clear();
+				if (node.IsLeaf())
+				{
+					for (uint32_t t = node.leftFirst; t < node.leftFirst + node.count; ++t)
+						merged.push_back(m_triangles[t].entityIndex);
+					std::sort(merged.begin(), merged.end());
+					merged.erase(std::unique(merged.begin(), merged.end()), merged.end());
+				}
+				else
+				{
+					const EntityList left = m_nodeEntities[node.leftFirst];
+					const EntityList right = m_nodeEntities[node.leftFirst + 1];
+					if (left.count == 0 || right.count == 0) continue;
+					const auto indices = m_nodeEntityIndices.begin();
+					merged.resize(left.count + right.count);
+					merged.erase(std::set_union(indices + left.first, indices + left.first + left.count,
+												indices + right.first, indices + right.first + right.count,
+												merged.begin()), merged.end());
+					// Nothing new on one side, so the other side's list is this node's too
+					if (merged.size() == left.count) { m_nodeEntities[nodeIndex] = left; continue; }
+					if (merged.size() == right.count) { m_nodeEntities[nodeIndex] = right; continue; }
+				}
+				if (merged.size() > MaxNodeEntities) continue;
+
+				m_nodeEntities[nodeIndex] = { static_cast<uint32_t>(m_nodeEntityIndices.size()),
+											  static_cast<uint32_t>(merged.size()) };
+				m_nodeEntityIndices.insert(m_nodeEntityIndices.end(), merged.begin(), merged.end());
+			}
+		}
+	}
+
+	bool AllVisible(const EntityList& list) const
+	{
+		for (uint32_t i = list.first; i < list.first + list.count; ++i)
+		{
+			if (m_visibleQueries[m_nodeEntityIndices[i]] != m_visibleQuery)
+				return false;
+		}
+		return true;
+	}
+
+	static Levels GroupLevels(const Pool<Node>& nodes)
+	{
+		Levels levels;
+		if (nodes.empty()) return levels;
+
+		std::vector<std::vector<uint32_t>> depths;
+		std::vector<std::pair<uint32_t, uint32_t>> stack = { { 0, 0 } };
+		while (!stack.empty())
+		{
+			auto [nodeIndex, depth] = stack.back();
+			stack.pop_back();
+			if (depths.size() <= depth)
+				depths.resize(depth + 1);
+			depths[depth].push_back(nodeIndex);
+
+			const Node& node = nodes[nodeIndex];
+			if (node.IsLeaf()) continue;
+			stack.push_back({ node.leftFirst, depth + 1 });
+			stack.push_back({ node.leftFirst + 1, depth + 1 });
+		}
+
+		for (auto it = depths.rbegin(); it != depths.rend(); ++it)
+		{
+			levels.offsets.push_back(levels.nodes.size());
+			levels.nodes.insert(levels.nodes.end(), it->begin(), it->end());
+		}
+		levels.offsets.push_back(levels.nodes.size());
+		return levels;
+	}
+
+	// Surface area heuristic cost of a node relative to the root's area
+	static float NodeCost(const Node& node)
+	{
+		const float area = SurfaceArea(node.min, node.max);
+		return node.IsLeaf() ? node.count * area : TraversalCost * area;
+	}
+
+	static float Cost(const Pool<Node>& nodes)
+	{
+		if (nodes.empty()) return 0.0f;
+		double cost = 0.0;
+		for (const Node& node : nodes)
+			cost += NodeCost(node);
+		return static_cast<float>(cost / std::max(SurfaceArea(nodes[0].min, nodes[0].max), FLT_MIN));
+	}
+
+	// Recompute every node's bounds bottom-up, one level at a time across the job
+	// system. leafBounds(leaf, min, max) bounds a leaf's primitives. Returns the
+	// tree's new cost
+	template <typename LeafBounds>
+	static float RefitNodes(Pool<Node>& nodes, const Levels& levels, const LeafBounds& leafBounds)
+	{
+		constexpr uint32_t batchSize = 1024;
+		double cost = 0.0;
+		for (uint32_t level = 0; level + 1 < levels.offsets.size(); ++level)
+		{
+			const uint32_t first = levels.offsets[level];
+			const uint32_t count = levels.offsets[level + 1] - first;
+			std::vector<double> batchCosts((count + batchSize - 1) / batchSize, 0.0);
+			JobSystem::ParallelFor(count, batchSize,
+				[&nodes, &levels, &leafBounds, &batchCosts, first](uint32_t begin, uint32_t end)
+			{
+				double batchCost = 0.0;
+				for (uint32_t i = begin; i < end; ++i)
+				{
+					Node& node = nodes[levels.nodes[first + i]];
+					node.min = glm::vec3(FLT_MAX);
+					node.max = glm::vec3(-FLT_MAX);
+					if (node.IsLeaf())
+					{
+						leafBounds(node, node.min, node.max);
+					}
+					else
+					{
+						const Node& left = nodes[node.leftFirst];
+						const Node& right = nodes[node.leftFirst + 1];
+						node.min = glm::min(left.min, right.min);
+						node.max = glm::max(left.max, right.max);
+					}
+					batchCost += NodeCost(node);
+				}
+				batchCosts[begin / batchSize] += batchCost;
+			});
+
+			for (double batchCost : batchCosts)
+				cost += batchCost;
+		}
+
+		if (nodes.empty()) return 0.0f;
+		return static_cast<float>(cost / std::max(SurfaceArea(nodes[0].min, nodes[0].max), FLT_MIN));
+	}
+
+	const Pool<Node>& GetNodes() const { return m_nodes; }
+	const Pool<Triangle>& GetTriangles() const { return m_triangles; }
+	const SpatialStats& GetStats() const { return m_stats; }
+
+private:
+	// Deeper ranges become leaves, so that traversal stacks are fixed size
+	static constexpr uint32_t MaxDepth = 64;
+	static constexpr uint32_t MaxBins = 64;
+	// Ranges with at least this many triangles are binned across the job system
+	static constexpr uint32_t ParallelBinning = 1u << 16;
+
+	static bool Overlap(const glm::vec3& aMin, const glm::vec3& aMax,
+						const glm::vec3& bMin, const glm::vec3& bMax)
+	{
+		return (aMin.x <= bMax.x) & (aMax.x >= bMin.x) &
+			(aMin.y <= bMax.y) & (aMax.y >= bMin.y) &
+			(aMin.z <= bMax.z) & (aMax.z >= bMin.z);
+	}
+
+	// Slab test against a node's bounds, entry is where the ray enters them
+	static bool RaySlab(const glm::vec3& origin,
+						const glm::vec3& invDirection,
+						const Node& node,
+						float t,
+						float& entry)
+	{
+		const glm::vec3 t0 = (node.min - origin) * invDirection;
+		const glm::vec3 t1 = (node.max - origin) * invDirection;
+		const glm::vec3 near = glm::min(t0, t1);
+		const glm::vec3 far = glm::max(t0, t1);
+		entry = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+		float exit = std::min(std::min(far.x, far.y), far.z);
+		return entry <= exit && entry <= t;
+	}
+
+	static float SurfaceArea(const glm::vec3& min, const glm::vec3& max)
+	{
+		const glm::vec3 d = glm::max(max - min, glm::vec3(0.0f));
+		return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+	}
+
+	// Range of the triangle order still to be turned into a node
+	struct BuildRange
+	{
+		uint32_t node;
+		uint32_t first;
+		uint32_t count;
+		uint32_t depth;
+	};
+
+	struct Bin
+	{
+		glm::vec3 min = glm::vec3(FLT_MAX);
+		glm::vec3 max = glm::vec3(-FLT_MAX);
+		uint32_t count = 0;
+	};
+
+	static uint32_t BinIndex(float centroid, float centroidMin, float scale, uint32_t binCount)
+	{
+		return std::min(binCount - 1, static_cast<uint32_t>(std::max(0.0f, (centroid - centroidMin) * scale)));
+	}
+
+	// Bounds of the range and the split with the lowest surface area cost.
+	// Returns false if the range should become a leaf
+	static bool FindSplit(const BuildData& data, const BuildRange& range, Node& node,
+						  uint32_t& axis, float& centroidMin, float& scale, uint32_t& split)
+	{
+		// Large ranges are summed up in batches across the job system
+		const uint32_t batchSize = range.count >= ParallelBinning ? ParallelBinning / 4 : range.count;
+		const uint32_t batchCount = (range.count + batchSize - 1) / batchSize;
+		std::vector<Node> batchBounds(batchCount);
+		std::vector<std::pair<glm::vec3, glm::vec3>> batchCentroids(batchCount,
+			{ glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX) });
+		JobSystem::ParallelFor(range.count, batchSize,
+			[&data, &range, &batchBounds, &batchCentroids, batchSize](uint32_t begin, uint32_t end)
+		{
+			Node& bounds = batchBounds[begin / batchSize];
+			auto& centroids = batchCentroids[begin / batchSize];
+			for (uint32_t i = range.first + begin; i < range.first + end; ++i)
+			{
+				const uint32_t triangle = data.order[i];
+				bounds.min = glm::min(bounds.min, data.min[triangle]);
+				bounds.max = glm::max(bounds.max, data.max[triangle]);
+				centroids.first = glm::min(centroids.first, data.centroid[triangle]);
+				centroids.second = glm::max(centroids.second, data.centroid[triangle]);
+			}
+		});
+
+		glm::vec3 cMin = glm::vec3(FLT_MAX), cMax = glm::vec3(-FLT_MAX);
+		for (uint32_t b = 0; b < batchCount; ++b)
+		{
+			node.min = glm::min(node.min, batchBounds[b].min);
+			node.max = glm::max(node.max, batchBounds[b].max);
+			cMin = glm::min(cMin, batchCentroids[b].first);
+			cMax = glm::max(cMax, batchCentroids[b].second);
+		}
+
+		if (range.count <= MinimumTriangles || range.depth + 1 >= MaxDepth)
+			return false;
+
+		// Split the longest axis of the centroids' bounds
+		const glm::vec3 extent = cMax - cMin;
+		axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+		if (!(extent[axis] > FLT_EPSILON))
+		{
+			// Every centroid is in the same place, halve the range if it is too large
+			if (range.count <= MaximumTriangles) return false;
+			split = UINT32_MAX;
+			return true;
+		}
+
+		const uint32_t binCount = std::clamp(BinCount, 2u, MaxBins);
+		centroidMin = cMin[axis];
+		scale = binCount / extent[axis];
+
+		std::vector<std::array<Bin, MaxBins>> batchBins(batchCount);
+		JobSystem::ParallelFor(range.count, batchSize,
+			[&, binCount](uint32_t begin, uint32_t end)
+		{
+			auto& bins = batchBins[begin / batchSize];
+			for (uint32_t i = range.first + begin; i < range.first + end; ++i)
+			{
+				const uint32_t triangle = data.order[i];
+				Bin& bin = bins[BinIndex(data.centroid[triangle][axis], centroidMin, scale, binCount)];
+				bin.min = glm::min(bin.min, data.min[triangle]);
+				bin.max = glm::max(bin.max, data.max[triangle]);
+				++bin.count;
+			}
+		});
+
+		Bin bins[MaxBins];
+		for (uint32_t b = 0; b < batchCount; ++b)
+		{
+			for (uint32_t i = 0; i < binCount; ++i)
+			{
+				bins[i].min = glm::min(bins[i].min, batchBins[b][i].min);
+				bins[i].max = glm::max(bins[i].max, batchBins[b][i].max);
+				bins[i].count += batchBins[b][i].count;
+			}
+		}
+
+		// Sweep from the right, then from the left evaluating every split between bins
+		float rightCost[MaxBins];
+		Bin right;
+		for (uint32_t i = binCount - 1; i > 0; --i)
+		{
+			right.min = glm::min(right.min, bins[i].min);
+			right.max = glm::max(right.max, bins[i].max);
+			right.count += bins[i].count;
+			rightCost[i] = right.count * SurfaceArea(right.min, right.max);
+		}
+
+		float bestCost = FLT_MAX;
+		Bin left;
+		for (uint32_t i = 1; i < binCount; ++i)
+		{
+			left.min = glm::min(left.min, bins[i - 1].min);
+			left.max = glm::max(left.max, bins[i - 1].max);
+			left.count += bins[i - 1].count;
+			if (left.count == 0 || left.count == range.count) continue;
+
+			float cost = left.count * SurfaceArea(left.min, left.max) + rightCost[i];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				split = i;
+			}
+		}
+
+		const float area = SurfaceArea(node.min, node.max);
+		const float leafCost = range.count * area;
+		bestCost += TraversalCost * area;
+		return bestCost < leafCost || range.count > MaximumTriangles;
+	}
+
+	// Turn ranges into nodes until the stack is empty. Ranges that reach stopDepth
+	// are moved to deferred instead, with only their bounds written
+	static void BuildRanges(BuildData& data,
+							std::vector<Node>& nodes,
+							std::vector<BuildRange>& stack,
+							uint32_t stopDepth,
+							std::vector<BuildRange>* deferred)
+	{
+		while (!stack.empty())
+		{
+			BuildRange range = stack.back();
+			stack.pop_back();
+
+			Node node;
+			uint32_t axis = 0, split = 0;
+			float centroidMin = 0.0f, scale = 0.0f;
+			bool isInterior = FindSplit(data, range, node, axis, centroidMin, scale, split);
+			if (deferred && range.depth == stopDepth && isInterior)
+			{
+				nodes[range.node] = node;
+				deferred->push_back(range);
+				continue;
+			}
+
+			if (!isInterior)
+			{
+				node.leftFirst = range.first;
+				node.count = range.count;
+				nodes[range.node] = node;
+				continue;
+			}
+
+			uint32_t middle = range.count / 2;
+			if (split != UINT32_MAX)
+			{
+				const uint32_t binCount = std::clamp(BinCount, 2u, MaxBins);
+				auto begin = data.order.begin() + range.first;
+				auto it = std::partition(begin, begin + range.count, [&](uint32_t triangle)
+				{
+					return BinIndex(data.centroid[triangle][axis], centroidMin, scale, binCount) < split;
+				});
+				middle = static_cast<uint32_t>(it - begin);
+			}
+
+			node.leftFirst = nodes.size();
+			nodes[range.node] = node;
+			nodes.emplace_back();
+			nodes.emplace_back();
+			stack.push_back({ node.leftFirst + 1, range.first + middle, range.count - middle, range.depth + 1 });
+			stack.push_back({ node.leftFirst, range.first, middle, range.depth + 1 });
+		}
+	}
+
+	void Build()
+	{
+		auto start = std::chrono::steady_clock::now();
+		m_nodes.clear();
+		const uint32_t triangleCount = m_triangles.size();
+		if (triangleCount == 0) return;
+
+		BuildData data;
+		data.Resize(triangleCount);
+		JobSystem::ParallelFor(triangleCount, 4096,
+			[this, &data](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; ++i)
+			{
+				const glm::vec3* p = m_triangles[i].triangle.positions;
+				data.min[i] = glm::min(p[0], glm::min(p[1], p[2]));
+				data.max[i] = glm::max(p[0], glm::max(p[1], p[2]));
+				data.centroid[i] = (data.min[i] + data.max[i]) * 0.5f;
+				data.order[i] = i;
+			}
+		});
+		m_stats.AddPhase("Bounds", start);
+
+		std::vector<Node> nodes = BuildNodes(data, &m_stats);
+
+		// Store the triangles in leaf order so that each leaf reads a contiguous range
+		start = std::chrono::steady_clock::now();
+		std::vector<Triangle> ordered(triangleCount);
+		for (uint32_t i = 0; i < triangleCount; ++i)
+			ordered[i] = m_triangles[data.order[i]];
+		m_triangles = std::move(ordered);
+		m_nodes = std::move(nodes);
+		for (uint32_t i = 0; i < triangleCount; ++i)
+			m_slots[data.order[i]] = i;
+		m_levels = GroupLevels(m_nodes);
+		GatherNodeEntities();
+		m_stats.buildCost = m_stats.cost = Cost(m_nodes);
+		m_debugDirty = true;
+		m_stats.AddPhase("Reorder", start);
+	}
+
+	// Where a source's triangles start in the slots, the first of an entity's
+	// triangles is at its first slot
+	struct Source
+	{
+		const Mesh<Vertex>* mesh;
+		glm::mat4 model;
+		uint32_t firstSlot;
+	};
+
+	// Bake each mesh into world space straight into its triangles' slots
+	void Bake(const std::vector<Source>& sources)
+	{
+		JobSystem::ParallelFor(sources.size(),
+			[this, &sources](uint32_t begin, uint32_t end)
+		{
+			std::vector<glm::vec3> positions;
+			for (uint32_t i = begin; i < end; ++i)
+			{
+				const Source& source = sources[i];
+				auto data = source.mesh->GetDataView();
+				positions.resize(data.vertexCount);
+				for (uint32_t v = 0; v < data.vertexCount; ++v)
+					positions[v] = static_cast<glm::vec3>(source.model * glm::vec4(data.vertices[v].pos, 1.0f));
+
+				for (uint32_t t = 0; t < data.indexCount / 3; ++t)
+				{
+					Triangle& triangle = m_triangles[m_slots[source.firstSlot + t]];
+					for (uint32_t corner = 0; corner < 3; ++corner)
+						triangle.triangle.positions[corner] = positions[data.indices[t * 3 + corner]];
+				}
+			}
+		});
+	}
+
+	void Refit()
+	{
+		m_stats.cost = RefitNodes(m_nodes, m_levels, [this](const Node& leaf, glm::vec3& min, glm::vec3& max)
+		{
+			for (uint32_t i = leaf.leftFirst; i < leaf.leftFirst + leaf.count; ++i)
+			{
+				const glm::vec3* p = m_triangles[i].triangle.positions;
+				min = glm::min(min, glm::min(p[0], glm::min(p[1], p[2])));
+				max = glm::max(max, glm::max(p[0], glm::max(p[1], p[2])));
+			}
+		});
+		++m_stats.refits;
+	}
+
+	// A tree built on a job from the triangles' bounds when it was started
+	struct Rebuild
+	{
+		Job job;
+		std::atomic<bool> done = false;
+		BuildData data;
+		std::vector<Node> nodes;
+	};
+
+	void StartRebuild()
+	{
+		m_rebuild = std::make_unique<Rebuild>();
+		Rebuild* rebuild = m_rebuild.get();
+		rebuild->data.Resize(m_triangles.size());
+		JobSystem::ParallelFor(m_triangles.size(), 4096,
+			[this, rebuild](uint32_t begin, uint32_t end)
+		{
+			BuildData& data = rebuild->data;
+			for (uint32_t i = begin; i < end; ++i)
+			{
+				const glm::vec3* p = m_triangles[i].triangle.positions;
+				data.min[i] = glm::min(p[0], glm::min(p[1], p[2]));
+				data.max[i] = glm::max(p[0], glm::max(p[1], p[2]));
+				data.centroid[i] = (data.min[i] + data.max[i]) * 0.5f;
+				data.order[i] = i;
+			}
+		});
+
+		// Runs on a single worker, its parallel fors run inline
+		rebuild->job = JobSystem::Push([rebuild]
+		{
+			rebuild->nodes = BuildNodes(rebuild->data, nullptr);
+			rebuild->done = true;
+		});
+		JobSystem::Execute();
+	}
+
+	// Swap in a finished rebuild, waiting for it if asked to
+	void FinishRebuild(bool wait)
+	{
+		if (m_rebuild == nullptr || (!wait && !m_rebuild->done)) return;
+		JobSystem::Wait(m_rebuild->job);
+
+		// The triangles kept moving during the build, take them as they are now
+		const std::vector<uint32_t>& order = m_rebuild->data.order;
+		std::vector<Triangle> ordered(m_triangles.size());
+		std::vector<uint32_t> moved(m_triangles.size());
+		for (uint32_t i = 0; i < ordered.size(); ++i)
+		{
+			ordered[i] = m_triangles[order[i]];
+			moved[order[i]] = i;
+		}
+		for (uint32_t& slot : m_slots)
+			slot = moved[slot];
+
+		m_triangles = std::move(ordered);
+		m_nodes = std::move(m_rebuild->nodes);
+		m_rebuild.reset();
+		m_levels = GroupLevels(m_nodes);
+		GatherNodeEntities();
+
+		// Catch up on what moved since the rebuild started
+		Refit();
+		m_stats.buildCost = m_stats.cost;
+		++m_stats.rebuilds;
+		m_debugDirty = true;
+		GatherStats();
+	}
+
+	// Upload the triangles into the debug mesh if they changed since the last
+	// upload. The previous mesh may still be used by frames in flight
+	void UpdateDebugMesh()
+	{
+		++m_frame;
+		while (!m_retired.empty() && m_frame - m_retired.front().first > MAX_FRAME_DRAWS)
+			m_retired.pop_front();
+
+		if (!m_debugDirty || m_triangles.empty()) return;
+
+		if (m_debugMesh.GetVertexCount() != 0)
+			m_retired.emplace_back(m_frame, std::move(m_debugMesh));
+
+		std::vector<PosVertex> vertices(m_triangles.size() * 3);
+		std::vector<uint32_t> indices(m_triangles.size() * 3);
+		for (uint32_t i = 0; i < vertices.size(); ++i)
+		{
+			vertices[i].pos = m_triangles[i / 3].triangle.positions[i % 3];
+			indices[i] = i;
+		}
+		m_debugMesh = Mesh<PosVertex>(vertices, indices, m_owner);
+		m_debugDirty = false;
+	}
+
+	// First triangle and triangle count below a node
+	void TriangleRange(uint32_t nodeIndex, uint32_t& first, uint32_t& count) const
+	{
+		uint32_t leftmost = nodeIndex, rightmost = nodeIndex;
+		while (!m_nodes[leftmost].IsLeaf())
+			leftmost = m_nodes[leftmost].leftFirst;
+		while (!m_nodes[rightmost].IsLeaf())
+			rightmost = m_nodes[rightmost].leftFirst + 1;
+
+		first = m_nodes[leftmost].leftFirst;
+		count = m_nodes[rightmost].leftFirst + m_nodes[rightmost].count - first;
+	}
+
+	// Describe the tree as it is now, build phases are added by whoever built it
+	void GatherStats()
+	{
+		m_stats.leafCount = 0;
+		m_stats.leafTriangles.fill(0);
+		m_stats.nodesPerDepth.clear();
+		m_stats.nodeCount = m_nodes.size();
+		m_stats.objectCount = m_triangles.size();
+		m_stats.storedTriangles = m_triangles.size();
+
+		std::vector<std::pair<uint32_t, uint32_t>> stack = { { 0, 0 } };
+		while (!m_nodes.empty() && !stack.empty())
+		{
+			auto [nodeIndex, depth] = stack.back();
+			stack.pop_back();
+			if (m_stats.nodesPerDepth.size() <= depth)
+				m_stats.nodesPerDepth.resize(depth + 1, 0);
+			++m_stats.nodesPerDepth[depth];
+
+			const Node& node = m_nodes[nodeIndex];
+			if (node.IsLeaf())
+			{
+				m_stats.AddLeaf(node.count);
+				continue;
+			}
+			stack.push_back({ node.leftFirst, depth + 1 });
+			stack.push_back({ node.leftFirst + 1, depth + 1 });
+		}
+
+		m_stats.memoryBytes = m_nodes.size() * sizeof(Node) +
+			m_triangles.size() * sizeof(Triangle) +
+			m_nodeEntities.size() * sizeof(EntityList) +
+			m_nodeEntityIndices.size() * sizeof(uint32_t);
+	}
+
+	Pool<Node> m_nodes;
+	// World space triangles in leaf order
+	Pool<Triangle> m_triangles;
+	// Where each source triangle is in m_triangles, an entity's source triangles are contiguous
+	std::vector<uint32_t> m_slots;
+	// First source triangle and triangle count of each entity
+	std::unordered_map<entt::entity, std::pair<uint32_t, uint32_t>> m_entityTriangles;
+	Levels m_levels;
+	std::unique_ptr<Rebuild> m_rebuild;
+
+	// Every triangle in one buffer, only created when objects are drawn
+	Mesh<PosVertex> m_debugMesh;
+	bool m_debugDirty = true;
+	// Replaced meshes, kept until no frame in flight can use them
+	std::deque<std::pair<uint32_t, Mesh<PosVertex>>> m_retired;
+	uint32_t m_frame = 0;
+	// What was built and how much work the queries do
+	SpatialStats m_stats;
+
+	// Entity of each entity index
+	std::vector<entt::entity> m_entities;
+	std::vector<EntityList> m_nodeEntities;
+	std::vector<uint32_t> m_nodeEntityIndices;
+	// Per entity, the last frustum query it was found visible by
+	std::vector<uint32_t> m_visibleQueries;
+	uint32_t m_visibleQuery = 0;
+
+	Device* m_owner = nullptr;
+};
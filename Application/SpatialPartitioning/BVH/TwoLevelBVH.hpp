@@ -0,0 +1,677 @@
+#pragma once
+
+// Two levels of BVHs over the rendered entities. Each distinct mesh gets a bottom
+// level BVH built once over its local space triangles, shared by every entity
+// placing it. The top level is a small BVH over the entities' world bounds that
+// is refit when they move. Queries are moved into local space at the instance
+class TwoLevelBVH
+{
+public:
+	// Bottom level, one per distinct mesh
+	struct Blas
+	{
+		Pool<BVH::Node> nodes;
+		// Local space triangles in leaf order, without an entity
+		Pool<BVH::Triangle> triangles;
+		// Positions and indices the mesh was matched by
+		uint64_t hash = 0;
+		// Only valid during Create, to tell meshes with the same hash apart
+		const Mesh<Vertex>* source = nullptr;
+		// Every triangle in one buffer, only created when objects are drawn
+		Mesh<PosVertex> debugMesh;
+	};
+
+	// Top level leaves index these
+	struct Instance
+	{
+		entt::entity entity;
+		uint32_t blas;
+		glm::mat4 model;
+		glm::mat4 invModel;
+		// World space bounds
+		glm::vec3 min;
+		glm::vec3 max;
+	};
+
+	struct CollisionPair
+	{
+		// Index into the queried colliders
+		uint32_t collider;
+		entt::entity entity;
+		// Triangle index in the entity's mesh
+		uint32_t triangle;
+	};
+
+	void Create(Device& owner)
+	{
+		m_owner = &owner;
+		m_stats.ResetBuild();
+		auto start = std::chrono::steady_clock::now();
+		auto view = ECS::Get().view<TransformComponent,
+			DeferredRenderComponent>();
+
+		std::vector<const Mesh<Vertex>*> meshes;
+		view.each([this, &meshes](const entt::entity entity,
+								  const TransformComponent& transform,
+								  const DeferredRenderComponent& render)
+		{
+			// Meshes without triangles have nothing to hit or cull
+			if (render.mesh.GetIndexCount() < 3) return;
+
+			Instance instance;
+			instance.entity = entity;
+			instance.model = transform.model;
+			m_instances.push_back(instance);
+			meshes.push_back(&render.mesh);
+		});
+
+		// Hash in parallel, then match the meshes to bottom levels in order
+		std::vector<uint64_t> hashes(meshes.size());
+		JobSystem::ParallelFor(meshes.size(),
+			[&meshes, &hashes](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; ++i)
+				hashes[i] = Hash(*meshes[i]);
+		});
+
+		std::unordered_multimap<uint64_t, uint32_t> blasByHash;
+		for (uint32_t i = 0; i < m_instances.size(); ++i)
+		{
+			auto [it, last] = blasByHash.equal_range(hashes[i]);
+			while (it != last && !SameGeometry(*m_blases[it->second].source, *meshes[i]))
+				++it;
+
+			if (it == last)
+			{
+				it = blasByHash.emplace(hashes[i], static_cast<uint32_t>(m_blases.size()));
+				Blas& blas = m_blases.emplace_back();
+				blas.hash = hashes[i];
+				blas.source = meshes[i];
+			}
+			m_instances[i].blas = it->second;
+		}
+		m_stats.AddPhase("Match Meshes", start);
+
+		// Each bottom level is built on its own job, a single one builds in parallel
+		start = std::chrono::steady_clock::now();
+		JobSystem::ParallelFor(m_blases.size(), 1,
+			[this](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; ++i)
+				BuildBlas(m_blases[i]);
+		});
+		for (Blas& blas : m_blases)
+			blas.source = nullptr;
+		m_stats.AddPhase("Build Bottom Levels", start);
+
+		start = std::chrono::steady_clock::now();
+		for (Instance& instance : m_instances)
+			UpdateInstance(instance);
+		BuildTlas();
+		m_stats.AddPhase("Build Top Level", start);
+
+		GatherStats();
+	}
+
+	// Move the instances of entities whose model changed and refit the top level
+	void Update(const std::vector<entt::entity>& moved)
+	{
+		if (m_nodes.empty() || moved.empty()) return;
+
+		auto& registry = ECS::Get();
+		bool refit = false;
+		for (entt::entity entity : moved)
+		{
+			auto it = m_instanceIndex.find(entity);
+			if (it == m_instanceIndex.end() || !registry.valid(entity)) continue;
+			const auto* transform = registry.try_get<TransformComponent>(entity);
+			if (transform == nullptr) continue;
+
+			Instance& instance = m_instances[it->second];
+			instance.model = transform->model;
+			UpdateInstance(instance);
+			refit = true;
+		}
+
+		if (!refit) return;
+
+		// The top level is small enough to rebuild in place once refitting wore it down
+		Refit();
+		if (m_stats.cost > BVH::RebuildThreshold * m_stats.buildCost)
+		{
+			BuildTlas();
+			++m_stats.rebuilds;
+		}
+	}
+
+#ifndef BK_HEADLESS
+	void RenderCells(vk::CommandBuffer commandBuffer,
+				vk::PipelineLayout pipelineLayout)
+	{
+		if (m_nodes.empty()) return;
+		SimpleMesh<PosVertex>::CubeList->Bind(commandBuffer);
+
+		// Top level nodes down to the BVH's display depth
+		std::vector<std::pair<uint32_t, uint32_t>> stack = { { 0, 0 } };
+		while (!stack.empty())
+		{
+			auto [nodeIndex, depth] = stack.back();
+			stack.pop_back();
+			const BVH::Node& node = m_nodes[nodeIndex];
+
+			glm::mat4 model = glm::translate(utils::identity, (node.min + node.max) * 0.5f);
+			model = glm::scale(model, node.max - node.min);
+			commandBuffer.pushConstants(
+				pipelineLayout,
+				vk::ShaderStageFlagBits::eVertex,
+				0, sizeof(glm::mat4), &model
+			);
+			SimpleMesh<PosVertex>::CubeList->Draw(commandBuffer);
+
+			if (node.IsLeaf() || depth >= static_cast<uint32_t>(BVH::DisplayDepth)) continue;
+			stack.push_back({ node.leftFirst, depth + 1 });
+			stack.push_back({ node.leftFirst + 1, depth + 1 });
+		}
+	}
+
+	// Every instance drawn from its bottom level's mesh, one color per bottom level
+	void RenderObjects(vk::CommandBuffer commandBuffer,
+				vk::PipelineLayout pipelineLayout)
+	{
+		if (m_nodes.empty()) return;
+		srand(1305871305);
+
+		std::vector<glm::vec4> colors(m_blases.size());
+		for (uint32_t i = 0; i < m_blases.size(); ++i)
+		{
+			colors[i] = { utils::Random(), utils::Random(), utils::Random(), 1.0f };
+
+			Blas& blas = m_blases[i];
+			if (blas.debugMesh.GetVertexCount() != 0) continue;
+			std::vector<PosVertex> vertices(blas.triangles.size() * 3);
+			std::vector<uint32_t> indices(blas.triangles.size() * 3);
+			for (uint32_t v = 0; v < vertices.size(); ++v)
+			{
+				vertices[v].pos = blas.triangles[v / 3].triangle.positions[v % 3];
+				indices[v] = v;
+			}
+			blas.debugMesh = Mesh<PosVertex>(vertices, indices, m_owner);
+		}
+
+		uint32_t bound = UINT32_MAX;
+		for (const Instance& instance : m_instances)
+		{
+			const Blas& blas = m_blases[instance.blas];
+			if (instance.blas != bound)
+			{
+				blas.debugMesh.Bind(commandBuffer);
+				bound = instance.blas;
+			}
+
+			commandBuffer.pushConstants(
+				pipelineLayout,
+				vk::ShaderStageFlagBits::eVertex,
+				0, sizeof(glm::mat4), &instance.model
+			);
+			commandBuffer.pushConstants(
+				pipelineLayout,
+				vk::ShaderStageFlagBits::eFragment,
+				sizeof(glm::mat4), sizeof(utils::UBOColor), &colors[instance.blas]
+			);
+			blas.debugMesh.Draw(commandBuffer);
+		}
+	}
+#endif
+
+	void Destroy()
+	{
+		m_owner->waitIdle();
+		m_nodes.clear();
+		m_instances.clear();
+		m_instanceIndex.clear();
+		m_levels = BVH::Levels();
+		m_blases.clear();
+		m_stats.ResetBuild();
+	}
+
+	bool IsInitialized()
+	{
+		return !m_nodes.empty();
+	}
+
+	// Nearest triangle hit within maxT, t is in units of the ray direction.
+	// Only reads the tree, so rays can be cast from several threads at once
+	std::optional<BVH::RayHit> RayCast(const Primitives::Ray& ray, float maxT) const
+	{
+		if (m_nodes.empty()) return std::nullopt;
+
+		const glm::vec3 invDirection = 1.0f / ray.direction;
+		float t = maxT;
+		uint32_t hitInstance = UINT32_MAX, hitTriangle = UINT32_MAX;
+		SpatialStats::Counters counters;
+
+		std::pair<uint32_t, float> stack[MaxDepth];
+		uint32_t top = 0;
+		float entry;
+		if (RayBounds(ray.position, invDirection, m_nodes[0].min, m_nodes[0].max, t, entry))
+			stack[top++] = { 0, entry };
+
+		while (top != 0)
+		{
+			auto [nodeIndex, nodeEntry] = stack[--top];
+			if (nodeEntry > t) continue;
+			const BVH::Node& node = m_nodes[nodeIndex];
+			++counters.visitedNodes;
+
+			if (node.IsLeaf())
+			{
+				for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+				{
+					const Instance& instance = m_instances[i];
+					if (!RayBounds(ray.position, invDirection, instance.min, instance.max, t, entry))
+						continue;
+
+					// The direction isn't normalized, so t is the same in both spaces
+					const Blas& blas = m_blases[instance.blas];
+					Primitives::Ray local = {
+						glm::vec3(instance.invModel * glm::vec4(ray.position, 1.0f)),
+						glm::vec3(instance.invModel * glm::vec4(ray.direction, 0.0f))
+					};
+					if (BVH::IntersectTriangles(blas.nodes.data(), blas.triangles.data(), local, t, hitTriangle, counters))
+						hitInstance = i;
+				}
+				continue;
+			}
+
+			// Nearest child first
+			const BVH::Node& left = m_nodes[node.leftFirst];
+			const BVH::Node& right = m_nodes[node.leftFirst + 1];
+			float leftEntry, rightEntry;
+			bool hitLeft = RayBounds(ray.position, invDirection, left.min, left.max, t, leftEntry);
+			bool hitRight = RayBounds(ray.position, invDirection, right.min, right.max, t, rightEntry);
+			if (hitLeft && hitRight)
+			{
+				bool leftFirst = leftEntry <= rightEntry;
+				stack[top++] = leftFirst ? std::make_pair(node.leftFirst + 1, rightEntry) : std::make_pair(node.leftFirst, leftEntry);
+				stack[top++] = leftFirst ? std::make_pair(node.leftFirst, leftEntry) : std::make_pair(node.leftFirst + 1, rightEntry);
+			}
+			else if (hitLeft)
+			{
+				stack[top++] = { node.leftFirst, leftEntry };
+			}
+			else if (hitRight)
+			{
+				stack[top++] = { node.leftFirst + 1, rightEntry };
+			}
+		}
+
+		m_stats.ray.Add(counters);
+		if (hitInstance == UINT32_MAX) return std::nullopt;
+
+		const Instance& instance = m_instances[hitInstance];
+		const BVH::Triangle& triangle = m_blases[instance.blas].triangles[hitTriangle];
+		const glm::vec3* p = triangle.triangle.positions;
+		const glm::vec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+
+		BVH::RayHit result;
+		result.entity = instance.entity;
+		result.triangle = triangle.index;
+		result.t = t;
+		result.normal = glm::normalize(glm::transpose(glm::mat3(instance.invModel)) * normal);
+		return result;
+	}
+
+	// Gather the entities with geometry inside the frustum of a view-projection.
+	// Instances straddling the frustum are tested against their bottom level
+	void FrustumQuery(const glm::mat4& viewProjection, std::vector<entt::entity>& visible) const
+	{
+		visible.clear();
+		if (m_nodes.empty()) return;
+
+		const Primitives::Frustum frustum = Primitives::GenerateFrustum(viewProjection);
+		SpatialStats::Counters counters;
+
+		std::pair<uint32_t, uint32_t> stack[MaxDepth];
+		uint32_t top = 0;
+		stack[top++] = { 0, 0x3Fu };
+		while (top != 0)
+		{
+			auto [nodeIndex, planeMask] = stack[--top];
+			const BVH::Node& node = m_nodes[nodeIndex];
+			++counters.visitedNodes;
+
+			bool outside = false;
+			if (planeMask != 0)
+				planeMask = Primitives::FrustumBox(frustum, planeMask, node.min, node.max, outside);
+			if (outside) continue;
+
+			if (!node.IsLeaf())
+			{
+				stack[top++] = { node.leftFirst + 1, planeMask };
+				stack[top++] = { node.leftFirst, planeMask };
+				continue;
+			}
+
+			for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+			{
+				const Instance& instance = m_instances[i];
+				uint32_t instanceMask = planeMask;
+				if (instanceMask != 0)
+				{
+					instanceMask = Primitives::FrustumBox(frustum, planeMask, instance.min, instance.max, outside);
+					if (outside) continue;
+				}
+
+				// The frustum of the combined matrix is in the instance's local space
+				if (instanceMask == 0 ||
+					BlasInFrustum(m_blases[instance.blas],
+								  Primitives::GenerateFrustum(viewProjection * instance.model),
+								  counters))
+				{
+					visible.push_back(instance.entity);
+				}
+			}
+		}
+		m_stats.frustum.Add(counters);
+	}
+
+	// Every (collider, triangle) pair whose boxes overlap. The colliders are
+	// bounded in each instance's local space, so rotated instances report more
+	// pairs than an exact test would
+	void CollisionQuery(const std::vector<Primitives::Box>& colliders,
+						std::vector<CollisionPair>& pairs) const
+	{
+		pairs.clear();
+		if (m_nodes.empty()) return;
+
+		SpatialStats::Counters counters;
+		uint32_t stack[MaxDepth];
+		for (uint32_t c = 0; c < colliders.size(); ++c)
+		{
+			const glm::vec3 min = colliders[c].position - colliders[c].halfExtent;
+			const glm::vec3 max = colliders[c].position + colliders[c].halfExtent;
+
+			uint32_t top = 0;
+			stack[top++] = 0;
+			while (top != 0)
+			{
+				const BVH::Node& node = m_nodes[stack[--top]];
+				++counters.visitedNodes;
+				if (!Overlap(node.min, node.max, min, max)) continue;
+
+				if (!node.IsLeaf())
+				{
+					stack[top++] = node.leftFirst;
+					stack[top++] = node.leftFirst + 1;
+					continue;
+				}
+
+				for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+				{
+					const Instance& instance = m_instances[i];
+					if (!Overlap(instance.min, instance.max, min, max)) continue;
+
+					glm::vec3 localMin, localMax;
+					TransformBounds(instance.invModel, min, max, localMin, localMax);
+					const Blas& blas = m_blases[instance.blas];
+					BVH::OverlapTriangles(blas.nodes.data(), blas.triangles.data(), localMin, localMax,
+										  counters, [&pairs, &blas, &instance, c](uint32_t triangle)
+					{
+						pairs.push_back({ c, instance.entity, blas.triangles[triangle].index });
+					});
+				}
+			}
+		}
+		m_stats.collision.Add(counters);
+	}
+
+	const Pool<BVH::Node>& GetNodes() const { return m_nodes; }
+	const std::vector<Instance>& GetInstances() const { return m_instances; }
+	const std::vector<Blas>& GetBlases() const { return m_blases; }
+	const SpatialStats& GetStats() const { return m_stats; }
+
+private:
+	static constexpr uint32_t MaxDepth = 64;
+
+	static bool Overlap(const glm::vec3& aMin, const glm::vec3& aMax,
+						const glm::vec3& bMin, const glm::vec3& bMax)
+	{
+		return (aMin.x <= bMax.x) & (aMax.x >= bMin.x) &
+			(aMin.y <= bMax.y) & (aMax.y >= bMin.y) &
+			(aMin.z <= bMax.z) & (aMax.z >= bMin.z);
+	}
+
+	static bool RayBounds(const glm::vec3& origin,
+						  const glm::vec3& invDirection,
+						  const glm::vec3& min,
+						  const glm::vec3& max,
+						  float t,
+						  float& entry)
+	{
+		const glm::vec3 t0 = (min - origin) * invDirection;
+		const glm::vec3 t1 = (max - origin) * invDirection;
+		const glm::vec3 near = glm::min(t0, t1);
+		const glm::vec3 far = glm::max(t0, t1);
+		entry = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+		float exit = std::min(std::min(far.x, far.y), far.z);
+		return entry <= exit && entry <= t;
+	}
+
+	// Bounds of a transformed box, from its transformed center and the
+	// absolute matrix applied to its extent
+	static void TransformBounds(const glm::mat4& transform,
+								const glm::vec3& min,
+								const glm::vec3& max,
+								glm::vec3& outMin,
+								glm::vec3& outMax)
+	{
+		const glm::vec3 center = glm::vec3(transform * glm::vec4((min + max) * 0.5f, 1.0f));
+		const glm::mat3 linear = glm::mat3(transform);
+		const glm::mat3 absolute = glm::mat3(glm::abs(linear[0]), glm::abs(linear[1]), glm::abs(linear[2]));
+		const glm::vec3 extent = absolute * ((max - min) * 0.5f);
+		outMin = center - extent;
+		outMax = center + extent;
+	}
+
+	// FNV-1a over the positions and indices, the rest of the vertex is ignored
+	static uint64_t Hash(const Mesh<Vertex>& mesh)
+	{
+		auto data = mesh.GetDataView();
+		uint64_t hash = 14695981039346656037ull;
+		auto add = [&hash](const void* bytes, size_t size)
+		{
+			const uint8_t* p = static_cast<const uint8_t*>(bytes);
+			for (size_t i = 0; i < size; ++i)
+				hash = (hash ^ p[i]) * 1099511628211ull;
+		};
+		for (uint32_t i = 0; i < data.vertexCount; ++i)
+			add(&data.vertices[i].pos, sizeof(glm::vec3));
+		add(data.indices, data.indexCount * sizeof(uint32_t));
+		return hash;
+	}
+
+	static bool SameGeometry(const Mesh<Vertex>& a, const Mesh<Vertex>& b)
+	{
+		auto dataA = a.GetDataView();
+		auto dataB = b.GetDataView();
+		if (dataA.vertexCount != dataB.vertexCount || dataA.indexCount != dataB.indexCount)
+			return false;
+		for (uint32_t i = 0; i < dataA.vertexCount; ++i)
+		{
+			if (dataA.vertices[i].pos != dataB.vertices[i].pos)
+				return false;
+		}
+		return std::equal(dataA.indices, dataA.indices + dataA.indexCount, dataB.indices);
+	}
+
+	static void BuildBlas(Blas& blas)
+	{
+		auto data = blas.source->GetDataView();
+		const uint32_t triangleCount = data.indexCount / 3;
+		std::vector<BVH::Triangle> triangles(triangleCount);
+		BVH::BuildData bounds;
+		bounds.Resize(triangleCount);
+		for (uint32_t t = 0; t < triangleCount; ++t)
+		{
+			BVH::Triangle& triangle = triangles[t];
+			glm::vec3* p = triangle.triangle.positions;
+			for (uint32_t corner = 0; corner < 3; ++corner)
+				p[corner] = data.vertices[data.indices[t * 3 + corner]].pos;
+			triangle.entity = entt::null;
+			triangle.index = t;
+			// Shared by every instance, the instance is what a query flags
+			triangle.entityIndex = 0;
+
+			bounds.min[t] = glm::min(p[0], glm::min(p[1], p[2]));
+			bounds.max[t] = glm::max(p[0], glm::max(p[1], p[2]));
+			bounds.centroid[t] = (bounds.min[t] + bounds.max[t]) * 0.5f;
+			bounds.order[t] = t;
+		}
+
+		blas.nodes = BVH::BuildNodes(bounds, nullptr);
+		std::vector<BVH::Triangle> ordered(triangleCount);
+		for (uint32_t t = 0; t < triangleCount; ++t)
+			ordered[t] = triangles[bounds.order[t]];
+		blas.triangles = std::move(ordered);
+	}
+
+	void UpdateInstance(Instance& instance)
+	{
+		instance.invModel = glm::inverse(instance.model);
+		const Blas& blas = m_blases[instance.blas];
+		TransformBounds(instance.model, blas.nodes[0].min, blas.nodes[0].max, instance.min, instance.max);
+	}
+
+	void BuildTlas()
+	{
+		BVH::BuildData bounds;
+		bounds.Resize(m_instances.size());
+		for (uint32_t i = 0; i < m_instances.size(); ++i)
+		{
+			bounds.min[i] = m_instances[i].min;
+			bounds.max[i] = m_instances[i].max;
+			bounds.centroid[i] = (m_instances[i].min + m_instances[i].max) * 0.5f;
+			bounds.order[i] = i;
+		}
+		m_nodes = BVH::BuildNodes(bounds, nullptr);
+		m_levels = BVH::GroupLevels(m_nodes);
+		m_stats.buildCost = m_stats.cost = BVH::Cost(m_nodes);
+
+		// Store the instances in leaf order
+		std::vector<Instance> ordered(m_instances.size());
+		m_instanceIndex.clear();
+		for (uint32_t i = 0; i < m_instances.size(); ++i)
+		{
+			ordered[i] = m_instances[bounds.order[i]];
+			m_instanceIndex[ordered[i].entity] = i;
+		}
+		m_instances = std::move(ordered);
+	}
+
+	void Refit()
+	{
+		m_stats.cost = BVH::RefitNodes(m_nodes, m_levels,
+			[this](const BVH::Node& leaf, glm::vec3& min, glm::vec3& max)
+		{
+			for (uint32_t i = leaf.leftFirst; i < leaf.leftFirst + leaf.count; ++i)
+			{
+				min = glm::min(min, m_instances[i].min);
+				max = glm::max(max, m_instances[i].max);
+			}
+		});
+		++m_stats.refits;
+	}
+
+	// Whether any triangle's bounds of the bottom level are inside a local space frustum
+	static bool BlasInFrustum(const Blas& blas,
+							  const Primitives::Frustum& frustum,
+							  SpatialStats::Counters& counters)
+	{
+		std::pair<uint32_t, uint32_t> stack[MaxDepth];
+		uint32_t top = 0;
+		stack[top++] = { 0, 0x3Fu };
+		while (top != 0)
+		{
+			auto [nodeIndex, planeMask] = stack[--top];
+			const BVH::Node& node = blas.nodes[nodeIndex];
+			++counters.visitedNodes;
+
+			bool outside = false;
+			planeMask = Primitives::FrustumBox(frustum, planeMask, node.min, node.max, outside);
+			if (outside) continue;
+			if (planeMask == 0) return true;
+
+			if (!node.IsLeaf())
+			{
+				stack[top++] = { node.leftFirst + 1, planeMask };
+				stack[top++] = { node.leftFirst, planeMask };
+				continue;
+			}
+
+			for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+			{
+				++counters.narrowPhaseTests;
+				const glm::vec3* p = blas.triangles[i].triangle.positions;
+				Primitives::FrustumBox(frustum, planeMask,
+									   glm::min(p[0], glm::min(p[1], p[2])),
+									   glm::max(p[0], glm::max(p[1], p[2])),
+									   outside);
+				if (!outside) return true;
+			}
+		}
+		return false;
+	}
+
+	void GatherStats()
+	{
+		// The depths are the top level's, the leaves are the bottom levels' triangle leaves
+		m_stats.objectCount = m_instances.size();
+		m_stats.nodeCount = m_nodes.size();
+		m_stats.memoryBytes = m_nodes.size() * sizeof(BVH::Node) +
+			m_instances.size() * sizeof(Instance);
+
+		std::vector<std::pair<uint32_t, uint32_t>> stack = { { 0, 0 } };
+		while (!m_nodes.empty() && !stack.empty())
+		{
+			auto [nodeIndex, depth] = stack.back();
+			stack.pop_back();
+			if (m_stats.nodesPerDepth.size() <= depth)
+				m_stats.nodesPerDepth.resize(depth + 1, 0);
+			++m_stats.nodesPerDepth[depth];
+
+			const BVH::Node& node = m_nodes[nodeIndex];
+			if (node.IsLeaf()) continue;
+			stack.push_back({ node.leftFirst, depth + 1 });
+			stack.push_back({ node.leftFirst + 1, depth + 1 });
+		}
+
+		for (const Blas& blas : m_blases)
+		{
+			m_stats.nodeCount += blas.nodes.size();
+			m_stats.storedTriangles += blas.triangles.size();
+			m_stats.memoryBytes += blas.nodes.size() * sizeof(BVH::Node) +
+				blas.triangles.size() * sizeof(BVH::Triangle);
+			for (const BVH::Node& node : blas.nodes)
+			{
+				if (node.IsLeaf())
+					m_stats.AddLeaf(node.count);
+			}
+		}
+
+		// Below 1 when instances share their geometry
+		for (const Instance& instance : m_instances)
+			m_stats.sourceTriangles += m_blases[instance.blas].triangles.size();
+	}
+
+	// Top level over the instances
+	Pool<BVH::Node> m_nodes;
+	// In top level leaf order
+	std::vector<Instance> m_instances;
+	std::unordered_map<entt::entity, uint32_t> m_instanceIndex;
+	BVH::Levels m_levels;
+	std::vector<Blas> m_blases;
+	// What was built and how much work the queries do
+	SpatialStats m_stats;
+
+	Device* m_owner = nullptr;
+};
@@ -2,559 +2,1814 @@
 
 class Octree
 {
+public:
+	// 8 triangles laid out per component as a vertex and two edges,
+	// unused lanes are degenerate and never hit
+	struct alignas(32) TrianglePacket
+	{
+		float v0x[8], v0y[8], v0z[8];
+		float e1x[8], e1y[8], e1z[8];
+		float e2x[8], e2y[8], e2z[8];
+	};
+
+	// Objects only hold ranges into the tree's geometry pools, so that everything
+	// can be written to and used in place from a file
+	struct Object
+	{
+		Primitives::Box bb;
+		entt::entity entity = entt::null;
+		// Vertices and the indices into them
+		uint32_t firstVertex = 0;
+		uint32_t vertexCount = 0;
+		uint32_t firstIndex = 0;
+		uint32_t indexCount = 0;
+		// Triangles for ray casts, the source triangle of packet lane j
+		// is at (firstPacket * 8 + j) in the triangle pool
+		uint32_t firstPacket = 0;
+		uint32_t packetCount = 0;
+		uint32_t colliding = 0;
+	};
+
+	struct CollisionPair
+	{
+		// Index into the collider batch
+		uint32_t collider;
+		// Index into GetObjects(), valid until the next Update
+		uint32_t object;
+		entt::entity entity;
+	};
 
+	struct RayHit
+	{
+		entt::entity entity = entt::null;
+		// Triangle index in the entity's mesh
+		uint32_t triangle = 0;
+		float t = 0.0f;
+		glm::vec3 normal = {};
+	};
+
+	// Nodes are stored breadth-first and the children of a node are contiguous,
+	// ordered by octant (Morton) index. A child is found from the first child
+	// offset and the number of octants present below it in the child mask
 	struct Node
 	{
 		Primitives::BoxUniform box;
-		Node* children[8] = { nullptr };
-		struct Object
-		{
-			Mesh<PosVertex> mesh;
-			Primitives::Box bb;
-			bool colliding = false;
-		};
-		std::list<Object> objects = { };
 		glm::vec3 color;
-		bool leaf = false;
+		// Index of the first child in the node array
+		uint32_t firstChild = 0;
+		// Index of this node's child bounds, only valid if it has children
+		uint32_t childBounds = 0;
+		// Range of this node's objects in the packed object array,
+		// the slots past the count are free for incremental inserts
+		uint32_t firstObject = 0;
+		uint32_t objectCount = 0;
+		uint32_t objectCapacity = 0;
+		uint32_t parent = 0;
+		// Bit i is set if octant i has a child
+		uint32_t childMask = 0;
 	};
 
+	// Tight bounds of all 8 children of a node laid out per axis,
+	// so that a query tests every child in one pass.
+	// Missing children have inverted bounds and never overlap anything
+	struct alignas(32) ChildBounds
+	{
+		float minX[8], minY[8], minZ[8];
+		float maxX[8], maxY[8], maxZ[8];
+	};
 
-public:
 	void Create(glm::vec3 position, float halfExtent, int stopDepth, Device& owner)
 	{
 		m_owner = &owner;
-		//head = CreateTree(position, halfExtent, stopDepth);
-		auto view = ECS::Get().view<TransformComponent, 
+		m_cell.position = position;
+		m_cell.halfExtent = halfExtent;
+		m_stats.ResetBuild();
+		auto start = std::chrono::steady_clock::now();
+		m_hash = HashScene(position, halfExtent, stopDepth);
+		m_stats.AddPhase("Hash", start);
+
+		start = std::chrono::steady_clock::now();
+		auto view = ECS::Get().view<TransformComponent,
 			DeferredRenderComponent>();
 
-		head = new Node();
-		head->box.position = position;
-		head->box.halfExtent = halfExtent;
-		head->color = glm::vec3(utils::Random(), utils::Random(), utils::Random());
+		// Gather the meshes here, the jobs below only read from them
+		struct Source
+		{
+			entt::entity entity;
+			const Mesh<Vertex>* mesh;
+			glm::mat4 model;
+		};
+		std::vector<Source> sources;
+		uint64_t sourceTriangles = 0;
+		view.each([&sources, &sourceTriangles](const entt::entity entity,
+											   const TransformComponent& transform,
+											   const DeferredRenderComponent& render)
+		{
+			sources.push_back({ entity, &render.mesh, transform.model });
+			sourceTriangles += render.mesh.GetIndexCount() / 3;
+		});
+		m_budget.Reset(sourceTriangles, MaxTriangleGrowth);
+		m_stats.AddPhase("Gather", start);
+
+		// Bake each mesh into world space and split it through the top levels
+		start = std::chrono::steady_clock::now();
+		std::vector<std::vector<Piece>> pieces(sources.size());
+		JobSystem::ParallelFor(sources.size(),
+			[this, &sources, &pieces, position, halfExtent](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; ++i)
+			{
+				Fragment data = Bake(*sources[i].mesh, sources[i].model);
+				SplitTopLevels(pieces[i], data, sources[i].entity, 1u, position, halfExtent, 0, m_budget);
+			}
+		});
+		m_stats.AddPhase("Split Top Levels", start);
+
+		// Merge the pieces into the top levels of the tree, anything that
+		// reached ParallelDepth is bucketed by the cell it continues from
+		start = std::chrono::steady_clock::now();
+		Builder builder;
+		builder.nodes.emplace_back();
+		builder.nodes[0].box.position = position;
+		builder.nodes[0].box.halfExtent = halfExtent;
+
+		std::vector<std::pair<uint32_t, std::vector<Piece>>> buckets;
+		std::unordered_map<uint32_t, uint32_t> bucketIndices;
+		for (auto& entityPieces : pieces)
+		{
+			for (auto& piece : entityPieces)
+			{
+				uint32_t node = builder.FindOrCreateCell(piece.key);
+				if (!piece.deferred)
+				{
+					builder.objects.push_back({ std::move(piece.data), node, piece.entity });
+					continue;
+				}
+
+				auto it = bucketIndices.find(node);
+				if (it == bucketIndices.end())
+				{
+					it = bucketIndices.emplace(node, buckets.size()).first;
+					buckets.emplace_back(node, std::vector<Piece>());
+				}
+				buckets[it->second].second.emplace_back(std::move(piece));
+			}
+		}
+		pieces.clear();
+		m_stats.AddPhase("Merge", start);
+
+		// Build each bucket's subtree into its own pools
+		start = std::chrono::steady_clock::now();
+		std::vector<Builder> subtrees(buckets.size());
+		JobSystem::ParallelFor(buckets.size(), 1,
+			[this, &builder, &buckets, &subtrees](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; ++i)
+			{
+				Builder& subtree = subtrees[i];
+				subtree.nodes.emplace_back();
+				subtree.nodes[0].box = builder.nodes[buckets[i].first].box;
 
+				const Primitives::BoxUniform box = subtree.nodes[0].box;
+				for (auto& piece : buckets[i].second)
+					InsertObject(subtree, 0, piece.data, piece.entity, box.position, box.halfExtent, m_budget);
+			}
+		});
+
+		for (uint32_t i = 0; i < buckets.size(); ++i)
+			builder.Graft(std::move(subtrees[i]), buckets[i].first);
+		m_stats.AddPhase("Build Subtrees", start);
+
+		start = std::chrono::steady_clock::now();
+		Flatten(builder);
+		m_stats.AddPhase("Flatten", start);
+		GatherStats();
+		m_stats.overBudget = m_budget.IsExceeded();
+	}
 
-		view.each([this, stopDepth, position, halfExtent](const entt::entity entity, 
-						 const TransformComponent& transform,
-						 DeferredRenderComponent& render)
+	// Write the tree in the layout it is used in, keyed by the hash of the scene
+	// and parameters it was built from. Returns false if the file can't be written
+	bool Save(const std::string& path) const
+	{
+		if (m_nodes.empty()) return false;
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) return false;
+
+		FileHeader header = {};
+		header.magic = FileMagic;
+		header.version = FileVersion;
+		header.hash = m_hash;
+		header.bounds = m_bounds;
+		header.cell = m_cell;
+
+		uint64_t offset = sizeof(FileHeader);
+		auto Place = [&offset](FileSection& section, size_t count, size_t stride)
+		{
+			offset = (offset + FileAlignment - 1) & ~uint64_t(FileAlignment - 1);
+			section.offset = offset;
+			section.count = count;
+			section.stride = stride;
+			offset += count * stride;
+		};
+		Place(header.sections[NodeSection], m_nodes.size(), sizeof(Node));
+		Place(header.sections[ChildBoundsSection], m_childBounds.size(), sizeof(ChildBounds));
+		Place(header.sections[ObjectSection], m_objects.size(), sizeof(Object));
+		Place(header.sections[VertexSection], m_vertices.size(), sizeof(PosVertex));
+		Place(header.sections[IndexSection], m_indices.size(), sizeof(uint32_t));
+		Place(header.sections[PacketSection], m_packets.size(), sizeof(TrianglePacket));
+		Place(header.sections[TriangleSection], m_triangles.size(), sizeof(uint32_t));
+		header.size = offset;
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		auto Write = [&file](const FileSection& section, const void* data)
 		{
-			auto& mesh = render.mesh;
-			// Convert from standard vertex mesh to position only mesh
-			auto vertices = mesh.GetVertexBufferDataCopy<glm::vec3>(0);
-			auto indices = mesh.GetIndexBufferDataCopy();
-			int vertexCount = vertices.size();
-			int indexCount = indices.size();
+			static const char padding[FileAlignment] = {};
+			file.write(padding, section.offset - static_cast<uint64_t>(file.tellp()));
+			file.write(static_cast<const char*>(data), section.count * section.stride);
+		};
+		Write(header.sections[NodeSection], m_nodes.data());
+		Write(header.sections[ChildBoundsSection], m_childBounds.data());
+		Write(header.sections[ObjectSection], m_objects.data());
+		Write(header.sections[VertexSection], m_vertices.data());
+		Write(header.sections[IndexSection], m_indices.data());
+		Write(header.sections[PacketSection], m_packets.data());
+		Write(header.sections[TriangleSection], m_triangles.data());
+
+		return file.good();
+	}
 
-			Mesh<PosVertex>::Data data;
-			// Copy data over
-			data.vertices.resize(vertexCount);
-			std::memcpy(data.vertices.data(), vertices.data(), sizeof(glm::vec3) * vertexCount);
-			data.indices.resize(indexCount);
-			std::memcpy(data.indices.data(), indices.data(), sizeof(uint32_t) * indexCount);
+	// Map a tree written by Save and use it in place. Returns false if the file is
+	// missing, malformed or was built from a different scene or parameters
+	bool Load(const std::string& path, glm::vec3 position, float halfExtent, int stopDepth, Device& owner)
+	{
+		auto start = std::chrono::steady_clock::now();
+		utils::MappedFile mapped(path);
+		if (!mapped.IsOpen() || mapped.Size() < sizeof(FileHeader)) return false;
+
+		const FileHeader& header = *reinterpret_cast<const FileHeader*>(mapped.Data());
+		if (header.magic != FileMagic || header.version != FileVersion ||
+			header.size != mapped.Size() ||
+			header.hash != HashScene(position, halfExtent, stopDepth))
+			return false;
 
-			const glm::mat4 model = transform.model;
+		const size_t strides[SectionCount] = {
+			sizeof(Node), sizeof(ChildBounds), sizeof(Object), sizeof(PosVertex),
+			sizeof(uint32_t), sizeof(TrianglePacket), sizeof(uint32_t)
+		};
+		for (uint32_t i = 0; i < SectionCount; ++i)
+		{
+			const FileSection& section = header.sections[i];
+			if (section.stride != strides[i] || section.offset % FileAlignment != 0 ||
+				section.offset + section.count * section.stride > mapped.Size())
+				return false;
+		}
+		if (header.sections[NodeSection].count == 0) return false;
 
-			// Turn into world space
-			for (auto& vertex : data.vertices)
-				vertex.pos = static_cast<glm::vec3>(model * glm::vec4(vertex.pos,1.0f));
+		if (IsInitialized())
+			Destroy();
 
-			InsertObject(*head, data, position, halfExtent);
-		});
+		m_owner = &owner;
+		m_hash = header.hash;
+		m_bounds = header.bounds;
+		m_cell = header.cell;
+
+		uint8_t* data = mapped.Data();
+		auto View = [data, &header](auto& pool, uint32_t section)
+		{
+			using T = std::remove_reference_t<decltype(pool[0])>;
+			pool.View(reinterpret_cast<T*>(data + header.sections[section].offset),
+					  header.sections[section].count);
+		};
+		View(m_nodes, NodeSection);
+		View(m_childBounds, ChildBoundsSection);
+		View(m_objects, ObjectSection);
+		View(m_vertices, VertexSection);
+		View(m_indices, IndexSection);
+		View(m_packets, PacketSection);
+		View(m_triangles, TriangleSection);
+		m_file = std::move(mapped);
+
+		m_debugDirty = true;
+		m_freeSlots = m_objects.size();
+		for (const Node& node : m_nodes)
+			m_freeSlots -= node.objectCount;
+		RebuildEntities();
+
+		m_stats.AddPhase("Load", start);
+		GatherStats();
+		return true;
 	}
 
-	void RenderCells(vk::CommandBuffer commandBuffer, 
+#ifndef BK_HEADLESS
+	void RenderCells(vk::CommandBuffer commandBuffer,
 				vk::PipelineLayout pipelineLayout)
 	{
-		if (head == nullptr) return;
-		SimpleMesh<PosVertex>::CubeList.Bind(commandBuffer);
-		RenderCellsRecursively(commandBuffer, pipelineLayout, head);
+		if (m_nodes.empty()) return;
+		SimpleMesh<PosVertex>::CubeList->Bind(commandBuffer);
+
+		// Empty cells are dropped when flattening, so every node is drawn
+		for (const Node& node : m_nodes)
+		{
+			glm::mat4 model = glm::translate(utils::identity, node.box.position);
+			model = glm::scale(model, glm::vec3(node.box.halfExtent * 2.0f));
+
+			commandBuffer.pushConstants(
+				pipelineLayout,
+				vk::ShaderStageFlagBits::eVertex,
+				0, sizeof(glm::mat4), &model
+			);
+			SimpleMesh<PosVertex>::CubeList->Draw(commandBuffer);
+		}
 	}
 
 	void RenderObjects(vk::CommandBuffer commandBuffer,
 				vk::PipelineLayout pipelineLayout)
 	{
-		if (head == nullptr) return;
+		if (m_nodes.empty()) return;
 		srand(1305871305);
-		utils::PushIdentityModel(commandBuffer, pipelineLayout);
-		RenderObjectsRecursively(commandBuffer, pipelineLayout, head, 0);
+		UpdateDebugMesh();
+
+		static glm::vec3 blue = { 0.0f, 1.0f, 0.0f };
+		static glm::vec3 red = { 1.0f, 0.0f, 0.0f };
+
+		for (const Node& node : m_nodes)
+		{
+			for (uint32_t i = 0; i < node.objectCount; ++i)
+			{
+				Object& obj = m_objects[node.firstObject + i];
+
+				// Every object is a range of the shared geometry
+				utils::PushIdentityModel(commandBuffer, pipelineLayout);
+				m_debugMesh.Bind(commandBuffer);
+
+				commandBuffer.pushConstants(
+					pipelineLayout,
+					vk::ShaderStageFlagBits::eFragment,
+					sizeof(glm::mat4), sizeof(utils::UBOColor), &node.color
+				);
+				m_debugMesh.Draw(commandBuffer, obj.indexCount, obj.firstIndex, obj.firstVertex);
+
+				SimpleMesh<PosVertex>::Cube->Bind(commandBuffer);
+				Primitives::Box& objBox = obj.bb;
+				glm::mat4 boxModel = glm::scale(glm::translate(utils::identity, objBox.position), objBox.halfExtent*2.0f);
+				commandBuffer.pushConstants(
+					pipelineLayout,
+					vk::ShaderStageFlagBits::eVertex,
+					0, sizeof(glm::mat4), &boxModel
+				);
+
+				commandBuffer.pushConstants(
+					pipelineLayout,
+					vk::ShaderStageFlagBits::eFragment,
+					sizeof(glm::mat4), sizeof(utils::UBOColor), (obj.colliding) ? &red : &blue
+				);
+
+				obj.colliding = 0;
+				SimpleMesh<PosVertex>::Cube->Draw(commandBuffer);
+			}
+		}
 	}
+#endif
 
 
 	void Destroy()
 	{
-		m_owner->waitIdle();
-		DestroyRecursively(head);
-		head = nullptr;
+		ReleaseStorage();
+		m_stats.ResetBuild();
+	}
+
+	// Remove and reinsert the given entities, typically the ones whose transform was
+	// updated this frame. Entities that are not in the tree yet are inserted if they
+	// can be rendered, the rest of the tree is left intact
+	void Update(const std::vector<entt::entity>& moved)
+	{
+		if (m_nodes.empty()) return;
+
+		auto& registry = ECS::Get();
+		for (entt::entity entity : moved)
+		{
+			Remove(entity);
+
+			if (!registry.valid(entity)) continue;
+			const auto* transform = registry.try_get<TransformComponent>(entity);
+			const auto* render = registry.try_get<DeferredRenderComponent>(entity);
+			if (transform == nullptr || render == nullptr) continue;
+
+			Fragment data = Bake(render->mesh, transform->model);
+			Reinsert(0, data, entity, m_cell.position, m_cell.halfExtent);
+		}
+
+		// Relocated ranges leave holes behind, repack once they outnumber the objects
+		if (m_freeSlots > m_objects.size() / 2)
+			Compact();
+	}
+
+	// Remove every object of an entity from the nodes it occupies
+	void Remove(entt::entity entity)
+	{
+		auto it = m_entities.find(entity);
+		if (it == m_entities.end()) return;
+
+		for (uint32_t nodeIndex : it->second)
+		{
+			Node& node = m_nodes[nodeIndex];
+			for (uint32_t i = 0; i < node.objectCount;)
+			{
+				const uint32_t slot = node.firstObject + i;
+				if (m_objects[slot].entity != entity)
+				{
+					++i;
+					continue;
+				}
+
+				// Swap with the last object of the range, bounds are left as they
+				// are since they only need to stay conservative. The geometry stays
+				// in the pools until they are compacted
+				const uint32_t last = node.firstObject + --node.objectCount;
+				m_objects[slot] = m_objects[last];
+				++m_freeSlots;
+				m_debugDirty = true;
+			}
+		}
+		m_entities.erase(it);
 	}
 
 	bool IsInitialized()
 	{
-		return head != nullptr;
+		return !m_nodes.empty();
 	}
 
 	inline static uint32_t MinimumTriangles = 500;
+	// Levels split up front before the remaining subtrees are built as jobs
+	inline static uint32_t ParallelDepth = 2;
+	// Loose mode never clips, each triangle goes to the smallest cell that holds it
+	// whole once the cell's bounds are scaled by Looseness
+	inline static bool Loose = false;
+	inline static float Looseness = 2.0f;
+	// Builds stop splitting once clipping stored this many times the source triangles
+	inline static float MaxTriangleGrowth = FLT_MAX;
+
+	// Every (collider, object) pair whose boxes overlap. Each node is visited once for
+	// the whole batch, with only the colliders that still overlap it. Only reads the
+	// tree, so queries can run from several threads at once
+	void CollisionQuery(const std::vector<Primitives::Box>& colliders,
+						std::vector<CollisionPair>& pairs) const
+	{
+		pairs.clear();
+		if (m_nodes.empty() || colliders.empty()) return;
+
+		// One set per depth, reused by every node at that depth
+		std::vector<ColliderSet> levels(2);
+		ColliderSet& all = levels[1];
+		all.Resize(colliders.size());
+		for (uint32_t i = 0; i < colliders.size(); ++i)
+		{
+			const glm::vec3 min = colliders[i].position - colliders[i].halfExtent;
+			const glm::vec3 max = colliders[i].position + colliders[i].halfExtent;
+			all.minX[i] = min.x; all.minY[i] = min.y; all.minZ[i] = min.z;
+			all.maxX[i] = max.x; all.maxY[i] = max.y; all.maxZ[i] = max.z;
+			all.ids[i] = i;
+		}
+		all.count = colliders.size();
+
+		FilterColliders(all, m_bounds.position - m_bounds.halfExtent,
+						m_bounds.position + m_bounds.halfExtent, levels[0]);
+		SpatialStats::Counters counters;
+		if (levels[0].count != 0)
+			CollideNode(0, levels, 0, pairs, counters);
+		m_stats.collision.Add(counters);
+	}
 
-	bool CollisionTest(const Primitives::Box& collider, 
-					   glm::mat4& transform)
+	// Marks the objects overlapped by a single collider for debug rendering
+	bool CollisionTest(const Primitives::Box& collider)
 	{
-		if (!head) return false;
-		colliderTransform = &transform;
-		return DetectCollisionBroad(collider, head);
+		std::vector<CollisionPair> pairs;
+		CollisionQuery({ collider }, pairs);
+		for (const CollisionPair& pair : pairs)
+			m_objects[pair.object].colliding = 1;
+
+		return !pairs.empty();
 	}
 
-private:
+	// Gather the entities with geometry inside the frustum of a perspective
+	// view-projection, nearest cells first and each entity once. Subtrees fully
+	// inside the frustum are accepted and the ones outside are rejected as a whole
+	void FrustumQuery(const glm::mat4& viewProjection, std::vector<entt::entity>& visible)
+	{
+		visible.clear();
+		m_visibleSet.clear();
+		if (m_nodes.empty()) return;
+
+		const Primitives::Frustum frustum = Primitives::GenerateFrustum(viewProjection);
+		// The eye is the only point projected to x = y = w = 0
+		const glm::vec4 eye = glm::inverse(viewProjection) * glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+
+		bool outside;
+		uint32_t planeMask = Primitives::FrustumBox(frustum, 0x3Fu,
+													m_bounds.position - m_bounds.halfExtent,
+													m_bounds.position + m_bounds.halfExtent, outside);
+		SpatialStats::Counters counters;
+		if (!outside)
+			CullNode(frustum, glm::vec3(eye) / eye.w, 0, planeMask, visible, counters);
+		m_stats.frustum.Add(counters);
+	}
 
-	// GJK
-	bool DetectCollisionNarrow(const Primitives::Box& collider,
-							   const Node::Object& object)
+	// Nearest triangle hit within maxT, t is in units of the ray direction.
+	// Only reads the tree, so rays can be cast from several threads at once
+	std::optional<RayHit> RayCast(const Primitives::Ray& ray, float maxT) const
 	{
-		static const glm::vec3 origin = glm::vec3(0.0f);
+		if (m_nodes.empty()) return std::nullopt;
+
+		RayState state;
+		state.origin = ray.position;
+		state.direction = ray.direction;
+		state.invDirection = 1.0f / ray.direction;
+		state.t = maxT;
+
+		float entry;
+		if (RaySlab(state, m_bounds.position - m_bounds.halfExtent,
+					m_bounds.position + m_bounds.halfExtent, entry))
+			RayCastNode(state, 0);
+
+		m_stats.ray.Add(state.counters);
+		if (state.object == nullptr) return std::nullopt;
+
+		const TrianglePacket& packet = m_packets[state.packet];
+		const uint32_t lane = state.lane;
+		glm::vec3 e1 = { packet.e1x[lane], packet.e1y[lane], packet.e1z[lane] };
+		glm::vec3 e2 = { packet.e2x[lane], packet.e2y[lane], packet.e2z[lane] };
+
+		RayHit hit;
+		hit.entity = state.object->entity;
+		hit.triangle = m_triangles[state.packet * 8 + lane];
+		hit.t = state.t;
+		hit.normal = glm::normalize(glm::cross(e1, e2));
+		return hit;
+	}
 
-		const Primitives::Box& objBox = object.bb;
-		auto MinkowskiSupport =
-			[this](const Primitives::Box& collider,
-			   const Primitives::Box& objBox,
-			   const glm::vec3& d) -> glm::vec3
+	// Cast a batch of rays across the job system, must be called from the main thread
+	void RayCast(const std::vector<Primitives::Ray>& rays,
+				 float maxT,
+				 std::vector<std::optional<RayHit>>& hits) const
+	{
+		hits.resize(rays.size());
+		JobSystem::ParallelFor(rays.size(), 64,
+			[this, &rays, &hits, maxT](uint32_t begin, uint32_t end)
 		{
-			auto furthestColliderPoint = BoxFurthestPosition(collider, d);
-			auto furthestObjectPoint = BoxFurthestPosition(objBox, -d);
+			for (uint32_t i = begin; i < end; ++i)
+				hits[i] = RayCast(rays[i], maxT);
+		});
+	}
 
-			return furthestColliderPoint - furthestObjectPoint;
-		};
+	const Pool<Node>& GetNodes() const { return m_nodes; }
+	const SpatialStats& GetStats() const { return m_stats; }
+	const Pool<Object>& GetObjects() const { return m_objects; }
+
+private:
 
-		auto SameDirection = [](
-			const glm::vec3& d,
-			const glm::vec3& AO
-			)
+	// Free the tree but keep the build statistics, Flatten runs at the end
+	// of a build whose earlier phases are already timed
+	void ReleaseStorage()
+	{
+		m_owner->waitIdle();
+		// Every node, bound and object lives in one of these arrays
+		m_nodes.clear();
+		m_childBounds.clear();
+		m_objects.clear();
+		m_vertices.clear();
+		m_indices.clear();
+		m_packets.clear();
+		m_triangles.clear();
+		m_debugMesh = Mesh<PosVertex>();
+		m_debugDirty = false;
+		m_entities.clear();
+		m_retired.clear();
+		m_freeSlots = 0;
+		m_file.Close();
+	}
+
+	enum FileSectionType : uint32_t
+	{
+		NodeSection,
+		ChildBoundsSection,
+		ObjectSection,
+		VertexSection,
+		IndexSection,
+		PacketSection,
+		TriangleSection,
+		SectionCount
+	};
+
+	// "BKOT", bump the version whenever the layout of anything written changes
+	static constexpr uint32_t FileMagic = 0x544F4B42u;
+	static constexpr uint32_t FileVersion = 1;
+	static constexpr uint32_t FileAlignment = 64;
+
+	// Offsets are from the start of the file, so it can be mapped at any address
+	struct FileSection
+	{
+		uint64_t offset;
+		uint64_t count;
+		uint64_t stride;
+	};
+
+	struct FileHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t hash;
+		uint64_t size;
+		Primitives::Box bounds;
+		Primitives::BoxUniform cell;
+		FileSection sections[SectionCount];
+	};
+
+	// FNV-1a over 8 byte words, folded so that high bits also reach the low ones
+	static uint64_t HashBytes(uint64_t hash, const void* data, size_t size)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		for (; size >= 8; size -= 8, bytes += 8)
 		{
-			return glm::dot(d, AO) > 0.0f;
-		};
+			uint64_t word;
+			std::memcpy(&word, bytes, 8);
+			hash = (hash ^ word) * 1099511628211ull;
+			hash ^= hash >> 32;
+		}
+		for (; size > 0; --size, ++bytes)
+			hash = (hash ^ *bytes) * 1099511628211ull;
+		return hash;
+	}
 
-		auto HandleLine = [SameDirection](std::vector<glm::vec3>& line, glm::vec3 & d) 
+	// Hash of everything a tree is built from, the build parameters
+	// and the entities' transforms and geometry
+	static uint64_t HashScene(const glm::vec3& position, float halfExtent, int stopDepth)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		hash = HashBytes(hash, &MinimumTriangles, sizeof(MinimumTriangles));
+		hash = HashBytes(hash, &Loose, sizeof(Loose));
+		hash = HashBytes(hash, &Looseness, sizeof(Looseness));
+		hash = HashBytes(hash, &MaxTriangleGrowth, sizeof(MaxTriangleGrowth));
+		hash = HashBytes(hash, &position, sizeof(position));
+		hash = HashBytes(hash, &halfExtent, sizeof(halfExtent));
+		hash = HashBytes(hash, &stopDepth, sizeof(stopDepth));
+
+		auto view = ECS::Get().view<TransformComponent,
+			DeferredRenderComponent>();
+		view.each([&hash](const entt::entity entity,
+						  const TransformComponent& transform,
+						  const DeferredRenderComponent& render)
 		{
-			auto& a = line[1];
-			auto& b = line[0];
-			
-			glm::vec3 ab = b - a;
-			glm::vec3 ao = origin - a;
+			auto data = render.mesh.GetDataView();
+			hash = HashBytes(hash, &entity, sizeof(entity));
+			hash = HashBytes(hash, &transform.model, sizeof(transform.model));
+			for (uint32_t i = 0; i < data.vertexCount; ++i)
+				hash = HashBytes(hash, &data.vertices[i].pos, sizeof(glm::vec3));
+			hash = HashBytes(hash, data.indices, data.indexCount * sizeof(uint32_t));
+		});
+		return hash;
+	}
 
-			if (SameDirection(ab, ao))
-			{
-				// Keep both vertices in simplex
-				d = glm::cross(glm::cross(ab, ao), ab);
-			}
-			else
-			{
-				// Remove B and keep new vertex
-				line.erase(line.begin());
-				d = ao;
-			}
+	// Geometry being split through the tree, along with the triangle
+	// of the entity's mesh that each of its triangles came from
+	struct Fragment : Mesh<PosVertex>::Data
+	{
+		std::vector<uint32_t> triangles;
+	};
 
-			return false;
-		};
+	// Cell used during construction, nodes and objects reference each other by
+	// index into the builder's pools so that nothing is allocated on its own
+	struct BuildNode
+	{
+		Primitives::BoxUniform box;
+		int32_t children[8] = { -1, -1, -1, -1, -1, -1, -1, -1 };
+	};
+
+	struct BuildObject
+	{
+		Fragment data;
+		uint32_t node;
+		entt::entity entity;
+	};
+
+	// Each job builds into its own builder, they are grafted together afterwards
+	struct Builder
+	{
+		std::vector<BuildNode> nodes;
+		std::vector<BuildObject> objects;
 
-		auto HandleTriangle = [&](std::vector<glm::vec3>& tri, glm::vec3& d) 
+		uint32_t GetOrCreateChild(uint32_t nodeIndex, uint32_t octant)
 		{
-			auto& a = tri[2];
-			auto& b = tri[1];
-			auto& c = tri[0];
+			int32_t child = nodes[nodeIndex].children[octant];
+			if (child != -1)
+				return child;
+
+			const Primitives::BoxUniform box = nodes[nodeIndex].box;
+			float step = box.halfExtent * 0.5f;
+			glm::vec3 offset;
+			offset.x = ((octant & 1) ? step : -step);
+			offset.y = ((octant & 2) ? step : -step);
+			offset.z = ((octant & 4) ? step : -step);
+
+			child = static_cast<int32_t>(nodes.size());
+			nodes[nodeIndex].children[octant] = child;
+			nodes.emplace_back();
+			nodes[child].box.halfExtent = step;
+			nodes[child].box.position = box.position + offset;
+			return child;
+		}
 
-			auto ab = b - a;
-			auto ac = c - a;
-			auto ao = origin - a;
+		// Location codes start with a sentinel bit for the root
+		// followed by three bits for each octant on the path
+		uint32_t FindOrCreateCell(uint32_t key)
+		{
+			if (key == 1u)
+				return 0;
+			return GetOrCreateChild(FindOrCreateCell(key >> 3), key & 7u);
+		}
 
-			auto abc = glm::cross(ab, ac);
+		// Append a subtree whose root is the given node, which must still be a leaf
+		void Graft(Builder&& subtree, uint32_t nodeIndex)
+		{
+			const int32_t base = static_cast<int32_t>(nodes.size()) - 1;
+			auto Remap = [base, nodeIndex](int32_t index) -> int32_t
+			{
+				if (index == -1) return -1;
+				return (index == 0) ? static_cast<int32_t>(nodeIndex) : base + index;
+			};
 
-			// Positive side of line AC
-			if (SameDirection(glm::cross(abc, ac), ao))
+			for (uint32_t octant = 0; octant < 8; ++octant)
 			{
-				if (SameDirection(ac, ao))
-				{
-					// Remove B
-					tri.erase(tri.begin() + 1);
-					d = glm::cross(glm::cross(ac, ao), ac);
-				}
-				// Also on positive side of line AB
-				else
-				{
-					// Remove C
-					tri.erase(tri.begin());
-					// Calculate line with points b and a
-					return HandleLine(tri, d);
-				}
+				ASSERT(nodes[nodeIndex].children[octant] == -1, "Grafting onto a node that has children");
+				nodes[nodeIndex].children[octant] = Remap(subtree.nodes[0].children[octant]);
 			}
-			// Negative side of AC
-			else
+
+			for (uint32_t i = 1; i < subtree.nodes.size(); ++i)
 			{
-				if (SameDirection(glm::cross(ab, abc), ao))
-				{
-					// Remove C
-					tri.erase(tri.begin());
-					// Calculate line with points a and b
-					return HandleLine(tri, d);
-				}
-				else
-				{
-					if (SameDirection(abc, ao))
-					{
-						// Keep all vertices in simplex
-						d = abc;
-					}
-					else
-					{
-						// Swap B and C
-						std::swap(*tri.begin(), *(tri.begin() + 1));
-						d = -abc;
-					}
-				}
+				BuildNode& node = nodes.emplace_back(subtree.nodes[i]);
+				for (int32_t& child : node.children)
+					child = Remap(child);
 			}
 
-			return false;
-		};
+			for (auto& obj : subtree.objects)
+				objects.push_back({ std::move(obj.data), static_cast<uint32_t>(Remap(obj.node)), obj.entity });
+		}
+	};
 
-		auto HandleTetrahedron = [&](std::vector<glm::vec3>& tet, glm::vec3& D) -> bool
-		{
-			auto& a = tet[3];
-			auto& b = tet[2];
-			auto& c = tet[1];
-			auto& d = tet[0];
-			
-			auto ab = b - a;
-			auto ac = c - a;
-			auto ad = d - a;
-			auto ao = origin - a;
-			
-			auto abc = glm::cross(ab, ac);
-			auto acd = glm::cross(ac, ad);
-			auto adb = glm::cross(ad, ab);
-
-			if (SameDirection(abc, ao))
-			{
-				// Remove D
-				tet.erase(tet.begin());
-				return HandleTriangle(tet, D);
-			}
-				
-			if (SameDirection(acd, ao))
+	// Geometry that has been split through the top levels of the tree. Deferred pieces
+	// reached ParallelDepth and still have to be inserted below their cell
+	struct Piece
+	{
+		uint32_t key;
+		Fragment data;
+		entt::entity entity;
+		bool deferred;
+	};
+
+	struct SplitData
+	{
+		Fragment data = {};
+		int mask = 0;
+	};
+
+	// Number of children stored before the given octant
+	static uint32_t ChildOffset(uint32_t childMask, uint32_t octant)
+	{
+		uint32_t v = childMask & ((1u << octant) - 1u);
+		v = v - ((v >> 1) & 0x55u);
+		v = (v & 0x33u) + ((v >> 2) & 0x33u);
+		return (v + (v >> 4)) & 0x0Fu;
+	}
+
+	uint32_t ChildIndex(const Node& node, uint32_t octant) const
+	{
+		return node.firstChild + ChildOffset(node.childMask, octant);
+	}
+
+	// Classify all 8 children against the planes in the mask at once. Children
+	// outside any plane are set in the returned mask, the others get the mask of
+	// planes they straddle
+	static uint32_t ClassifyChildren(const Primitives::Frustum& frustum,
+									 uint32_t planeMask,
+									 const ChildBounds& bounds,
+									 uint32_t childPlanes[8])
+	{
+		uint32_t outside = 0;
+		for (uint32_t p = 0; p < 6; ++p)
+		{
+			if ((planeMask & (1u << p)) == 0) continue;
+
+			const Primitives::Plane& plane = frustum.planes[p];
+			const glm::vec3 absNormal = glm::abs(plane.normal);
+			for (uint32_t i = 0; i < 8; ++i)
 			{
-				// Remove B 
-				tet.erase(tet.begin() + 2);
-				return HandleTriangle(tet, D);
+				float d = plane.normal.x * (bounds.minX[i] + bounds.maxX[i]) +
+					plane.normal.y * (bounds.minY[i] + bounds.maxY[i]) +
+					plane.normal.z * (bounds.minZ[i] + bounds.maxZ[i]);
+				float r = absNormal.x * (bounds.maxX[i] - bounds.minX[i]) +
+					absNormal.y * (bounds.maxY[i] - bounds.minY[i]) +
+					absNormal.z * (bounds.maxZ[i] - bounds.minZ[i]);
+				d = d * 0.5f - plane.D;
+				r *= 0.5f;
+
+				outside |= static_cast<uint32_t>(d + r < 0.0f) << i;
+				childPlanes[i] |= static_cast<uint32_t>(d - r < 0.0f) << p;
 			}
-			
-			if (SameDirection(adb, ao))
+		}
+		return outside;
+	}
+
+	void CullNode(const Primitives::Frustum& frustum,
+				  const glm::vec3& eye,
+				  uint32_t nodeIndex,
+				  uint32_t planeMask,
+				  std::vector<entt::entity>& visible,
+				  SpatialStats::Counters& counters)
+	{
+		const Node& node = m_nodes[nodeIndex];
+		++counters.visitedNodes;
+
+		// With no planes left the node is fully inside and nothing is tested
+		for (uint32_t i = 0; i < node.objectCount; ++i)
+		{
+			const Object& obj = m_objects[node.firstObject + i];
+			if (planeMask != 0)
 			{
-				// Remove C and swap D and B
-				tet.erase(tet.begin() + 1);
-				std::swap(*tet.begin(), *(tet.begin() + 1));
-				return HandleTriangle(tet, D);
+				++counters.narrowPhaseTests;
+				bool outside;
+				Primitives::FrustumBox(frustum, planeMask, obj.bb.position - obj.bb.halfExtent,
+									   obj.bb.position + obj.bb.halfExtent, outside);
+				if (outside) continue;
 			}
+			if (m_visibleSet.insert(obj.entity).second)
+				visible.push_back(obj.entity);
+		}
 
-			return true;
-		};
+		if (node.childMask == 0) return;
 
+		// Missing children have inverted bounds, mask them out instead of testing
+		uint32_t childPlanes[8] = {};
+		uint32_t outside = ~node.childMask & 0xFFu;
+		if (planeMask != 0)
+			outside |= ClassifyChildren(frustum, planeMask, m_childBounds[node.childBounds], childPlanes);
 
-		glm::vec3 d = { 1.0f, 0.0f, 0.0f };
-		std::vector<glm::vec3> simplex;
-		// First point is the Minkowski difference vertex
-		simplex.push_back(MinkowskiSupport(collider, objBox, d));
+		// Visiting the octants in this order from the one holding the eye is front-to-back
+		uint32_t nearest = (eye.x > node.box.position.x ? 1u : 0u) |
+			(eye.y > node.box.position.y ? 2u : 0u) |
+			(eye.z > node.box.position.z ? 4u : 0u);
+		for (uint32_t i = 0; i < 8; ++i)
+		{
+			uint32_t octant = i ^ nearest;
+			if (outside & (1u << octant)) continue;
+
+			CullNode(frustum, eye, ChildIndex(node, octant), childPlanes[octant], visible, counters);
+		}
+	}
+
+	struct RayState
+	{
+		glm::vec3 origin;
+		glm::vec3 direction;
+		glm::vec3 invDirection;
+		// Distance to the nearest hit so far
+		float t;
+		const Object* object = nullptr;
+		// Index in the packet pool
+		uint32_t packet = 0;
+		uint32_t lane = 0;
+		SpatialStats::Counters counters;
+	};
 
-		d = origin - simplex[0];
-		while (true)
+	// Append an object's geometry to the pools and build its ray cast packets
+	void AppendGeometry(const Fragment& data, Object& obj)
+	{
+		const uint32_t triangleCount = data.indices.size() / 3;
+		obj.bb = Mesh<PosVertex>::GetBoundingBox(data.vertices.data(), data.vertices.size());
+
+		obj.firstVertex = m_vertices.size();
+		obj.vertexCount = data.vertices.size();
+		m_vertices.append(data.vertices.begin(), data.vertices.end());
+		obj.firstIndex = m_indices.size();
+		obj.indexCount = data.indices.size();
+		m_indices.append(data.indices.begin(), data.indices.end());
+
+		// Unused lanes are left degenerate
+		obj.firstPacket = m_packets.size();
+		obj.packetCount = (triangleCount + 7) / 8;
+		m_packets.resize(obj.firstPacket + obj.packetCount);
+		std::memset(&m_packets[obj.firstPacket], 0, obj.packetCount * sizeof(TrianglePacket));
+		m_triangles.append(data.triangles.begin(), data.triangles.end());
+		m_triangles.resize(static_cast<size_t>(obj.firstPacket + obj.packetCount) * 8);
+
+		for (uint32_t i = 0; i < triangleCount; ++i)
 		{
-			auto A = MinkowskiSupport(collider, objBox, d);
-			// If support doesn't pass origin
-			if (glm::dot(A, d) <= 0.0f)
-				return false;
-			simplex.push_back(A);
-			auto len = simplex.size();
-			switch (len)
+			const glm::vec3& v0 = data.vertices[data.indices[i * 3 + 0]].pos;
+			const glm::vec3 e1 = data.vertices[data.indices[i * 3 + 1]].pos - v0;
+			const glm::vec3 e2 = data.vertices[data.indices[i * 3 + 2]].pos - v0;
+
+			TrianglePacket& packet = m_packets[obj.firstPacket + i / 8];
+			const uint32_t lane = i % 8;
+			packet.v0x[lane] = v0.x; packet.v0y[lane] = v0.y; packet.v0z[lane] = v0.z;
+			packet.e1x[lane] = e1.x; packet.e1y[lane] = e1.y; packet.e1z[lane] = e1.z;
+			packet.e2x[lane] = e2.x; packet.e2y[lane] = e2.y; packet.e2z[lane] = e2.z;
+		}
+	}
+
+	// Moller-Trumbore against 8 triangles at once, written branch-free so the
+	// lanes vectorize. Returns the lane of the nearest hit closer than t, or -1
+	static int IntersectPacket(const TrianglePacket& p,
+							   const glm::vec3& o,
+							   const glm::vec3& d,
+							   float& t)
+	{
+		float hitT[8];
+		for (uint32_t i = 0; i < 8; ++i)
+		{
+			float px = d.y * p.e2z[i] - d.z * p.e2y[i];
+			float py = d.z * p.e2x[i] - d.x * p.e2z[i];
+			float pz = d.x * p.e2y[i] - d.y * p.e2x[i];
+			float det = p.e1x[i] * px + p.e1y[i] * py + p.e1z[i] * pz;
+			float invDet = 1.0f / det;
+
+			float sx = o.x - p.v0x[i];
+			float sy = o.y - p.v0y[i];
+			float sz = o.z - p.v0z[i];
+			float u = (sx * px + sy * py + sz * pz) * invDet;
+
+			float qx = sy * p.e1z[i] - sz * p.e1y[i];
+			float qy = sz * p.e1x[i] - sx * p.e1z[i];
+			float qz = sx * p.e1y[i] - sy * p.e1x[i];
+			float v = (d.x * qx + d.y * qy + d.z * qz) * invDet;
+			float hit = (p.e2x[i] * qx + p.e2y[i] * qy + p.e2z[i] * qz) * invDet;
+
+			bool valid = (std::abs(det) > 1e-12f) & (u >= 0.0f) & (v >= 0.0f) &
+				(u + v <= 1.0f) & (hit >= 0.0f);
+			hitT[i] = valid ? hit : FLT_MAX;
+		}
+
+		int lane = -1;
+		for (uint32_t i = 0; i < 8; ++i)
+		{
+			if (hitT[i] < t)
 			{
-			case 2:
-				HandleLine(simplex, d);
-				break;
-			case 3:
-				HandleTriangle(simplex, d);
-				break;
-			case 4:
-				if (HandleTetrahedron(simplex, d))
-					return true;
-				break;
-			default:
-				ASSERT(false, "Invalid number of simplex vertices in GJK");
+				t = hitT[i];
+				lane = i;
 			}
 		}
+		return lane;
 	}
 
+	// Slab test against [min, max], entry is where the ray enters the box
+	static bool RaySlab(const RayState& ray,
+						const glm::vec3& min,
+						const glm::vec3& max,
+						float& entry)
+	{
+		glm::vec3 t0 = (min - ray.origin) * ray.invDirection;
+		glm::vec3 t1 = (max - ray.origin) * ray.invDirection;
+		glm::vec3 tNear = glm::min(t0, t1);
+		glm::vec3 tFar = glm::max(t0, t1);
+
+		entry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+		float exit = std::min(std::min(tFar.x, tFar.y), tFar.z);
+		return entry <= exit && entry <= ray.t;
+	}
 
-	bool DetectCollisionMid(const Primitives::Box& collider,
-							Node* node)
+	// Slab test against all 8 children at once, returns the mask of children hit before t
+	static uint32_t RayChildren(const ChildBounds& bounds, const RayState& ray, float entry[8])
 	{
-		// Test intersection with grid
-		if (!Primitives::BoxBox(collider, node->box))
-			return false;
+		uint32_t mask = 0;
+		for (uint32_t i = 0; i < 8; ++i)
+		{
+			float tx0 = (bounds.minX[i] - ray.origin.x) * ray.invDirection.x;
+			float tx1 = (bounds.maxX[i] - ray.origin.x) * ray.invDirection.x;
+			float ty0 = (bounds.minY[i] - ray.origin.y) * ray.invDirection.y;
+			float ty1 = (bounds.maxY[i] - ray.origin.y) * ray.invDirection.y;
+			float tz0 = (bounds.minZ[i] - ray.origin.z) * ray.invDirection.z;
+			float tz1 = (bounds.maxZ[i] - ray.origin.z) * ray.invDirection.z;
+
+			float tNear = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)),
+								   std::max(std::min(tz0, tz1), 0.0f));
+			float tFar = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)),
+								  std::max(tz0, tz1));
+			entry[i] = tNear;
+			mask |= static_cast<uint32_t>((tNear <= tFar) & (tNear <= ray.t)) << i;
+		}
+		return mask;
+	}
+
+	void RayCastNode(RayState& ray, uint32_t nodeIndex) const
+	{
+		const Node& node = m_nodes[nodeIndex];
+		++ray.counters.visitedNodes;
 
-		// Perform GJK if on a leaf
-		if (node->leaf)
+		for (uint32_t i = 0; i < node.objectCount; ++i)
 		{
-			int i = 0;
-			for (auto& obj : node->objects)
+			const Object& obj = m_objects[node.firstObject + i];
+			float entry;
+			if (!RaySlab(ray, obj.bb.position - obj.bb.halfExtent,
+						 obj.bb.position + obj.bb.halfExtent, entry))
+				continue;
+
+			ray.counters.narrowPhaseTests += obj.packetCount;
+			for (uint32_t p = obj.firstPacket; p < obj.firstPacket + obj.packetCount; ++p)
 			{
-				if (DetectCollisionNarrow(collider, obj))
+				int lane = IntersectPacket(m_packets[p], ray.origin, ray.direction, ray.t);
+				if (lane < 0) continue;
+
+				ray.object = &obj;
+				ray.packet = p;
+				ray.lane = lane;
+			}
+		}
+
+		if (node.childMask == 0) return;
+
+		float entry[8];
+		uint32_t hits = RayChildren(m_childBounds[node.childBounds], ray, entry) & node.childMask;
+
+		// Nearest child first, stop once the rest start past the closest hit
+		while (hits != 0)
+		{
+			uint32_t nearest = 0;
+			float nearestEntry = FLT_MAX;
+			for (uint32_t octant = 0; octant < 8; ++octant)
+			{
+				if ((hits & (1u << octant)) && entry[octant] <= nearestEntry)
 				{
-					obj.colliding = true;
-					return true;
+					nearest = octant;
+					nearestEntry = entry[octant];
 				}
-				++i;
 			}
+
+			hits &= ~(1u << nearest);
+			if (nearestEntry > ray.t) break;
+			RayCastNode(ray, ChildIndex(node, nearest));
+		}
+	}
+
+	// Colliders still overlapping a node, laid out per axis
+	struct ColliderSet
+	{
+		std::vector<float> minX, minY, minZ;
+		std::vector<float> maxX, maxY, maxZ;
+		std::vector<uint32_t> ids;
+		uint32_t count = 0;
+
+		void Resize(uint32_t size)
+		{
+			if (ids.size() >= size) return;
+			minX.resize(size); minY.resize(size); minZ.resize(size);
+			maxX.resize(size); maxY.resize(size); maxZ.resize(size);
+			ids.resize(size);
+		}
+	};
+
+	// Keep the colliders that overlap [min, max]. Every lane is written and the
+	// output only advances on overlap, so the loop has no branches
+	static void FilterColliders(const ColliderSet& in,
+								const glm::vec3& min,
+								const glm::vec3& max,
+								ColliderSet& out)
+	{
+		out.Resize(in.count);
+		uint32_t count = 0;
+		for (uint32_t i = 0; i < in.count; ++i)
+		{
+			bool overlap = (in.minX[i] <= max.x) & (in.maxX[i] >= min.x) &
+				(in.minY[i] <= max.y) & (in.maxY[i] >= min.y) &
+				(in.minZ[i] <= max.z) & (in.maxZ[i] >= min.z);
+
+			out.minX[count] = in.minX[i]; out.minY[count] = in.minY[i]; out.minZ[count] = in.minZ[i];
+			out.maxX[count] = in.maxX[i]; out.maxY[count] = in.maxY[i]; out.maxZ[count] = in.maxZ[i];
+			out.ids[count] = in.ids[i];
+			count += overlap;
 		}
+		out.count = count;
+	}
 
-		// Perform mid-phase collision testing on leaves
-		for (auto& child : node->children)
+	void CollideNode(uint32_t nodeIndex,
+					 std::vector<ColliderSet>& levels,
+					 uint32_t depth,
+					 std::vector<CollisionPair>& pairs,
+					 SpatialStats::Counters& counters) const
+	{
+		// Sets are indexed on every use, deeper calls may grow the vector
+		if (levels.size() < depth + 2)
+			levels.resize(depth + 2);
+
+		const Node& node = m_nodes[nodeIndex];
+		++counters.visitedNodes;
+		counters.narrowPhaseTests += static_cast<uint64_t>(node.objectCount) * levels[depth].count;
+		for (uint32_t i = 0; i < node.objectCount; ++i)
 		{
-			if (child == nullptr) continue;
+			const Object& obj = m_objects[node.firstObject + i];
+			ColliderSet& hits = levels[depth + 1];
+			FilterColliders(levels[depth], obj.bb.position - obj.bb.halfExtent,
+							obj.bb.position + obj.bb.halfExtent, hits);
 
-			if (DetectCollisionMid(collider, child))
-				return true;
+			for (uint32_t j = 0; j < hits.count; ++j)
+				pairs.push_back({ hits.ids[j], node.firstObject + i, obj.entity });
 		}
 
-		return false;
+		if (node.childMask == 0) return;
+
+		const ChildBounds& bounds = m_childBounds[node.childBounds];
+		for (uint32_t octant = 0; octant < 8; ++octant)
+		{
+			if ((node.childMask & (1u << octant)) == 0) continue;
+
+			glm::vec3 min = { bounds.minX[octant], bounds.minY[octant], bounds.minZ[octant] };
+			glm::vec3 max = { bounds.maxX[octant], bounds.maxY[octant], bounds.maxZ[octant] };
+			FilterColliders(levels[depth], min, max, levels[depth + 1]);
+			if (levels[depth + 1].count != 0)
+				CollideNode(ChildIndex(node, octant), levels, depth + 1, pairs, counters);
+		}
 	}
 
 
-	bool DetectCollisionBroad(const Primitives::Box& collider,
-							  Node* node)
+	static Fragment Bake(const Mesh<Vertex>& mesh, const glm::mat4& model)
 	{
-		// Don't intersect with grid, then early out
-		if (!Primitives::BoxBox(collider, node->box))
-			return false;
+		// Convert from standard vertex mesh to position only mesh
+		auto view = mesh.GetDataView();
 
-		// Otherwise perform mid-phase collision testing
-		if (DetectCollisionMid(collider, node))
-			return true;
+		Fragment data;
+		data.vertices.resize(view.vertexCount);
+		data.indices.assign(view.indices, view.indices + view.indexCount);
+		data.triangles.resize(view.indexCount / 3);
+		for (uint32_t i = 0; i < data.triangles.size(); ++i)
+			data.triangles[i] = i;
+
+		// Turn into world space
+		for (uint32_t i = 0; i < view.vertexCount; ++i)
+			data.vertices[i].pos = static_cast<glm::vec3>(model * glm::vec4(view.vertices[i].pos, 1.0f));
 
-		// No intersection after testing
-		return false;
+		return data;
 	}
 
-	bool RenderCellsRecursively(vk::CommandBuffer commandBuffer,
-						   vk::PipelineLayout pipelineLayout,
-						   Node* node)
+	// Split mask of triangles that stay in the cell being split
+	static constexpr int KeepInCell = 8;
+
+	// Copy the given triangles and the vertices they use
+	static void ExtractTriangles(const Fragment& data,
+								 const std::vector<uint32_t>& triangles,
+								 std::vector<uint32_t>& remap,
+								 Fragment& out)
 	{
-		bool childExists = false;
-		for (Octree::Node * child : node->children)
+		remap.assign(data.vertices.size(), UINT32_MAX);
+		out.indices.reserve(triangles.size() * 3);
+		out.triangles.reserve(triangles.size());
+		for (uint32_t triangle : triangles)
 		{
-			if (child != nullptr)
-				childExists |= RenderCellsRecursively(commandBuffer, pipelineLayout, child);
+			for (uint32_t i = 0; i < 3; ++i)
+			{
+				uint32_t index = data.indices[triangle * 3 + i];
+				if (remap[index] == UINT32_MAX)
+				{
+					remap[index] = out.vertices.size();
+					out.vertices.push_back(data.vertices[index]);
+				}
+				out.indices.push_back(remap[index]);
+			}
+			out.triangles.push_back(data.triangles[triangle]);
 		}
-		if (node->objects.empty() && childExists == false)
+	}
+
+	// Move every triangle to the child its center falls in if the child's loose bounds
+	// hold it whole, the rest are masked with KeepInCell. Returns false if nothing moves
+	static bool SplitLoose(const glm::vec3& cellPosition,
+						   float cellHalfExtent,
+						   const Fragment& data,
+						   std::vector<SplitData>& splits)
+	{
+		const uint32_t triangleCount = data.indices.size() / 3;
+		const float step = cellHalfExtent * 0.5f;
+		const float looseExtent = step * Looseness;
+
+		std::vector<uint32_t> buckets[KeepInCell + 1];
+		for (uint32_t i = 0; i < triangleCount; ++i)
 		{
-			return false;
+			const glm::vec3& a = data.vertices[data.indices[i * 3 + 0]].pos;
+			const glm::vec3& b = data.vertices[data.indices[i * 3 + 1]].pos;
+			const glm::vec3& c = data.vertices[data.indices[i * 3 + 2]].pos;
+			const glm::vec3 min = glm::min(a, glm::min(b, c));
+			const glm::vec3 max = glm::max(a, glm::max(b, c));
+			const glm::vec3 center = (min + max) * 0.5f;
+
+			int octant = (center.x > cellPosition.x ? 1 : 0) |
+				(center.y > cellPosition.y ? 2 : 0) |
+				(center.z > cellPosition.z ? 4 : 0);
+			glm::vec3 childPosition;
+			childPosition.x = cellPosition.x + ((octant & 1) ? step : -step);
+			childPosition.y = cellPosition.y + ((octant & 2) ? step : -step);
+			childPosition.z = cellPosition.z + ((octant & 4) ? step : -step);
+
+			bool fits = glm::all(glm::greaterThanEqual(min, childPosition - looseExtent)) &&
+				glm::all(glm::lessThanEqual(max, childPosition + looseExtent));
+			buckets[fits ? octant : KeepInCell].push_back(i);
 		}
 
-		glm::mat4 model = glm::translate(utils::identity, node->box.position);
-		model = glm::scale(model, glm::vec3(node->box.halfExtent * 2.0f));
+		if (buckets[KeepInCell].size() == triangleCount)
+			return false;
 
-		commandBuffer.pushConstants(
-			pipelineLayout,
-			vk::ShaderStageFlagBits::eVertex,
-			0, sizeof(glm::mat4), &model
-		);
-		SimpleMesh<PosVertex>::CubeList.Draw(commandBuffer);
+		std::vector<uint32_t> remap;
+		for (int mask = 0; mask <= KeepInCell; ++mask)
+		{
+			if (buckets[mask].empty()) continue;
+
+			SplitData& split = splits.emplace_back();
+			split.mask = mask;
+			ExtractTriangles(data, buckets[mask], remap, split.data);
+		}
 		return true;
 	}
 
-	void RenderObjectsRecursively(vk::CommandBuffer commandBuffer,
-						   vk::PipelineLayout pipelineLayout,
-						   Node* node, int index)
+	// Split the data by the three planes through the cell's center, each split is masked by
+	// the octant it falls in. Returns false if splitting would increase the triangle count
+	// too much, or add more than is left of the budget when one is given
+	static bool SplitIntoOctants(const glm::vec3& cellPosition,
+								 float cellHalfExtent,
+								 const Fragment& data,
+								 std::vector<SplitData>& splits,
+								 TriangleBudget* budget = nullptr)
 	{
-		if (node == nullptr) return;
+		if (Loose)
+			return SplitLoose(cellPosition, cellHalfExtent, data, splits);
+
+		const uint32_t triangleCount = data.indices.size() / 3;
 
-		for (int i = 0; i < 8; ++i)
+		Primitives::Plane planes[3] = {
+			{ { 1.0f, 0.0f, 0.0f } },
+			{ { 0.0f, 1.0f, 0.0f } },
+			{ { 0.0f, 0.0f, 1.0f } }
+		};
+		for (int i = 0; i < 3; ++i)
 		{
-			RenderObjectsRecursively(commandBuffer,
-									 pipelineLayout,
-									 node->children[i], index * 8 + i);
+			planes[i].position = cellPosition;
+			planes[i].D = glm::dot(cellPosition, planes[i].normal);
 		}
 
-		for (auto& obj : node->objects)
+		// Most data deep in the tree straddles none of the planes, classify against
+		// all three at once and only split if something has to be clipped
+		int straddles[3];
+		float minDistances[3];
+		Mesh<PosVertex>::IsStraddlingPlanes(data.vertices.data(), data.vertices.size(), planes, 3,
+											straddles, minDistances);
+		if (straddles[0] != 0 && straddles[1] != 0 && straddles[2] != 0)
 		{
-			utils::PushIdentityModel(commandBuffer, pipelineLayout);
-			obj.mesh.Bind(commandBuffer);
-			
-			commandBuffer.pushConstants(
-				pipelineLayout,
-				vk::ShaderStageFlagBits::eFragment,
-				sizeof(glm::mat4), sizeof(utils::UBOColor), &node->color
-			);
-
-			//TransformComponent transform = ECS::Get().get<TransformComponent>(obj.entity);
-			//transform.PushModel(commandBuffer, pipelineLayout);
-			obj.mesh.Draw(commandBuffer);
+			int mask = 0;
+			for (int i = 0; i < 3; ++i)
+			{
+				// Outside of the cell, there is no child to hold it so it stays here
+				if (minDistances[i] > cellHalfExtent)
+				{
+					mask = KeepInCell;
+					break;
+				}
+				if (straddles[i] == 1)
+					mask |= (1 << i);
+			}
+			splits.push_back({ data, mask });
+			return true;
+		}
 
-			SimpleMesh<PosVertex>::Cube.Bind(commandBuffer);
-			Primitives::Box& objBox = obj.bb;
-			glm::mat4 boxModel = glm::scale(glm::translate(utils::identity, objBox.position), objBox.halfExtent*2.0f);
-			commandBuffer.pushConstants(
-				pipelineLayout,
-				vk::ShaderStageFlagBits::eVertex,
-				0, sizeof(glm::mat4), &boxModel
-			);
-			static glm::vec3 blue = { 0.0f, 1.0f, 0.0f };
-			static glm::vec3 red = { 1.0f, 0.0f, 0.0f };
+		// Something has to be clipped, split into all eight octants at once
+		Mesh<PosVertex>::Data octants[8];
+		std::vector<uint32_t> octantTriangles[8];
+		glm::vec3 octantDistances[8];
+		// BAIL if we're at the point where splitting increases
+		// our triangle count
+		if (!Mesh<PosVertex>::SplitOctants(data, cellPosition, octants, octantTriangles, octantDistances,
+										   triangleCount))
+		{
+			return false;
+		}
 
-			commandBuffer.pushConstants(
-				pipelineLayout,
-				vk::ShaderStageFlagBits::eFragment,
-				sizeof(glm::mat4), sizeof(utils::UBOColor), (obj.colliding) ? &red : &blue
-			);
+		uint32_t splitTriangles = 0;
+		for (const auto& octant : octants)
+			splitTriangles += octant.indices.size() / 3;
+		if (budget != nullptr &&
+			!budget->Take(static_cast<int64_t>(splitTriangles) - static_cast<int64_t>(triangleCount)))
+		{
+			return false;
+		}
 
-			obj.colliding = false;
-			SimpleMesh<PosVertex>::Cube.Draw(commandBuffer);
+		for (int mask = 0; mask < 8; ++mask)
+		{
+			if (octants[mask].indices.empty())
+				continue;
+
+			// Octants entirely outside of the cell stay in it, like in the case above
+			const glm::vec3& minDistance = octantDistances[mask];
+			const bool outside =
+				minDistance.x > cellHalfExtent || minDistance.y > cellHalfExtent || minDistance.z > cellHalfExtent;
+
+			SplitData& split = splits.emplace_back();
+			split.mask = outside ? KeepInCell : mask;
+			split.data.vertices = std::move(octants[mask].vertices);
+			split.data.indices = std::move(octants[mask].indices);
+			split.data.triangles = std::move(octantTriangles[mask]);
+			for (uint32_t& triangle : split.data.triangles)
+				triangle = data.triangles[triangle];
 		}
-	}
 
+		return true;
+	}
 
-	void DestroyRecursively(Node* node)
+	// Same decisions as InsertObject, but only down to ParallelDepth and
+	// without touching any nodes, so that it can run on any thread
+	static void SplitTopLevels(std::vector<Piece>& pieces,
+							   Fragment& data,
+							   entt::entity entity,
+							   uint32_t key,
+							   const glm::vec3& cellPosition,
+							   float cellHalfExtent,
+							   uint32_t depth,
+							   TriangleBudget& budget)
 	{
-		for (Octree::Node * child : node->children)
+		if (depth == ParallelDepth)
 		{
-			if (child != nullptr)
-				DestroyRecursively(child);
+			pieces.push_back({ key, std::move(data), entity, true });
+			return;
 		}
-		for (auto& obj : node->objects)
-			obj.mesh.Destroy();
-		delete node;
-	}
 
+		std::vector<SplitData> splits;
+		if (data.indices.size() / 3 < MinimumTriangles ||
+			!SplitIntoOctants(cellPosition, cellHalfExtent, data, splits, &budget))
+		{
+			pieces.push_back({ key, std::move(data), entity, false });
+			return;
+		}
 
-	void InsertObject(Node& node, 
-					  Mesh<PosVertex>::Data& data,
-					  const glm::vec3& cellPosition,
-					  float cellHalfExtent)
-	{
-		int triangleCount = data.indices.size() / 3;
+		float step = cellHalfExtent * 0.5f;
+		glm::vec3 offset;
+		for (auto& split : splits)
+		{
+			if (split.mask == KeepInCell)
+			{
+				pieces.push_back({ key, std::move(split.data), entity, false });
+				continue;
+			}
+
+			offset.x = ((split.mask & 1) ? step : -step);
+			offset.y = ((split.mask & 2) ? step : -step);
+			offset.z = ((split.mask & 4) ? step : -step);
 
+			SplitTopLevels(pieces, split.data, entity, (key << 3) | split.mask,
+						   cellPosition + offset, step, depth + 1, budget);
+		}
+	}
+
+	static void InsertObject(Builder& builder,
+							 uint32_t nodeIndex,
+							 Fragment& data,
+							 entt::entity entity,
+							 const glm::vec3& cellPosition,
+							 float cellHalfExtent,
+							 TriangleBudget& budget)
+	{
 		auto EmplaceObject =
-			[this, &node](Mesh<PosVertex>::Data& d)
+			[&builder, nodeIndex, entity](Fragment& d)
 		{
-			node.objects.emplace_back();
-			auto& obj = node.objects.back();
-			obj.mesh.CreateStatic(d.vertices, d.indices, *m_owner);
-			obj.bb = obj.mesh.GetBoundingBox();
-			node.leaf = true;
+			builder.objects.push_back({ std::move(d), nodeIndex, entity });
 		};
 
-		if (triangleCount < MinimumTriangles)
+		if (data.indices.size() / 3 < MinimumTriangles)
 		{
 			EmplaceObject(data);
 			return;
 		}
 
-		int index = 0;
-		static Primitives::Plane planes[3] = {
-			{ { 1.0f, 0.0f, 0.0f } },
-			{ { 0.0f, 1.0f, 0.0f } },
-			{ { 0.0f, 0.0f, 1.0f } }
-		};
-
-		struct SplitData
-		{
-			SplitData(Mesh<PosVertex>::Data&& data, int mask)
-				: data(data), mask(mask) {}
-			Mesh<PosVertex>::Data data = {};
-			int mask = 0;
-		};
 		std::vector<SplitData> splits;
-		splits.emplace_back(std::move(data), 0);
-
-		for (int i = 0; i < 3; ++i)
+		if (!SplitIntoOctants(cellPosition, cellHalfExtent, data, splits, &budget))
 		{
-			// Assign plane data
-			planes[i].position = node.box.position;
-			planes[i].D = glm::dot(node.box.position, planes[i].normal);
+			EmplaceObject(data);
+			return;
+		}
 
-			int splitSize = splits.size();
-			// For each set of vertices placed in the split vector
-			for (int j = 0; j < splitSize; ++j)
+		float step = cellHalfExtent * 0.5f;
+		glm::vec3 offset;
+		for (auto& split : splits)
+		{
+			if (split.mask == KeepInCell)
 			{
-				auto& split = splits[j];
-				float minDistance;
-				int straddling = Mesh<PosVertex>::IsStraddlingPlane(
-					split.data.vertices.data(),
-					split.data.vertices.size(),
-					planes[i], &minDistance);
-
-				if (minDistance > node.box.halfExtent)
-				{
-					// Erase this SplitData as it is outside the cell
-					splits.erase(splits.begin() + j--);
-					--splitSize;
-					continue;
-				}
-
-				// 0 means a straddle, 1 is all positive, -1 is all negative
-				if (straddling != 0)
-				{
-					// If not straddling and on back side,  mask if positive
-					if (straddling == 1)
-						split.mask |= (1 << i);
-				}
-				else
-				{
-					Mesh<PosVertex>::Data front, back;
-					// Straddling, split into two (front, back pair)
-					Mesh<PosVertex>::Clip(split.data, planes[i], front, back);
-
-					// BAIL if we're at the point where splitting increases
-					// our triangle count
-					if (front.indices.size() / 3 > triangleCount ||
-						back.indices.size()  / 3 > triangleCount)
-					{
-						EmplaceObject(data);
-						return;
-					}
-
-					int mask = split.mask;
-					// Erase this SplitData as we have just split it into two
-					splits.erase(splits.begin() + j--);
-					--splitSize;
-					// Emplace front and back-side split, front is masked by the current plane
-					if (!front.indices.empty())
-						splits.emplace_back( std::move(front), mask | (1 << i) );
-					if (!back.indices.empty())
-						splits.emplace_back( std::move(back), mask );
-				}
+				EmplaceObject(split.data);
+				continue;
 			}
+
+			offset.x = ((split.mask & 1) ? step : -step);
+			offset.y = ((split.mask & 2) ? step : -step);
+			offset.z = ((split.mask & 4) ? step : -step);
+
+			// Insert into children based on index mask
+			uint32_t child = builder.GetOrCreateChild(nodeIndex, split.mask);
+			InsertObject(builder, child, split.data, entity, cellPosition + offset, step, budget);
 		}
+	}
 
-		int splitSize = splits.size();
+	// Insert into the existing cells without creating any, geometry that falls in
+	// an octant without a child is kept by the deepest cell that contains it
+	void Reinsert(uint32_t nodeIndex,
+				  Fragment& data,
+				  entt::entity entity,
+				  const glm::vec3& cellPosition,
+				  float cellHalfExtent)
+	{
+		std::vector<SplitData> splits;
+		if (m_nodes[nodeIndex].childMask == 0 ||
+			data.indices.size() / 3 < MinimumTriangles ||
+			!SplitIntoOctants(cellPosition, cellHalfExtent, data, splits))
+		{
+			AddObject(nodeIndex, data, entity);
+			return;
+		}
 
 		float step = cellHalfExtent * 0.5f;
 		glm::vec3 offset;
-		for (int i = 0; i < splitSize; ++i)
+		for (auto& split : splits)
 		{
-			auto& split = splits[i];
+			// Also keeps the triangles that stay in this cell, they never have a child
+			const Node& node = m_nodes[nodeIndex];
+			if (split.mask == KeepInCell || (node.childMask & (1u << split.mask)) == 0)
+			{
+				AddObject(nodeIndex, split.data, entity);
+				continue;
+			}
+
 			offset.x = ((split.mask & 1) ? step : -step);
 			offset.y = ((split.mask & 2) ? step : -step);
 			offset.z = ((split.mask & 4) ? step : -step);
+			Reinsert(ChildIndex(node, split.mask), split.data, entity, cellPosition + offset, step);
+		}
+	}
 
-			auto* child = node.children[split.mask];
-			if (child == nullptr)
+	void AddObject(uint32_t nodeIndex, Fragment& data, entt::entity entity)
+	{
+		// Move the range to the end of the array once it is full
+		Node& node = m_nodes[nodeIndex];
+		if (node.objectCount == node.objectCapacity)
+		{
+			uint32_t first = m_objects.size();
+			uint32_t capacity = std::max(4u, node.objectCapacity * 2);
+			m_objects.resize(first + capacity);
+			for (uint32_t i = 0; i < node.objectCount; ++i)
+				m_objects[first + i] = m_objects[node.firstObject + i];
+
+			m_freeSlots += capacity;
+			node.firstObject = first;
+			node.objectCapacity = capacity;
+		}
+
+		Object& obj = m_objects[node.firstObject + node.objectCount++];
+		--m_freeSlots;
+		obj.entity = entity;
+		obj.colliding = 0;
+		AppendGeometry(data, obj);
+		m_debugDirty = true;
+
+		auto& nodes = m_entities[entity];
+		if (std::find(nodes.begin(), nodes.end(), nodeIndex) == nodes.end())
+			nodes.push_back(nodeIndex);
+
+		ExpandBounds(nodeIndex, obj.bb);
+	}
+
+	// Grow the bounds of a node and its ancestors to contain a box
+	void ExpandBounds(uint32_t nodeIndex, const Primitives::Box& box)
+	{
+		const glm::vec3 min = box.position - box.halfExtent;
+		const glm::vec3 max = box.position + box.halfExtent;
+
+		while (nodeIndex != 0)
+		{
+			const Node& node = m_nodes[nodeIndex];
+			const Node& parent = m_nodes[node.parent];
+			uint32_t octant = (node.box.position.x > parent.box.position.x ? 1u : 0u) |
+				(node.box.position.y > parent.box.position.y ? 2u : 0u) |
+				(node.box.position.z > parent.box.position.z ? 4u : 0u);
+
+			ChildBounds& bounds = m_childBounds[parent.childBounds];
+			bounds.minX[octant] = std::min(bounds.minX[octant], min.x);
+			bounds.minY[octant] = std::min(bounds.minY[octant], min.y);
+			bounds.minZ[octant] = std::min(bounds.minZ[octant], min.z);
+			bounds.maxX[octant] = std::max(bounds.maxX[octant], max.x);
+			bounds.maxY[octant] = std::max(bounds.maxY[octant], max.y);
+			bounds.maxZ[octant] = std::max(bounds.maxZ[octant], max.z);
+			nodeIndex = node.parent;
+		}
+
+		glm::vec3 rootMin = glm::min(m_bounds.position - m_bounds.halfExtent, min);
+		glm::vec3 rootMax = glm::max(m_bounds.position + m_bounds.halfExtent, max);
+		m_bounds.position = (rootMin + rootMax) * 0.5f;
+		m_bounds.halfExtent = (rootMax - rootMin) * 0.5f;
+	}
+
+	// Repack every node's objects and their geometry back to back, dropping the free slots
+	void Compact()
+	{
+		uint32_t objectCount = 0;
+		for (const Node& node : m_nodes)
+			objectCount += node.objectCount;
+
+		std::vector<Object> objects(objectCount);
+		Pool<PosVertex> vertices;
+		Pool<uint32_t> indices;
+		Pool<TrianglePacket> packets;
+		Pool<uint32_t> triangles;
+
+		uint32_t cursor = 0;
+		for (Node& node : m_nodes)
+		{
+			for (uint32_t i = 0; i < node.objectCount; ++i)
 			{
-				child = node.children[split.mask] = new Node();
-				child->box.halfExtent = step;
-				child->box.position = cellPosition + offset;
-				child->color = glm::vec3(utils::Random(), utils::Random(), utils::Random());
+				Object obj = m_objects[node.firstObject + i];
+
+				const uint32_t firstVertex = vertices.size();
+				vertices.append(m_vertices.begin() + obj.firstVertex,
+								m_vertices.begin() + obj.firstVertex + obj.vertexCount);
+				const uint32_t firstIndex = indices.size();
+				indices.append(m_indices.begin() + obj.firstIndex,
+							   m_indices.begin() + obj.firstIndex + obj.indexCount);
+				const uint32_t firstPacket = packets.size();
+				packets.append(m_packets.begin() + obj.firstPacket,
+							   m_packets.begin() + obj.firstPacket + obj.packetCount);
+				triangles.append(m_triangles.begin() + obj.firstPacket * 8,
+								 m_triangles.begin() + (obj.firstPacket + obj.packetCount) * 8);
+
+				obj.firstVertex = firstVertex;
+				obj.firstIndex = firstIndex;
+				obj.firstPacket = firstPacket;
+				objects[cursor + i] = obj;
 			}
 
-			// Insert into children based on index mask
-			InsertObject(*child, split.data, cellPosition + offset, step);
+			node.firstObject = cursor;
+			node.objectCapacity = node.objectCount;
+			cursor += node.objectCount;
 		}
+
+		m_objects = std::move(objects);
+		m_vertices = std::move(vertices);
+		m_indices = std::move(indices);
+		m_packets = std::move(packets);
+		m_triangles = std::move(triangles);
+		m_freeSlots = 0;
+		m_debugDirty = true;
+	}
+
+	// Upload the geometry pools into the shared debug mesh if they changed since
+	// the last upload. The previous mesh may still be used by frames in flight
+	void UpdateDebugMesh()
+	{
+		++m_frame;
+		while (!m_retired.empty() && m_frame - m_retired.front().first > MAX_FRAME_DRAWS)
+			m_retired.pop_front();
+
+		if (!m_debugDirty || m_indices.empty()) return;
+
+		if (m_debugMesh.GetVertexCount() != 0)
+			m_retired.emplace_back(m_frame, std::move(m_debugMesh));
+
+		std::vector<PosVertex> vertices(m_vertices.begin(), m_vertices.end());
+		std::vector<uint32_t> indices(m_indices.begin(), m_indices.end());
+		m_debugMesh = Mesh<PosVertex>(vertices, indices, m_owner);
+		m_debugDirty = false;
+	}
+
+	// Describe the tree as it is now, build phases are added by whoever built it
+	void GatherStats()
+	{
+		m_stats.nodeCount = m_nodes.size();
+		m_stats.objectCount = 0;
+		m_stats.leafCount = 0;
+		m_stats.leafTriangles.fill(0);
+		m_stats.nodesPerDepth.clear();
+		m_stats.storedTriangles = 0;
+
+		// Parents come before their children, so depths are known on the way down
+		std::vector<uint32_t> depths(m_nodes.size(), 0);
+		std::unordered_set<uint64_t> sourceTriangles;
+		for (uint32_t i = 0; i < m_nodes.size(); ++i)
+		{
+			const Node& node = m_nodes[i];
+			if (i != 0)
+				depths[i] = depths[node.parent] + 1;
+			if (m_stats.nodesPerDepth.size() <= depths[i])
+				m_stats.nodesPerDepth.resize(depths[i] + 1, 0);
+			++m_stats.nodesPerDepth[depths[i]];
+
+			uint64_t nodeTriangles = 0;
+			for (uint32_t j = 0; j < node.objectCount; ++j)
+			{
+				const Object& obj = m_objects[node.firstObject + j];
+				const uint32_t triangleCount = obj.indexCount / 3;
+				nodeTriangles += triangleCount;
+
+				// Clipped pieces of the same source triangle are only counted once
+				const uint64_t entity = static_cast<uint64_t>(obj.entity) << 32;
+				for (uint32_t k = 0; k < triangleCount; ++k)
+					sourceTriangles.insert(entity | m_triangles[obj.firstPacket * 8 + k]);
+			}
+			m_stats.objectCount += node.objectCount;
+			m_stats.storedTriangles += nodeTriangles;
+			if (node.childMask == 0)
+				m_stats.AddLeaf(nodeTriangles);
+		}
+		m_stats.sourceTriangles = sourceTriangles.size();
+
+		m_stats.memoryBytes = m_nodes.size() * sizeof(Node) +
+			m_childBounds.size() * sizeof(ChildBounds) +
+			m_objects.size() * sizeof(Object) +
+			m_vertices.size() * sizeof(PosVertex) +
+			m_indices.size() * sizeof(uint32_t) +
+			m_packets.size() * sizeof(TrianglePacket) +
+			m_triangles.size() * sizeof(uint32_t);
+	}
+
+	// Map every entity to the nodes holding its objects
+	void RebuildEntities()
+	{
+		m_entities.clear();
+		for (uint32_t nodeIndex = 0; nodeIndex < m_nodes.size(); ++nodeIndex)
+		{
+			const Node& node = m_nodes[nodeIndex];
+			for (uint32_t i = 0; i < node.objectCount; ++i)
+			{
+				auto& nodes = m_entities[m_objects[node.firstObject + i].entity];
+				if (nodes.empty() || nodes.back() != nodeIndex)
+					nodes.push_back(nodeIndex);
+			}
+		}
+	}
+
+	// Lay the built cells out breadth-first, pack the objects by node
+	// and gather the tight bounds of every node's children
+	void Flatten(Builder& builder)
+	{
+		const uint32_t buildNodeCount = builder.nodes.size();
+
+		// Children are always pushed after their parent, so a reverse pass
+		// accumulates each subtree's object count
+		std::vector<uint32_t> objectCounts(buildNodeCount, 0);
+		for (const auto& obj : builder.objects)
+			++objectCounts[obj.node];
+
+		std::vector<uint32_t> subtreeCounts = objectCounts;
+		for (uint32_t i = buildNodeCount; i-- > 0;)
+		{
+			for (int32_t child : builder.nodes[i].children)
+			{
+				if (child != -1)
+					subtreeCounts[i] += subtreeCounts[child];
+			}
+		}
+
+		ReleaseStorage();
+		if (subtreeCounts[0] == 0)
+			return;
+
+		// Breadth-first order, cells that hold nothing are dropped
+		std::vector<uint32_t> order;
+		std::vector<uint32_t> linearIndex(buildNodeCount, UINT32_MAX);
+		order.reserve(buildNodeCount);
+		order.push_back(0);
+		m_nodes.reserve(buildNodeCount);
+
+		uint32_t objectCursor = 0;
+		for (uint32_t i = 0; i < order.size(); ++i)
+		{
+			const BuildNode& buildNode = builder.nodes[order[i]];
+			linearIndex[order[i]] = i;
+
+			Node node;
+			node.box = buildNode.box;
+			node.color = glm::vec3(utils::Random(), utils::Random(), utils::Random());
+			node.firstObject = objectCursor;
+			node.objectCount = objectCounts[order[i]];
+			node.objectCapacity = node.objectCount;
+			node.firstChild = order.size();
+			objectCursor += node.objectCount;
+
+			for (uint32_t octant = 0; octant < 8; ++octant)
+			{
+				int32_t child = buildNode.children[octant];
+				if (child == -1 || subtreeCounts[child] == 0) continue;
+
+				node.childMask |= 1u << octant;
+				order.push_back(child);
+			}
+			m_nodes.push_back(node);
+		}
+
+		for (uint32_t i = 0; i < m_nodes.size(); ++i)
+		{
+			for (uint32_t octant = 0; octant < 8; ++octant)
+			{
+				if (m_nodes[i].childMask & (1u << octant))
+					m_nodes[ChildIndex(m_nodes[i], octant)].parent = i;
+			}
+		}
+
+		// Pack objects into their node's range
+		std::vector<uint32_t> cursors(m_nodes.size());
+		for (uint32_t i = 0; i < m_nodes.size(); ++i)
+			cursors[i] = m_nodes[i].firstObject;
+
+		m_objects.resize(objectCursor);
+		for (auto& buildObject : builder.objects)
+		{
+			Object& obj = m_objects[cursors[linearIndex[buildObject.node]]++];
+			obj.entity = buildObject.entity;
+			AppendGeometry(buildObject.data, obj);
+		}
+		builder.objects.clear();
+		m_debugDirty = true;
+		RebuildEntities();
+
+		// Children come after their parent, so a reverse pass computes tight bounds
+		std::vector<glm::vec3> boundsMin(m_nodes.size(), glm::vec3(FLT_MAX));
+		std::vector<glm::vec3> boundsMax(m_nodes.size(), glm::vec3(-FLT_MAX));
+		for (uint32_t i = m_nodes.size(); i-- > 0;)
+		{
+			const Node& node = m_nodes[i];
+			for (uint32_t j = 0; j < node.objectCount; ++j)
+			{
+				const Primitives::Box& bb = m_objects[node.firstObject + j].bb;
+				boundsMin[i] = glm::min(boundsMin[i], bb.position - bb.halfExtent);
+				boundsMax[i] = glm::max(boundsMax[i], bb.position + bb.halfExtent);
+			}
+
+			for (uint32_t octant = 0; octant < 8; ++octant)
+			{
+				if ((node.childMask & (1u << octant)) == 0) continue;
+				uint32_t child = ChildIndex(node, octant);
+				boundsMin[i] = glm::min(boundsMin[i], boundsMin[child]);
+				boundsMax[i] = glm::max(boundsMax[i], boundsMax[child]);
+			}
+		}
+
+		for (Node& node : m_nodes)
+		{
+			if (node.childMask == 0) continue;
+
+			node.childBounds = m_childBounds.size();
+			ChildBounds& bounds = m_childBounds.emplace_back();
+			for (uint32_t octant = 0; octant < 8; ++octant)
+			{
+				glm::vec3 min = glm::vec3(FLT_MAX);
+				glm::vec3 max = glm::vec3(-FLT_MAX);
+				if (node.childMask & (1u << octant))
+				{
+					uint32_t child = ChildIndex(node, octant);
+					min = boundsMin[child];
+					max = boundsMax[child];
+				}
+				bounds.minX[octant] = min.x;
+				bounds.minY[octant] = min.y;
+				bounds.minZ[octant] = min.z;
+				bounds.maxX[octant] = max.x;
+				bounds.maxY[octant] = max.y;
+				bounds.maxZ[octant] = max.z;
+			}
+		}
+
+		m_bounds.position = (boundsMin[0] + boundsMax[0]) * 0.5f;
+		m_bounds.halfExtent = (boundsMax[0] - boundsMin[0]) * 0.5f;
 	}
 
-	// TODO: Not hard-code this
-	glm::mat4* colliderTransform = nullptr;
+	Pool<Node> m_nodes;
+	Pool<ChildBounds> m_childBounds;
+	Pool<Object> m_objects;
+	// Geometry of every object
+	Pool<PosVertex> m_vertices;
+	Pool<uint32_t> m_indices;
+	Pool<TrianglePacket> m_packets;
+	Pool<uint32_t> m_triangles;
+	// Every object's geometry in one buffer, only created when objects are drawn
+	Mesh<PosVertex> m_debugMesh;
+	bool m_debugDirty = false;
+	// File the pools may be viewing
+	utils::MappedFile m_file;
+	// Hash of the scene and parameters the tree was built from
+	uint64_t m_hash = 0;
+	// Tight bounds of everything in the tree
+	Primitives::Box m_bounds = {};
+	// Root cell the tree was created with
+	Primitives::BoxUniform m_cell = {};
+
+	// Nodes holding objects of each entity, so that updates only touch those
+	std::unordered_map<entt::entity, std::vector<uint32_t>> m_entities;
+	// Object slots not referenced by any node
+	uint32_t m_freeSlots = 0;
+	// Replaced debug meshes, kept alive until no frame can reference them
+	std::deque<std::pair<uint32_t, Mesh<PosVertex>>> m_retired;
+	uint32_t m_frame = 0;
+
+	// What was built and how much work the queries do
+	SpatialStats m_stats;
+	// Shared by the jobs of a build
+	TriangleBudget m_budget;
+
+	// Entities already gathered by the current frustum query
+	std::unordered_set<entt::entity> m_visibleSet;
 
-	Node* head = nullptr;
 	Device* m_owner;
-};
\ No newline at end of file
+};
@@ -0,0 +1,142 @@
+#pragma once
+
+// Array of trivially copyable elements that either owns its storage or views
+// memory owned by someone else, such as a section of a mapped file. A view is
+// used in place until it has to grow, then it is copied into owned storage
+template <typename T>
+class Pool
+{
+	static_assert(std::is_trivially_copyable_v<T>, "Pool elements are stored as raw bytes");
+
+public:
+	Pool() = default;
+
+	Pool(const Pool& other)
+		: m_owned(other.begin(), other.end())
+	{
+		Sync();
+	}
+
+	Pool(Pool&& other) noexcept
+	{
+		*this = std::move(other);
+	}
+
+	Pool& operator=(const Pool& other)
+	{
+		if (this != &other)
+		{
+			m_owned.assign(other.begin(), other.end());
+			Sync();
+		}
+		return *this;
+	}
+
+	Pool& operator=(Pool&& other) noexcept
+	{
+		m_owned = std::move(other.m_owned);
+		m_data = other.m_data;
+		m_size = other.m_size;
+		m_view = other.m_view;
+		other.m_data = nullptr;
+		other.m_size = 0;
+		other.m_view = false;
+		return *this;
+	}
+
+	Pool& operator=(std::vector<T>&& elements)
+	{
+		m_owned = std::move(elements);
+		Sync();
+		return *this;
+	}
+
+	// Use the elements in place, the memory must outlive the view
+	void View(T* data, size_t size)
+	{
+		m_owned = std::vector<T>();
+		m_data = data;
+		m_size = size;
+		m_view = true;
+	}
+
+	bool IsView() const { return m_view; }
+
+	T* data() { return m_data; }
+	const T* data() const { return m_data; }
+	size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+
+	T& operator[](size_t i) { return m_data[i]; }
+	const T& operator[](size_t i) const { return m_data[i]; }
+	T& back() { return m_data[m_size - 1]; }
+
+	T* begin() { return m_data; }
+	T* end() { return m_data + m_size; }
+	const T* begin() const { return m_data; }
+	const T* end() const { return m_data + m_size; }
+
+	void clear()
+	{
+		m_owned.clear();
+		Sync();
+	}
+
+	void reserve(size_t size)
+	{
+		Own();
+		m_owned.reserve(size);
+		Sync();
+	}
+
+	void resize(size_t size)
+	{
+		Own();
+		m_owned.resize(size);
+		Sync();
+	}
+
+	void push_back(const T& element)
+	{
+		Own();
+		m_owned.push_back(element);
+		Sync();
+	}
+
+	template <typename... Args>
+	T& emplace_back(Args&&... args)
+	{
+		Own();
+		m_owned.emplace_back(std::forward<Args>(args)...);
+		Sync();
+		return back();
+	}
+
+	template <typename It>
+	void append(It first, It last)
+	{
+		Own();
+		m_owned.insert(m_owned.end(), first, last);
+		Sync();
+	}
+
+private:
+	void Own()
+	{
+		if (!m_view) return;
+		m_owned.assign(m_data, m_data + m_size);
+		m_view = false;
+	}
+
+	void Sync()
+	{
+		m_data = m_owned.data();
+		m_size = m_owned.size();
+		m_view = false;
+	}
+
+	std::vector<T> m_owned;
+	T* m_data = nullptr;
+	size_t m_size = 0;
+	bool m_view = false;
+};
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "Pool.hpp"
+#include "TriangleBudget.hpp"
+#include "Octree/Octree.hpp"
+#include "BSP/BSP.hpp"
+#include "BVH/BVH.hpp"
+#include "BVH/TwoLevelBVH.hpp"
+#include "SpatialTuning.hpp"
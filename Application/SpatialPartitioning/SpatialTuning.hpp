@@ -0,0 +1,55 @@
+#pragma once
+
+// Build parameters of the structures that are worth tuning per scene. Kept in a
+// small text file of "name value" lines next to the scene, see SpatialBenchmark --tune
+struct SpatialTuning
+{
+	uint32_t octreeMinimumTriangles = Octree::MinimumTriangles;
+	uint32_t bspMinimumTriangles = BSP::MinimumTriangles;
+	float bspSplitBlend = BSP::SplitBlend;
+	uint32_t bspPlaneSamples = BSP::PlaneSamples;
+
+	// The parameters the structures currently build with
+	static SpatialTuning Capture()
+	{
+		return SpatialTuning();
+	}
+
+	void Apply() const
+	{
+		Octree::MinimumTriangles = octreeMinimumTriangles;
+		BSP::MinimumTriangles = bspMinimumTriangles;
+		BSP::SplitBlend = bspSplitBlend;
+		BSP::PlaneSamples = bspPlaneSamples;
+	}
+
+	bool Save(const std::string& path) const
+	{
+		std::ofstream file(path);
+		if (!file) return false;
+
+		file << "Octree::MinimumTriangles " << octreeMinimumTriangles << '\n'
+			 << "BSP::MinimumTriangles " << bspMinimumTriangles << '\n'
+			 << "BSP::SplitBlend " << bspSplitBlend << '\n'
+			 << "BSP::PlaneSamples " << bspPlaneSamples << '\n';
+		return static_cast<bool>(file);
+	}
+
+	// Parameters missing from the file keep their current values
+	bool Load(const std::string& path)
+	{
+		std::ifstream file(path);
+		if (!file) return false;
+
+		std::string name;
+		while (file >> name)
+		{
+			if (name == "Octree::MinimumTriangles") file >> octreeMinimumTriangles;
+			else if (name == "BSP::MinimumTriangles") file >> bspMinimumTriangles;
+			else if (name == "BSP::SplitBlend") file >> bspSplitBlend;
+			else if (name == "BSP::PlaneSamples") file >> bspPlaneSamples;
+			else file.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+		}
+		return !file.bad();
+	}
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+// Triangles a build may add by clipping before it stops splitting, shared by all
+// of the build's jobs. Some parameters keep clipping slivers until memory runs
+// out, with a budget such a build ends early with everything left unsplit
+class TriangleBudget
+{
+public:
+	// Allow up to maxGrowth times the source triangles, FLT_MAX for no limit
+	void Reset(uint64_t sourceTriangles, float maxGrowth)
+	{
+		const double limit = static_cast<double>(sourceTriangles) * maxGrowth;
+		m_remaining = limit >= static_cast<double>(INT64_MAX) ?
+			INT64_MAX : static_cast<int64_t>(limit) - static_cast<int64_t>(sourceTriangles);
+		m_exceeded = false;
+	}
+
+	// Take the triangles a split adds, false if they don't fit. Once one split
+	// didn't fit no other one does, so the build stops splitting everywhere
+	bool Take(int64_t triangles)
+	{
+		if (m_exceeded.load(std::memory_order_relaxed))
+			return false;
+		if (triangles <= 0)
+			return true;
+		if (m_remaining.fetch_sub(triangles, std::memory_order_relaxed) < triangles)
+		{
+			m_exceeded.store(true, std::memory_order_relaxed);
+			return false;
+		}
+		return true;
+	}
+
+	bool IsExceeded() const
+	{
+		return m_exceeded.load(std::memory_order_relaxed);
+	}
+
+private:
+	std::atomic<int64_t> m_remaining{ INT64_MAX };
+	std::atomic<bool> m_exceeded{ false };
+};
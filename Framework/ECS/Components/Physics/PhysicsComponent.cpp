@@ -0,0 +1,11 @@
+#include "PhysicsComponent.h"
+
+void PhysicsComponent::GetWorldBounds(const glm::mat4& model, glm::vec3& min, glm::vec3& max) const
+{
+	const glm::vec3 center = glm::vec3(model * glm::vec4(bounds.position, 1.0f));
+	const glm::mat3 linear = glm::mat3(model);
+	const glm::mat3 absolute = glm::mat3(glm::abs(linear[0]), glm::abs(linear[1]), glm::abs(linear[2]));
+	const glm::vec3 extent = absolute * bounds.halfExtent;
+	min = center - extent;
+	max = center + extent;
+}
@@ -4,6 +4,11 @@ class PhysicsComponent
 {
 public:
 	glm::vec3 velocity = glm::vec3(0.0f);
+	// Local space box the broad-phase tracks the entity with
+	Primitives::Box bounds = { glm::vec3(0.0f), glm::vec3(0.5f) };
+
+	// World space box around the bounds moved by the model
+	void GetWorldBounds(const glm::mat4& model, glm::vec3& min, glm::vec3& max) const;
 
 private:
 
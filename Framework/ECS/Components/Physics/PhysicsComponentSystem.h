@@ -3,8 +3,22 @@
 class PhysicsComponentSystem : public ComponentSystem
 {
 public:
+	enum class BroadPhase { SpatialHashGrid, SweepAndPrune };
+
+	void Create() override
+	{
+		m_spatialHashGrid.Create();
+	}
+
 	void Update(float dt) override
 	{
+		// Pairs for the models rebuilt by the transform system this frame
+		const auto& moved = ECS::GetSystem<TransformComponentSystem>().GetUpdated();
+		if (m_broadPhase == BroadPhase::SpatialHashGrid)
+			m_spatialHashGrid.Update(moved);
+		else
+			m_sweepAndPrune.Update(moved);
+
 		auto& reg = ECS::Get();
 		auto view = reg.view<PhysicsComponent, TransformComponent>();
 		view.each([dt](PhysicsComponent& physics, TransformComponent& transform)
@@ -12,4 +26,33 @@ public:
 			transform.SetPosition(transform.GetPosition() + physics.velocity * dt);
 		});
 	}
+
+	void Destroy() override
+	{
+		if (m_broadPhase == BroadPhase::SpatialHashGrid)
+			m_spatialHashGrid.Destroy();
+		else
+			m_sweepAndPrune.Destroy();
+	}
+
+	// Only the selected broad-phase tracks the bodies, the other one is destroyed
+	void SetBroadPhase(BroadPhase broadPhase)
+	{
+		if (broadPhase == m_broadPhase) return;
+		Destroy();
+		m_broadPhase = broadPhase;
+		if (m_broadPhase == BroadPhase::SpatialHashGrid)
+			m_spatialHashGrid.Create();
+		else
+			m_sweepAndPrune.Create();
+	}
+
+	BroadPhase GetBroadPhase() const { return m_broadPhase; }
+	const SpatialHashGrid& GetSpatialHashGrid() const { return m_spatialHashGrid; }
+	const SweepAndPrune& GetSweepAndPrune() const { return m_sweepAndPrune; }
+
+private:
+	BroadPhase m_broadPhase = BroadPhase::SpatialHashGrid;
+	SpatialHashGrid m_spatialHashGrid;
+	SweepAndPrune m_sweepAndPrune;
 };
@@ -0,0 +1,488 @@
+#pragma once
+
+// Broad-phase over the entities with a PhysicsComponent. Each body's world space
+// box is quantized into the cells it overlaps. Cells live in an open addressing
+// table keyed by their packed coordinates, and their bodies are stored contiguously
+// in cell order. Only bodies that moved are re-bounded, and the cells are only
+// rebuilt once a body entered or left one
+class SpatialHashGrid
+{
+public:
+	// Bodies whose boxes overlap, a is the lower of the two entities
+	struct Pair
+	{
+		entt::entity a;
+		entt::entity b;
+	};
+
+	// Track every entity that has a PhysicsComponent now or gets one later
+	void Create()
+	{
+		auto& registry = ECS::Get();
+		registry.on_construct<PhysicsComponent>().connect<&SpatialHashGrid::OnConstruct>(*this);
+		registry.on_destroy<PhysicsComponent>().connect<&SpatialHashGrid::OnDestroy>(*this);
+		registry.view<PhysicsComponent>().each([this](const entt::entity entity, PhysicsComponent&)
+		{
+			m_added.push_back(entity);
+		});
+	}
+
+	void Destroy()
+	{
+		auto& registry = ECS::Get();
+		registry.on_construct<PhysicsComponent>().disconnect<&SpatialHashGrid::OnConstruct>(*this);
+		registry.on_destroy<PhysicsComponent>().disconnect<&SpatialHashGrid::OnDestroy>(*this);
+		m_entities.clear();
+		m_min.clear();
+		m_max.clear();
+		m_cellMin.clear();
+		m_cellMax.clear();
+		m_bodyIndex.clear();
+		m_added.clear();
+		m_removed.clear();
+		m_table.clear();
+		m_occupied.clear();
+		m_cellBodies.clear();
+		m_oversized.clear();
+		m_inCells.clear();
+		m_pairs.clear();
+		m_stats.ResetBuild();
+	}
+
+	// Bring the bodies up to date with the moved entities and find this frame's pairs
+	void Update(const std::vector<entt::entity>& moved)
+	{
+		m_stats.phases.clear();
+		auto start = std::chrono::steady_clock::now();
+
+		bool changedCells = UpdateBodies(moved);
+		if (CellSize != m_cellSize)
+		{
+			// Every body is in different cells now
+			m_cellSize = CellSize;
+			for (uint32_t i = 0; i < m_entities.size(); ++i)
+				Quantize(m_min[i], m_max[i], m_cellMin[i], m_cellMax[i]);
+			changedCells = true;
+		}
+		if (MaxBodyCells != m_maxBodyCells)
+		{
+			m_maxBodyCells = MaxBodyCells;
+			changedCells = true;
+		}
+		m_stats.AddPhase("Update Bodies", start);
+
+		if (changedCells)
+		{
+			start = std::chrono::steady_clock::now();
+			Insert();
+			m_stats.AddPhase("Insert", start);
+		}
+
+		start = std::chrono::steady_clock::now();
+		FindPairs();
+		m_stats.AddPhase("Find Pairs", start);
+		GatherStats();
+	}
+
+	const std::vector<Pair>& GetPairs() const { return m_pairs; }
+	const SpatialStats& GetStats() const { return m_stats; }
+
+	// Bodies are inserted into every cell they overlap, so this is best kept
+	// around the size of a typical body
+	inline static float CellSize = 2.0f;
+	// Bodies overlapping more cells than this are kept out of the cells and tested
+	// against every body instead, so one huge body can't fill the table
+	inline static uint32_t MaxBodyCells = 64;
+
+private:
+	static constexpr uint64_t EmptyKey = UINT64_MAX;
+	// Cell coordinates are packed into 21 bits each
+	static constexpr int32_t CellLimit = (1 << 20) - 1;
+	// Slots and cell bodies are indexed with 32 bits
+	static constexpr uint64_t MaxTableSize = 1ull << 31;
+
+	struct Slot
+	{
+		std::atomic<uint64_t> key{ EmptyKey };
+		// Bodies in the cell while inserting, then the cursor while placing them
+		std::atomic<uint32_t> count{ 0 };
+		// First of the cell's bodies in m_cellBodies
+		uint32_t first = 0;
+		uint32_t size = 0;
+	};
+
+	void OnConstruct(entt::registry& registry, entt::entity entity)
+	{
+		m_added.push_back(entity);
+	}
+
+	void OnDestroy(entt::registry& registry, entt::entity entity)
+	{
+		m_removed.push_back(entity);
+	}
+
+	static uint64_t Key(const glm::ivec3& cell)
+	{
+		return (static_cast<uint64_t>(cell.x & 0x1FFFFF) << 42) |
+			(static_cast<uint64_t>(cell.y & 0x1FFFFF) << 21) |
+			static_cast<uint64_t>(cell.z & 0x1FFFFF);
+	}
+
+	void Quantize(const glm::vec3& min, const glm::vec3& max,
+				  glm::ivec3& cellMin, glm::ivec3& cellMax) const
+	{
+		cellMin = glm::clamp(glm::ivec3(glm::floor(min / m_cellSize)), glm::ivec3(-CellLimit), glm::ivec3(CellLimit));
+		cellMax = glm::clamp(glm::ivec3(glm::floor(max / m_cellSize)), glm::ivec3(-CellLimit), glm::ivec3(CellLimit));
+	}
+
+	// Add and remove the bodies queued by the signals and re-bound the moved ones.
+	// Returns whether any body entered or left a cell
+	bool UpdateBodies(const std::vector<entt::entity>& moved)
+	{
+		auto& registry = ECS::Get();
+		bool changedCells = false;
+
+		for (entt::entity entity : m_removed)
+		{
+			auto it = m_bodyIndex.find(entity);
+			if (it == m_bodyIndex.end()) continue;
+
+			// Swap the last body into the hole
+			const uint32_t body = it->second;
+			const uint32_t last = m_entities.size() - 1;
+			m_bodyIndex.erase(it);
+			if (body != last)
+			{
+				m_entities[body] = m_entities[last];
+				m_min[body] = m_min[last];
+				m_max[body] = m_max[last];
+				m_cellMin[body] = m_cellMin[last];
+				m_cellMax[body] = m_cellMax[last];
+				m_bodyIndex[m_entities[body]] = body;
+			}
+			m_entities.pop_back();
+			m_min.pop_back();
+			m_max.pop_back();
+			m_cellMin.pop_back();
+			m_cellMax.pop_back();
+			changedCells = true;
+		}
+		m_removed.clear();
+
+		// Entities without a transform yet are kept until they have one
+		std::vector<entt::entity> pending;
+		for (entt::entity entity : m_added)
+		{
+			if (!registry.valid(entity) || m_bodyIndex.count(entity) != 0) continue;
+			const auto* physics = registry.try_get<PhysicsComponent>(entity);
+			const auto* transform = registry.try_get<TransformComponent>(entity);
+			if (physics == nullptr) continue;
+			if (transform == nullptr)
+			{
+				pending.push_back(entity);
+				continue;
+			}
+
+			m_bodyIndex[entity] = m_entities.size();
+			m_entities.push_back(entity);
+			glm::vec3& min = m_min.emplace_back();
+			glm::vec3& max = m_max.emplace_back();
+			physics->GetWorldBounds(transform->model, min, max);
+			Quantize(min, max, m_cellMin.emplace_back(), m_cellMax.emplace_back());
+			changedCells = true;
+		}
+		m_added = std::move(pending);
+
+		// Re-bound the moved bodies in parallel, most stay in their cells
+		std::atomic<bool> movedCells = false;
+		JobSystem::ParallelFor(moved.size(), 256,
+			[this, &registry, &moved, &movedCells](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; ++i)
+			{
+				auto it = m_bodyIndex.find(moved[i]);
+				if (it == m_bodyIndex.end()) continue;
+				const auto* physics = registry.try_get<PhysicsComponent>(moved[i]);
+				const auto* transform = registry.try_get<TransformComponent>(moved[i]);
+				if (physics == nullptr || transform == nullptr) continue;
+
+				const uint32_t body = it->second;
+				physics->GetWorldBounds(transform->model, m_min[body], m_max[body]);
+				glm::ivec3 cellMin, cellMax;
+				Quantize(m_min[body], m_max[body], cellMin, cellMax);
+				if (cellMin != m_cellMin[body] || cellMax != m_cellMax[body])
+				{
+					m_cellMin[body] = cellMin;
+					m_cellMax[body] = cellMax;
+					movedCells.store(true, std::memory_order_relaxed);
+				}
+			}
+		});
+
+		return changedCells || movedCells;
+	}
+
+	// Slot of a key, claiming an empty one for it if it isn't in the table yet
+	uint32_t Claim(uint64_t key)
+	{
+		const uint32_t mask = m_table.size() - 1;
+		uint32_t slot = static_cast<uint32_t>((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+		while (true)
+		{
+			uint64_t expected = EmptyKey;
+			if (m_table[slot].key.compare_exchange_strong(expected, key, std::memory_order_relaxed) ||
+				expected == key)
+			{
+				return slot;
+			}
+			slot = (slot + 1) & mask;
+		}
+	}
+
+	// Slot of a key that is known to be in the table
+	uint32_t Find(uint64_t key) const
+	{
+		const uint32_t mask = m_table.size() - 1;
+		uint32_t slot = static_cast<uint32_t>((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+		while (m_table[slot].key.load(std::memory_order_relaxed) != key)
+			slot = (slot + 1) & mask;
+		return slot;
+	}
+
+	uint64_t CellCount(uint32_t body) const
+	{
+		const glm::ivec3 cells = m_cellMax[body] - m_cellMin[body] + 1;
+		return static_cast<uint64_t>(cells.x) * cells.y * cells.z;
+	}
+
+	template <typename Func>
+	void ForEachCell(uint32_t body, Func&& func) const
+	{
+		const glm::ivec3& cellMin = m_cellMin[body];
+		const glm::ivec3& cellMax = m_cellMax[body];
+		for (int32_t x = cellMin.x; x <= cellMax.x; ++x)
+			for (int32_t y = cellMin.y; y <= cellMax.y; ++y)
+				for (int32_t z = cellMin.z; z <= cellMax.z; ++z)
+					func(Key({ x, y, z }));
+	}
+
+	// Rebuild the cells from scratch in three passes: count each cell's bodies
+	// while claiming its slot, lay the cells out one after another, then place the
+	// bodies. Only the layout runs on a single thread
+	void Insert()
+	{
+		const uint32_t bodyCount = m_entities.size();
+
+		uint64_t references = 0;
+		m_oversized.clear();
+		m_inCells.assign(bodyCount, 1);
+		for (uint32_t i = 0; i < bodyCount; ++i)
+		{
+			const uint64_t cells = CellCount(i);
+			if (cells > m_maxBodyCells)
+			{
+				m_oversized.push_back(i);
+				m_inCells[i] = 0;
+				continue;
+			}
+			references += cells;
+		}
+
+		// There are never more cells than references, keep the table at most half full
+		uint64_t capacity = 64;
+		while (capacity < references * 2)
+			capacity <<= 1;
+		ASSERT(capacity <= MaxTableSize, "Too many cell references, raise CellSize or lower MaxBodyCells");
+		if (m_table.size() != capacity)
+		{
+			m_table = std::vector<Slot>(capacity);
+		}
+		else
+		{
+			JobSystem::ParallelFor(capacity, 4096, [this](uint32_t begin, uint32_t end)
+			{
+				for (uint32_t i = begin; i < end; ++i)
+				{
+					m_table[i].key.store(EmptyKey, std::memory_order_relaxed);
+					m_table[i].count.store(0, std::memory_order_relaxed);
+				}
+			});
+		}
+
+		JobSystem::ParallelFor(bodyCount, 256, [this](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; ++i)
+			{
+				if (!m_inCells[i]) continue;
+				ForEachCell(i, [this](uint64_t key)
+				{
+					m_table[Claim(key)].count.fetch_add(1, std::memory_order_relaxed);
+				});
+			}
+		});
+
+		m_occupied.clear();
+		uint32_t first = 0;
+		for (uint32_t i = 0; i < capacity; ++i)
+		{
+			Slot& slot = m_table[i];
+			if (slot.key.load(std::memory_order_relaxed) == EmptyKey) continue;
+			slot.first = first;
+			slot.size = slot.count.load(std::memory_order_relaxed);
+			slot.count.store(0, std::memory_order_relaxed);
+			first += slot.size;
+			m_occupied.push_back(i);
+		}
+
+		m_cellBodies.resize(first);
+		JobSystem::ParallelFor(bodyCount, 256, [this](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; ++i)
+			{
+				if (!m_inCells[i]) continue;
+				ForEachCell(i, [this, i](uint64_t key)
+				{
+					Slot& slot = m_table[Find(key)];
+					m_cellBodies[slot.first + slot.count.fetch_add(1, std::memory_order_relaxed)] = i;
+				});
+			}
+		});
+	}
+
+	bool Overlap(uint32_t a, uint32_t b) const
+	{
+		return !glm::any(glm::greaterThan(m_min[a], m_max[b])) &&
+			!glm::any(glm::greaterThan(m_min[b], m_max[a]));
+	}
+
+	void AddPair(std::vector<Pair>& pairs, uint32_t a, uint32_t b) const
+	{
+		entt::entity first = m_entities[a], second = m_entities[b];
+		if (static_cast<uint64_t>(second) < static_cast<uint64_t>(first))
+			std::swap(first, second);
+		pairs.push_back({ first, second });
+	}
+
+	// Test every pair of bodies sharing a cell. A pair is only reported by the
+	// cell holding the lowest corner of the overlap of their boxes, so pairs
+	// sharing several cells are reported once without a set
+	void FindPairs()
+	{
+		constexpr uint32_t batchSize = 64;
+		const uint32_t batchCount = (m_occupied.size() + batchSize - 1) / batchSize;
+		// Followed by one batch per oversized body
+		std::vector<std::vector<Pair>> batchPairs(batchCount + m_oversized.size());
+		std::vector<SpatialStats::Counters> batchCounters(batchCount + m_oversized.size());
+
+		JobSystem::ParallelFor(m_occupied.size(), batchSize,
+			[this, &batchPairs, &batchCounters](uint32_t begin, uint32_t end)
+		{
+			std::vector<Pair>& pairs = batchPairs[begin / batchSize];
+			SpatialStats::Counters& counters = batchCounters[begin / batchSize];
+			for (uint32_t c = begin; c < end; ++c)
+			{
+				const Slot& slot = m_table[m_occupied[c]];
+				const uint64_t key = slot.key.load(std::memory_order_relaxed);
+				const uint32_t* bodies = m_cellBodies.data() + slot.first;
+				++counters.visitedNodes;
+
+				for (uint32_t i = 0; i < slot.size; ++i)
+				{
+					const uint32_t a = bodies[i];
+					for (uint32_t j = i + 1; j < slot.size; ++j)
+					{
+						const uint32_t b = bodies[j];
+						++counters.narrowPhaseTests;
+						if (!Overlap(a, b)) continue;
+
+						glm::ivec3 owner, unused;
+						Quantize(glm::max(m_min[a], m_min[b]), m_max[a], owner, unused);
+						if (Key(owner) != key) continue;
+						AddPair(pairs, a, b);
+					}
+				}
+			}
+		});
+
+		// Oversized bodies are in no cell, so they are tested against every body.
+		// A pair of two of them is reported by the lower body
+		JobSystem::ParallelFor(m_oversized.size(), 1,
+			[this, batchCount, &batchPairs, &batchCounters](uint32_t begin, uint32_t end)
+		{
+			const uint32_t bodyCount = m_entities.size();
+			for (uint32_t o = begin; o < end; ++o)
+			{
+				std::vector<Pair>& pairs = batchPairs[batchCount + o];
+				SpatialStats::Counters& counters = batchCounters[batchCount + o];
+				const uint32_t a = m_oversized[o];
+				++counters.visitedNodes;
+				for (uint32_t b = 0; b < bodyCount; ++b)
+				{
+					if (b == a || (!m_inCells[b] && b < a)) continue;
+					++counters.narrowPhaseTests;
+					if (Overlap(a, b))
+						AddPair(pairs, a, b);
+				}
+			}
+		});
+
+		// Sorted so that the pairs don't depend on the order bodies were placed in
+		m_pairs.clear();
+		SpatialStats::Counters counters;
+		for (uint32_t b = 0; b < batchPairs.size(); ++b)
+		{
+			m_pairs.insert(m_pairs.end(), batchPairs[b].begin(), batchPairs[b].end());
+			counters.visitedNodes += batchCounters[b].visitedNodes;
+			counters.narrowPhaseTests += batchCounters[b].narrowPhaseTests;
+		}
+		std::sort(m_pairs.begin(), m_pairs.end(), [](const Pair& x, const Pair& y)
+		{
+			return std::make_pair(static_cast<uint64_t>(x.a), static_cast<uint64_t>(x.b)) <
+				std::make_pair(static_cast<uint64_t>(y.a), static_cast<uint64_t>(y.b));
+		});
+		m_stats.collision.Add(counters);
+	}
+
+	// Cells are the nodes, the bodies in each cell its leaf objects
+	void GatherStats()
+	{
+		m_stats.nodesPerDepth.clear();
+		m_stats.leafTriangles.fill(0);
+		m_stats.leafCount = 0;
+		m_stats.nodeCount = m_occupied.size();
+		m_stats.objectCount = m_entities.size();
+		for (uint32_t slot : m_occupied)
+			m_stats.AddLeaf(m_table[slot].size);
+
+		m_stats.memoryBytes = m_table.size() * sizeof(Slot) +
+			m_cellBodies.size() * sizeof(uint32_t) +
+			m_oversized.size() * sizeof(uint32_t) +
+			m_entities.size() * (sizeof(entt::entity) + 2 * sizeof(glm::vec3) + 2 * sizeof(glm::ivec3) + sizeof(uint8_t));
+	}
+
+	// Bodies, indexed the same across these
+	std::vector<entt::entity> m_entities;
+	std::vector<glm::vec3> m_min;
+	std::vector<glm::vec3> m_max;
+	std::vector<glm::ivec3> m_cellMin;
+	std::vector<glm::ivec3> m_cellMax;
+	std::unordered_map<entt::entity, uint32_t> m_bodyIndex;
+
+	// Queued by the signals until the next update
+	std::vector<entt::entity> m_added;
+	std::vector<entt::entity> m_removed;
+
+	std::vector<Slot> m_table;
+	// Slots holding a cell, in table order
+	std::vector<uint32_t> m_occupied;
+	// Bodies of each cell, one cell after another
+	std::vector<uint32_t> m_cellBodies;
+	// Bodies over MaxBodyCells, and per body whether it is in the cells
+	std::vector<uint32_t> m_oversized;
+	std::vector<uint8_t> m_inCells;
+	float m_cellSize = CellSize;
+	uint32_t m_maxBodyCells = MaxBodyCells;
+
+	std::vector<Pair> m_pairs;
+	SpatialStats m_stats;
+};
@@ -0,0 +1,411 @@
+#pragma once
+
+// Sort and sweep broad-phase over the entities with a PhysicsComponent. The ends of
+// every body's box are kept sorted along each axis. Bodies barely move between
+// frames, so an insertion sort restores the order in close to linear time, and the
+// ends that pass each other are exactly where pairs start or stop overlapping.
+// Reports the pairs that were added and removed by the last update
+class SweepAndPrune
+{
+public:
+	using Pair = SpatialHashGrid::Pair;
+
+	// Track every entity that has a PhysicsComponent now or gets one later
+	void Create()
+	{
+		auto& registry = ECS::Get();
+		registry.on_construct<PhysicsComponent>().connect<&SweepAndPrune::OnConstruct>(*this);
+		registry.on_destroy<PhysicsComponent>().connect<&SweepAndPrune::OnDestroy>(*this);
+		registry.view<PhysicsComponent>().each([this](const entt::entity entity, PhysicsComponent&)
+		{
+			m_added.push_back(entity);
+		});
+		m_initialized = true;
+	}
+
+	void Destroy()
+	{
+		auto& registry = ECS::Get();
+		registry.on_construct<PhysicsComponent>().disconnect<&SweepAndPrune::OnConstruct>(*this);
+		registry.on_destroy<PhysicsComponent>().disconnect<&SweepAndPrune::OnDestroy>(*this);
+		m_entities.clear();
+		m_min.clear();
+		m_max.clear();
+		m_bodyIndex.clear();
+		m_added.clear();
+		m_removed.clear();
+		for (auto& endpoints : m_endpoints)
+			endpoints.clear();
+		m_pairs.clear();
+		m_addedPairs.clear();
+		m_removedPairs.clear();
+		m_stats.ResetBuild();
+		m_initialized = false;
+	}
+
+	bool IsInitialized() const
+	{
+		return m_initialized;
+	}
+
+	void Update(const std::vector<entt::entity>& moved)
+	{
+		if (!m_initialized) return;
+		m_addedPairs.clear();
+		m_removedPairs.clear();
+		m_stats.phases.clear();
+		auto start = std::chrono::steady_clock::now();
+
+		const uint32_t bodyCount = m_entities.size();
+		bool changed = RemoveBodies();
+		changed |= UpdateBodies(moved);
+		const uint32_t added = AddBodies();
+		m_stats.AddPhase("Update Bodies", start);
+
+		if (added * RebuildRatio > bodyCount)
+		{
+			// New ends each move past most of the others, past a handful of new
+			// bodies sorting from scratch is cheaper
+			start = std::chrono::steady_clock::now();
+			Rebuild();
+			m_stats.AddPhase("Rebuild", start);
+		}
+		else if (changed || added > 0)
+		{
+			start = std::chrono::steady_clock::now();
+			SpatialStats::Counters counters;
+			for (uint32_t axis = 0; axis < 3; ++axis)
+			{
+				RefreshEndpoints(axis);
+				Sort(axis, counters);
+			}
+			m_stats.collision.Add(counters);
+			m_stats.AddPhase("Sort", start);
+		}
+
+		GatherStats();
+	}
+
+	// Pairs that started overlapping during the last update
+	const std::vector<Pair>& GetAddedPairs() const { return m_addedPairs; }
+	// Pairs that stopped overlapping during the last update, or lost one of their bodies
+	const std::vector<Pair>& GetRemovedPairs() const { return m_removedPairs; }
+	uint32_t GetPairCount() const { return m_pairs.size(); }
+	const SpatialStats& GetStats() const { return m_stats; }
+
+	// Sort from scratch once more than 1 in this many bodies are new
+	inline static uint32_t RebuildRatio = 8;
+
+private:
+	static constexpr uint32_t InvalidBody = UINT32_MAX;
+
+	// One end of a body's box along an axis
+	struct Endpoint
+	{
+		float value;
+		// Body index in the upper bits, set lowest bit for the max end
+		uint32_t data;
+
+		uint32_t Body() const { return data >> 1; }
+		bool IsMax() const { return (data & 1) != 0; }
+
+		// Min ends go first on ties, so that touching boxes overlap
+		bool operator<(const Endpoint& other) const
+		{
+			return value < other.value || (value == other.value && (data & 1) < (other.data & 1));
+		}
+	};
+
+	void OnConstruct(entt::registry& registry, entt::entity entity)
+	{
+		m_added.push_back(entity);
+	}
+
+	void OnDestroy(entt::registry& registry, entt::entity entity)
+	{
+		m_removed.push_back(entity);
+	}
+
+	static uint64_t PairKey(entt::entity a, entt::entity b)
+	{
+		uint64_t x = static_cast<uint64_t>(a), y = static_cast<uint64_t>(b);
+		if (y < x) std::swap(x, y);
+		return (x << 32) | y;
+	}
+
+	static Pair KeyPair(uint64_t key)
+	{
+		return { static_cast<entt::entity>(key >> 32), static_cast<entt::entity>(key & 0xFFFFFFFF) };
+	}
+
+	bool Overlap(uint32_t a, uint32_t b) const
+	{
+		return !glm::any(glm::greaterThan(m_min[a], m_max[b])) &&
+			!glm::any(glm::greaterThan(m_min[b], m_max[a]));
+	}
+
+	void AddPair(uint32_t a, uint32_t b)
+	{
+		const uint64_t key = PairKey(m_entities[a], m_entities[b]);
+		if (m_pairs.insert(key).second)
+			m_addedPairs.push_back(KeyPair(key));
+	}
+
+	void RemovePair(uint32_t a, uint32_t b)
+	{
+		const uint64_t key = PairKey(m_entities[a], m_entities[b]);
+		if (m_pairs.erase(key) != 0)
+			m_removedPairs.push_back(KeyPair(key));
+	}
+
+	// Drop the destroyed bodies along with their pairs and ends. The ends stay
+	// sorted, only their body indices are remapped
+	bool RemoveBodies()
+	{
+		std::unordered_set<uint64_t> removed;
+		for (entt::entity entity : m_removed)
+		{
+			if (m_bodyIndex.count(entity) != 0)
+				removed.insert(static_cast<uint64_t>(entity));
+		}
+		m_removed.clear();
+		if (removed.empty()) return false;
+
+		for (auto it = m_pairs.begin(); it != m_pairs.end();)
+		{
+			if (removed.count(*it >> 32) != 0 || removed.count(*it & 0xFFFFFFFF) != 0)
+			{
+				m_removedPairs.push_back(KeyPair(*it));
+				it = m_pairs.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+
+		// Swap the last body into each hole while tracking where every body ends up
+		const uint32_t bodyCount = m_entities.size();
+		std::vector<uint32_t> remap(bodyCount, InvalidBody);
+		std::vector<uint32_t> original(bodyCount);
+		for (uint32_t i = 0; i < bodyCount; ++i)
+			original[i] = i;
+
+		for (uint64_t entity : removed)
+		{
+			auto it = m_bodyIndex.find(static_cast<entt::entity>(entity));
+			const uint32_t body = it->second;
+			const uint32_t last = m_entities.size() - 1;
+			m_bodyIndex.erase(it);
+			if (body != last)
+			{
+				m_entities[body] = m_entities[last];
+				m_min[body] = m_min[last];
+				m_max[body] = m_max[last];
+				original[body] = original[last];
+				m_bodyIndex[m_entities[body]] = body;
+			}
+			m_entities.pop_back();
+			m_min.pop_back();
+			m_max.pop_back();
+		}
+		for (uint32_t i = 0; i < m_entities.size(); ++i)
+			remap[original[i]] = i;
+
+		for (auto& endpoints : m_endpoints)
+		{
+			auto end = std::remove_if(endpoints.begin(), endpoints.end(), [&remap](const Endpoint& endpoint)
+			{
+				return remap[endpoint.Body()] == InvalidBody;
+			});
+			endpoints.erase(end, endpoints.end());
+			for (Endpoint& endpoint : endpoints)
+				endpoint.data = (remap[endpoint.Body()] << 1) | (endpoint.data & 1);
+		}
+		return true;
+	}
+
+	// Re-bound the moved bodies, returns whether there were any
+	bool UpdateBodies(const std::vector<entt::entity>& moved)
+	{
+		auto& registry = ECS::Get();
+		std::atomic<bool> changed = false;
+		JobSystem::ParallelFor(moved.size(), 256,
+			[this, &registry, &moved, &changed](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; ++i)
+			{
+				auto it = m_bodyIndex.find(moved[i]);
+				if (it == m_bodyIndex.end()) continue;
+				const auto* physics = registry.try_get<PhysicsComponent>(moved[i]);
+				const auto* transform = registry.try_get<TransformComponent>(moved[i]);
+				if (physics == nullptr || transform == nullptr) continue;
+
+				physics->GetWorldBounds(transform->model, m_min[it->second], m_max[it->second]);
+				changed.store(true, std::memory_order_relaxed);
+			}
+		});
+		return changed;
+	}
+
+	// Append the queued bodies' ends unsorted, the next sort moves them into place
+	uint32_t AddBodies()
+	{
+		auto& registry = ECS::Get();
+		uint32_t added = 0;
+
+		// Entities without a transform yet are kept until they have one
+		std::vector<entt::entity> pending;
+		for (entt::entity entity : m_added)
+		{
+			if (!registry.valid(entity) || m_bodyIndex.count(entity) != 0) continue;
+			const auto* physics = registry.try_get<PhysicsComponent>(entity);
+			const auto* transform = registry.try_get<TransformComponent>(entity);
+			if (physics == nullptr) continue;
+			if (transform == nullptr)
+			{
+				pending.push_back(entity);
+				continue;
+			}
+
+			const uint32_t body = m_entities.size();
+			m_bodyIndex[entity] = body;
+			m_entities.push_back(entity);
+			physics->GetWorldBounds(transform->model, m_min.emplace_back(), m_max.emplace_back());
+			for (uint32_t axis = 0; axis < 3; ++axis)
+			{
+				m_endpoints[axis].push_back({ m_min[body][axis], body << 1 });
+				m_endpoints[axis].push_back({ m_max[body][axis], (body << 1) | 1 });
+			}
+			++added;
+		}
+		m_added = std::move(pending);
+		return added;
+	}
+
+	void RefreshEndpoints(uint32_t axis)
+	{
+		std::vector<Endpoint>& endpoints = m_endpoints[axis];
+		JobSystem::ParallelFor(endpoints.size(), 4096, [this, &endpoints, axis](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; ++i)
+			{
+				Endpoint& endpoint = endpoints[i];
+				endpoint.value = endpoint.IsMax() ? m_max[endpoint.Body()][axis] : m_min[endpoint.Body()][axis];
+			}
+		});
+	}
+
+	// Insertion sort, each swap of ends of different bodies is a change in overlap.
+	// Every pair of ends swaps at most once, so the pair set ends up matching the
+	// boxes no matter which axis sees the change first
+	void Sort(uint32_t axis, SpatialStats::Counters& counters)
+	{
+		std::vector<Endpoint>& endpoints = m_endpoints[axis];
+		for (uint32_t i = 1; i < endpoints.size(); ++i)
+		{
+			const Endpoint endpoint = endpoints[i];
+			uint32_t j = i;
+			while (j > 0 && endpoint < endpoints[j - 1])
+			{
+				const Endpoint& previous = endpoints[j - 1];
+				if (previous.IsMax() && !endpoint.IsMax())
+				{
+					// The min passed a max, they may overlap now
+					++counters.narrowPhaseTests;
+					if (Overlap(previous.Body(), endpoint.Body()))
+						AddPair(previous.Body(), endpoint.Body());
+				}
+				else if (!previous.IsMax() && endpoint.IsMax())
+				{
+					// The max passed a min, they are apart along this axis
+					RemovePair(previous.Body(), endpoint.Body());
+				}
+				endpoints[j] = previous;
+				--j;
+				++counters.visitedNodes;
+			}
+			endpoints[j] = endpoint;
+		}
+	}
+
+	// Sort every axis from scratch and sweep the first one for the pairs, then
+	// report the difference to the previous pairs
+	void Rebuild()
+	{
+		SpatialStats::Counters counters;
+		for (uint32_t axis = 0; axis < 3; ++axis)
+		{
+			RefreshEndpoints(axis);
+			std::sort(m_endpoints[axis].begin(), m_endpoints[axis].end());
+		}
+
+		std::unordered_set<uint64_t> pairs;
+		std::vector<uint32_t> active;
+		std::vector<uint32_t> activeIndex(m_entities.size());
+		for (const Endpoint& endpoint : m_endpoints[0])
+		{
+			const uint32_t body = endpoint.Body();
+			++counters.visitedNodes;
+			if (endpoint.IsMax())
+			{
+				const uint32_t index = activeIndex[body];
+				active[index] = active.back();
+				activeIndex[active[index]] = index;
+				active.pop_back();
+				continue;
+			}
+
+			for (uint32_t other : active)
+			{
+				++counters.narrowPhaseTests;
+				if (Overlap(body, other))
+					pairs.insert(PairKey(m_entities[body], m_entities[other]));
+			}
+			activeIndex[body] = active.size();
+			active.push_back(body);
+		}
+
+		for (uint64_t key : pairs)
+		{
+			if (m_pairs.count(key) == 0)
+				m_addedPairs.push_back(KeyPair(key));
+		}
+		for (uint64_t key : m_pairs)
+		{
+			if (pairs.count(key) == 0)
+				m_removedPairs.push_back(KeyPair(key));
+		}
+		m_pairs = std::move(pairs);
+		m_stats.collision.Add(counters);
+		++m_stats.rebuilds;
+	}
+
+	void GatherStats()
+	{
+		m_stats.objectCount = m_entities.size();
+		m_stats.memoryBytes = 3 * m_endpoints[0].size() * sizeof(Endpoint) +
+			m_entities.size() * (sizeof(entt::entity) + 2 * sizeof(glm::vec3)) +
+			m_pairs.size() * sizeof(uint64_t);
+	}
+
+	// Bodies, indexed the same across these
+	std::vector<entt::entity> m_entities;
+	std::vector<glm::vec3> m_min;
+	std::vector<glm::vec3> m_max;
+	std::unordered_map<entt::entity, uint32_t> m_bodyIndex;
+
+	// Queued by the signals until the next update
+	std::vector<entt::entity> m_added;
+	std::vector<entt::entity> m_removed;
+
+	std::array<std::vector<Endpoint>, 3> m_endpoints;
+
+	// Overlapping pairs keyed by their entities, lower one in the upper bits
+	std::unordered_set<uint64_t> m_pairs;
+	std::vector<Pair> m_addedPairs;
+	std::vector<Pair> m_removedPairs;
+
+	bool m_initialized = false;
+	SpatialStats m_stats;
+};
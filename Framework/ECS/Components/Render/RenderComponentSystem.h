@@ -5,6 +5,7 @@ class RenderComponentSystem : public ComponentSystem
 public:
 	void Update(float dt) override {};
 
+#ifndef BK_HEADLESS
 	template <typename ComponentType>
 	void RenderEntities(vk::CommandBuffer commandBuffer,
 						vk::DescriptorSet descriptorSet,
@@ -34,6 +35,38 @@ public:
 		});
 	}
 
+	// Render only the given entities in order, e.g. the result of a visibility query
+	template <typename ComponentType>
+	void RenderEntities(vk::CommandBuffer commandBuffer,
+						vk::DescriptorSet descriptorSet,
+						vk::PipelineLayout pipelineLayout,
+						const std::vector<entt::entity>& entities)
+	{
+		commandBuffer.bindDescriptorSets(
+			vk::PipelineBindPoint::eGraphics,
+			pipelineLayout,
+			0,
+			1,
+			&descriptorSet,
+			0,
+			nullptr
+		);
+
+		auto& registry = ECS::Get();
+		for (entt::entity entity : entities)
+		{
+			if (!registry.valid(entity)) continue;
+			const auto* transform = registry.try_get<TransformComponent>(entity);
+			const auto* render = registry.try_get<ComponentType>(entity);
+			if (transform == nullptr || render == nullptr) continue;
+
+			render->mesh.Bind(commandBuffer);
+			transform->PushModel(commandBuffer, pipelineLayout);
+			render->mesh.Draw(commandBuffer);
+		}
+	}
+#endif
+
 	//template <>
 	//void RenderEntities<DeferredRenderComponent>(vk::CommandBuffer commandBuffer,
 	//											 vk::DescriptorSet descriptorSet,
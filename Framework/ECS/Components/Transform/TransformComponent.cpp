@@ -22,6 +22,7 @@ void TransformComponent::SetRotation(const glm::vec3& rotation)
 	dirty = true;
 }
 
+#ifndef BK_HEADLESS
 void TransformComponent::PushModel(vk::CommandBuffer commandBuffer, vk::PipelineLayout pipelineLayout) const
 {
 	commandBuffer.pushConstants(
@@ -30,6 +31,7 @@ void TransformComponent::PushModel(vk::CommandBuffer commandBuffer, vk::Pipeline
 		0, sizeof(glm::mat4), &model
 	);
 }
+#endif
 
 void TransformComponent::UpdateModel()
 {
@@ -17,8 +17,10 @@ public:
 	glm::mat4 model = glm::mat4(1.0f);
 	bool dirty = false;
 
+#ifndef BK_HEADLESS
 	void PushModel(vk::CommandBuffer commandBuffer,
 				   vk::PipelineLayout pipelineLayout) const;
+#endif
 	void UpdateModel();
 
 	inline const glm::vec3& GetPosition() const { return m_position; }
@@ -7,9 +7,18 @@ public:
 	{
 		auto& reg = ECS::Get();
 		auto view = reg.view<TransformComponent>();
-		view.each([](TransformComponent& transform)
+		m_updated.clear();
+		view.each([this](const entt::entity entity, TransformComponent& transform)
 		{
-			if (transform.dirty) transform.UpdateModel();
+			if (!transform.dirty) return;
+			transform.UpdateModel();
+			m_updated.push_back(entity);
 		});
 	}
+
+	// Entities whose model was rebuilt by the last update
+	const std::vector<entt::entity>& GetUpdated() const { return m_updated; }
+
+private:
+	std::vector<entt::entity> m_updated;
 };
@@ -10,6 +10,73 @@ namespace bk {
 
 class Device;
 
+#ifdef BK_HEADLESS
+// Headless buffers are plain arrays in system memory, "mapped" for as long as they live
+template<class VertexType>
+class VertexBuffer
+{
+public:
+	VertexBuffer() = default;
+
+	VertexBuffer(const std::vector<VertexType>& vertices, bool dynamic, Device* owner)
+		: vertices(vertices)
+	{
+		assert(!vertices.empty());
+	}
+
+	void UpdateData(void* data, size_t size, uint32_t newVertexCount, bool submitToGPU)
+	{
+		const auto* first = reinterpret_cast<const VertexType*>(data);
+		vertices.assign(first, first + newVertexCount);
+	}
+
+	void* GetMappedData() { return vertices.data(); }
+	[[nodiscard]] const void* GetMappedData() const { return vertices.data(); }
+
+	[[nodiscard]] uint32_t GetVertexCount() const
+	{
+		return vertices.size();
+	}
+
+	void Destroy()
+	{
+		vertices.clear();
+	}
+
+private:
+	std::vector<VertexType> vertices;
+};
+
+
+class IndexBuffer
+{
+public:
+	IndexBuffer() = default;
+
+	IndexBuffer(const std::vector<uint32_t>& indices, bool dynamic, Device* owner)
+		: indices(indices)
+	{
+		assert(!indices.empty());
+	}
+
+	void UpdateData(void* data, size_t size, uint32_t newIndexCount, bool submitToGPU)
+	{
+		const auto* first = reinterpret_cast<const uint32_t*>(data);
+		indices.assign(first, first + newIndexCount);
+	}
+
+	void* GetMappedData() { return indices.data(); }
+	[[nodiscard]] const void* GetMappedData() const { return indices.data(); }
+
+	[[nodiscard]] uint32_t GetIndexCount() const
+	{
+		return indices.size();
+	}
+
+private:
+	std::vector<uint32_t> indices;
+};
+#else
 class Buffer : public IVulkanType<vk::Buffer, VkBuffer>, public IOwned<Device>
 {
 public:
@@ -152,5 +219,6 @@ BK_TYPE_OWNED_BODY(IndexBuffer, Buffer)
 private:
 	uint32_t indexCount = 0;
 };
+#endif
 
-}
\ No newline at end of file
+}
@@ -8,6 +8,14 @@
 #pragma once
 namespace bk {
 
+#ifdef BK_HEADLESS
+// Nothing is ever sent to a GPU, so there is nothing to wait on
+class Device
+{
+public:
+	void waitIdle() const {}
+};
+#else
 class Device : public IVulkanType<vk::Device>, public IOwned<PhysicalDevice>
 {
 public:
@@ -55,4 +63,6 @@ private:
 	void RecreateSurface();
 };
 
+#endif
+
 }
\ No newline at end of file
@@ -169,6 +169,7 @@ public:
 	}
 
 
+#ifndef BK_HEADLESS
 	void StageDynamic(vk::CommandBuffer commandBuffer)
 	{
 		vertexBuffer.StageTransferDynamic(commandBuffer);
@@ -177,6 +178,7 @@ public:
 			indexBuffer.StageTransferDynamic(commandBuffer);
 		}
 	}
+#endif
 
 
 	static Mesh::Data LoadModel(const std::string& path);
@@ -186,6 +188,7 @@ public:
 		ASSERT(false, "There is no template specialization for this model creation.");
 	}
 
+#ifndef BK_HEADLESS
 	void Bind(vk::CommandBuffer commandBuffer) const
 	{
 		vk::DeviceSize offset = 0;
@@ -206,6 +209,16 @@ public:
 		commandBuffer.draw(GetVertexCount(), 1, 0, 0);
 	}
 
+	// Draw a range of the index buffer, indices are relative to vertexOffset
+	void Draw(vk::CommandBuffer commandBuffer,
+			  uint32_t indexCount,
+			  uint32_t firstIndex,
+			  int32_t vertexOffset) const
+	{
+		commandBuffer.drawIndexed(indexCount, 1, firstIndex, vertexOffset, 0);
+	}
+#endif
+
 	void SetModel(const glm::mat4& model)
 	{
 		this->model = model;
@@ -307,15 +320,65 @@ public:
 		float* minDistance = nullptr
 	);
 
+	// IsStraddlingPlane against each of the planes, reading the vertices once
+	static void IsStraddlingPlanes(
+		const VertexType* vertices,
+		const uint32_t vertexCount,
+		const Primitives::Plane* planes,
+		const uint32_t planeCount,
+		int* straddles,
+		float* minDistances = nullptr
+	);
+
 
 	// Returns front-facing and back-facing mesh relative to the plane respectively
 	[[nodiscard]] std::pair<Mesh<VertexType>, Mesh<VertexType>> Clip(const Primitives::Plane& plane) const;
 
+	// From this many triangles Clip splits the work across the job system workers,
+	// the output is the same either way
+	inline static uint32_t ParallelClipTriangles = 1 << 16;
+
+	// Vertices made on split edges interpolate every attribute of the vertex type.
+	// Optionally outputs the index of the input triangle each output triangle came from
 	static void Clip(
 		const Mesh<VertexType>::Data& data,
 		const Primitives::Plane& plane,
 		Mesh<VertexType>::Data& front,
-		Mesh<VertexType>::Data& back
+		Mesh<VertexType>::Data& back,
+		std::vector<uint32_t>* frontTriangles = nullptr,
+		std::vector<uint32_t>* backTriangles = nullptr
+	);
+
+	// Clip of the triangles in [firstTriangle, lastTriangle) once the sides of the vertices
+	// are known. Vertices are output in the order the range first uses them, optionally
+	// with a key each, (v << 32) | v for input vertex v and (a << 32) | b for the split of
+	// edge a < b
+	static void ClipTriangles(
+		const Mesh<VertexType>::Data& data,
+		const float* distances,
+		const int* sides,
+		uint32_t firstTriangle,
+		uint32_t lastTriangle,
+		Mesh<VertexType>::Data& front,
+		Mesh<VertexType>::Data& back,
+		std::vector<uint32_t>* frontTriangles,
+		std::vector<uint32_t>* backTriangles,
+		std::vector<uint64_t>* frontKeys = nullptr,
+		std::vector<uint64_t>* backKeys = nullptr
+	);
+
+	// Clips by the x, y and z planes through center in a single pass, same as Clip by
+	// each in turn. Octant i is in front of the plane of axis k when bit k of i is set.
+	// The outputs are arrays of 8, minDistances is the smallest distance of an octant's
+	// vertices to each plane. Stops and returns false as soon as a side gets more than
+	// maxSideTriangles after any of the planes, leaving the outputs incomplete
+	static bool SplitOctants(
+		const Mesh<VertexType>::Data& data,
+		const glm::vec3& center,
+		Mesh<VertexType>::Data* octants,
+		std::vector<uint32_t>* octantTriangles = nullptr,
+		glm::vec3* minDistances = nullptr,
+		uint32_t maxSideTriangles = UINT32_MAX
 	);
 
 	static Primitives::Box GetBoundingBox(const VertexType* vertices, const uint32_t vertexCount);
@@ -353,42 +416,12 @@ glm::vec3 Mesh<VertexType>::GetFurthestVertexPosition(const glm::vec3& direction
 template<class VertexType>
 Primitives::Box Mesh<VertexType>::GetBoundingBox(const VertexType* vertices, const uint32_t vertexCount)
 {
-	glm::vec3 minX, minY, minZ;
-	glm::vec3 maxX, maxY, maxZ;
-
-	auto GetExtremePoints = [vertices, vertexCount](auto& min, auto& max, const auto& dir)
-	{
-		float minProj = FLT_MAX;
-		float maxProj = -FLT_MAX;
-		int indexMin = 0, indexMax = 0;
-
-		for (int i = 0; i < vertexCount; ++i)
-		{
-			float proj = glm::dot(vertices[i].pos, dir);
-
-			if (proj < minProj)
-			{
-				minProj = proj;
-				indexMin = i;
-			}
-			if (proj > maxProj)
-			{
-				maxProj = proj;
-				indexMax = i;
-			}
-		}
-		min = vertices[indexMin].pos;
-		max = vertices[indexMax].pos;
-	};
-
-	GetExtremePoints(minX, maxX, glm::vec3(1.0f, 0.0f, 0.0f));
-	GetExtremePoints(minY, maxY, glm::vec3(0.0f, 1.0f, 0.0f));
-	GetExtremePoints(minZ, maxZ, glm::vec3(0.0f, 0.0f, 1.0f));
-
+	glm::vec3 min, max;
+	MeshKernels::GetBounds(PositionView::FromVertices(vertices, vertexCount), min, max);
 
 	Primitives::Box bb;
-	bb.position = glm::vec3(maxX.x + minX.x, maxY.y + minY.y, maxZ.z + minZ.z) * 0.5f;
-	bb.halfExtent = glm::vec3(maxX.x - minX.x, maxY.y - minY.y, maxZ.z - minZ.z) * 0.5f;
+	bb.position = (max + min) * 0.5f;
+	bb.halfExtent = (max - min) * 0.5f;
 
 	return bb;
 }
@@ -408,51 +441,39 @@ int Mesh<VertexType>::IsStraddlingPlane(
 	float* minDistance
 )
 {
-	uint32_t positive = 0;
-	uint32_t negative = 0;
-
-	float minDist = std::numeric_limits<float>::max();
+	if (vertexCount >= MeshKernels::MinimumCount)
+		return MeshKernels::ClassifyPlane(PositionView::FromVertices(vertices, vertexCount), plane, minDistance);
 
-	//ASSERT(planeDistance.size() == size, "Incorrect size for input bool vector");
-	for (int i = 0; i < vertexCount; ++i)
+	// Single triangles, like Clip tests, are cheaper without the call
+	bool positive = false, negative = false;
+	float minDist = FLT_MAX;
+	for (uint32_t i = 0; i < vertexCount; ++i)
 	{
-		const glm::vec3& vert = vertices[i].pos;
-		float distance = glm::dot(plane.normal, vert - plane.position);
-		if (distance > Primitives::Plane::thickness)
-		{
-			++positive;
-		}
-		else if (distance < -Primitives::Plane::thickness)
-		{
-			++negative;
-		}
-
-
-		if (minDistance != nullptr)
-		{
-			float absDist = std::abs(distance);
-			if (absDist < minDist)
-			{
-				minDist = absDist;
-			}
-		}
+		float distance = glm::dot(plane.normal, vertices[i].pos - plane.position);
+		positive |= distance > Primitives::Plane::thickness;
+		negative |= distance < -Primitives::Plane::thickness;
+		minDist = std::abs(distance) < minDist ? std::abs(distance) : minDist;
 	}
 
 	if (minDistance != nullptr)
-	{
 		*minDistance = minDist;
-	}
-
 	if (!negative && !positive)
-	{
 		return 1;
-	}
-
-	int straddle = 0;
-	straddle += negative == 0;
-	straddle -= positive == 0;
+	return static_cast<int>(!negative) - static_cast<int>(!positive);
+}
 
-	return straddle;
+template<class VertexType>
+void Mesh<VertexType>::IsStraddlingPlanes(
+	const VertexType* vertices,
+	const uint32_t vertexCount,
+	const Primitives::Plane* planes,
+	const uint32_t planeCount,
+	int* straddles,
+	float* minDistances
+)
+{
+	MeshKernels::ClassifyPlanes(PositionView::FromVertices(vertices, vertexCount), planes, planeCount,
+								straddles, minDistances);
 }
 
 
@@ -490,212 +511,699 @@ void Mesh<VertexType>::Clip(
 	const Mesh<VertexType>::Data& data,
 	const Primitives::Plane& plane,
 	Mesh<VertexType>::Data& front,
-	Mesh<VertexType>::Data& back
+	Mesh<VertexType>::Data& back,
+	std::vector<uint32_t>* frontTriangles,
+	std::vector<uint32_t>* backTriangles
 )
 {
-	int frontCount = 0, backCount = 0;
-
-	int size = data.indices.size();
-	ASSERT(size % 3 == 0, "Incorrect number of vertices attempted to be split");
-	ASSERT(data.indices.size() != 0, "Non-indexed triangles not supported for octree");
-	std::vector<glm::vec3> frontVerts, backVerts;
-	frontVerts.resize(size * 4 / 3);
-	backVerts.resize(size * 4 / 3);
-
-	// Used to store per triangle if it is a quad
-	std::vector<bool> frontQuads(size / 3);
-	std::vector<bool> backQuads(size / 3);
-
-	int currentFrontFaceVertCount = 0;
-	int currentBackFaceVertCount = 0;
-	int frontFaceCount = 0;
-	int backFaceCount = 0;
+	const uint32_t vertexCount = data.vertices.size();
+	const uint32_t indexCount = data.indices.size();
+	ASSERT(indexCount % 3 == 0, "Incorrect number of vertices attempted to be split");
+	ASSERT(indexCount != 0, "Non-indexed triangles not supported for octree");
+
+	// Scratch kept per thread between calls, builds clip from many jobs at once. Jobs
+	// must go through these pointers, naming a thread_local there gets the worker's own
+	thread_local std::vector<float> distanceScratch;
+	thread_local std::vector<int> sideScratch;
+	distanceScratch.resize(vertexCount);
+	sideScratch.resize(vertexCount);
+	float* distances = distanceScratch.data();
+	int* sides = sideScratch.data();
+
+	auto Classify = [&data, &plane, distances, sides](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t i = begin; i < end; ++i)
+		{
+			const float distance = glm::dot(plane.normal, data.vertices[i].pos - plane.position);
+			distances[i] = distance;
+			sides[i] = distance > Primitives::Plane::thickness ? Primitives::PointPlaneStatus::Front :
+				distance < -Primitives::Plane::thickness ? Primitives::PointPlaneStatus::Back :
+				Primitives::PointPlaneStatus::Coplanar;
+		}
+	};
 
-	bool triCross = false;
+	const uint32_t triangleCount = indexCount / 3;
+	if (triangleCount < ParallelClipTriangles || JobSystem::ThreadCount <= 1 || JobSystem::IsWorker())
+	{
+		Classify(0, vertexCount);
+		ClipTriangles(data, distances, sides, 0, triangleCount, front, back, frontTriangles, backTriangles);
+		return;
+	}
 
-	for (int i = 0; i < size; i += 3)
+	// Large meshes are clipped in one range of triangles per worker, each numbering
+	// its vertices on its own. They are then numbered in the order the whole mesh
+	// first uses them, so that the output is the same as clipping it in one go
+	struct Chunk
 	{
-		uint32_t indices[3] = {
-			data.indices[i + 0],
-			data.indices[i + 1],
-			data.indices[i + 2],
-		};
+		Mesh<VertexType>::Data front, back;
+		std::vector<uint32_t> frontTriangles, backTriangles;
+		std::vector<uint64_t> frontKeys, backKeys;
+		// Output index of each chunk vertex, with Owned set in the chunk that first uses it
+		std::vector<uint32_t> frontRemap, backRemap;
+		uint32_t frontIndexOffset = 0, backIndexOffset = 0;
+	};
+	constexpr uint32_t Owned = 1u << 31;
+	constexpr uint32_t Unused = ~0u;
 
-		PosVertex tri[3] = {
-			data.vertices[indices[0]],
-			data.vertices[indices[1]],
-			data.vertices[indices[2]]
-		};
+	JobSystem::ParallelFor(vertexCount, Classify);
 
-		int straddle = IsStraddlingPlane(tri, 3u, plane);
-		if (straddle != 0)
+	const uint32_t chunkSize = (triangleCount + JobSystem::ThreadCount - 1) / JobSystem::ThreadCount;
+	std::vector<Chunk> chunks((triangleCount + chunkSize - 1) / chunkSize);
+	JobSystem::ParallelFor(triangleCount, chunkSize,
+		[&data, distances, sides, &chunks, chunkSize](uint32_t begin, uint32_t end)
 		{
-			if (straddle == 1)
+			Chunk& chunk = chunks[begin / chunkSize];
+			ClipTriangles(data, distances, sides, begin, end, chunk.front, chunk.back,
+						  &chunk.frontTriangles, &chunk.backTriangles, &chunk.frontKeys, &chunk.backKeys);
+		});
+
+	// Number the vertices in chunk order, a vertex is new the first time any chunk uses it
+	uint32_t splitCount = 0;
+	for (const Chunk& chunk : chunks)
+		for (uint64_t key : chunk.frontKeys)
+			splitCount += (key >> 32) != (key & 0xFFFFFFFFu);
+
+	struct EdgeSplit
+	{
+		uint64_t key = 0;
+		uint32_t front = Unused;
+		uint32_t back = Unused;
+	};
+	thread_local std::vector<uint32_t> frontRemap, backRemap;
+	thread_local std::vector<EdgeSplit> edgeSplits;
+	frontRemap.assign(vertexCount, Unused);
+	backRemap.assign(vertexCount, Unused);
+	uint32_t edgeSize = 4;
+	while (edgeSize < 2 * splitCount)
+		edgeSize *= 2;
+	edgeSplits.assign(edgeSize, EdgeSplit());
+
+	auto Number = [&](const std::vector<uint64_t>& keys,
+					  std::vector<uint32_t>& remap,
+					  uint32_t EdgeSplit::* side,
+					  std::vector<uint32_t>& chunkRemap,
+					  uint32_t& count)
+	{
+		chunkRemap.resize(keys.size());
+		for (uint32_t i = 0; i < keys.size(); ++i)
+		{
+			const uint64_t key = keys[i];
+			const uint32_t a = static_cast<uint32_t>(key >> 32), b = static_cast<uint32_t>(key);
+			uint32_t* index = &remap[a];
+			if (a != b)
 			{
-				for (int j = 0; j < 3; ++j)
-					frontVerts[frontCount++] = tri[j].pos;
-				// All on one side, not a quad
-				frontQuads[frontFaceCount++] = false;
+				uint32_t slot = static_cast<uint32_t>((key * 0x9E3779B97F4A7C15ull) >> 32) & (edgeSize - 1);
+				while (edgeSplits[slot].key != 0 && edgeSplits[slot].key != key)
+					slot = (slot + 1) & (edgeSize - 1);
+				edgeSplits[slot].key = key;
+				index = &(edgeSplits[slot].*side);
 			}
-			else
+
+			if (*index == Unused)
 			{
-				for (int j = 0; j < 3; ++j)
-					backVerts[backCount++] = tri[j].pos;
-				// All on one side, not a quad
-				backQuads[backFaceCount++] = false;
+				*index = count++;
+				chunkRemap[i] = *index | Owned;
 			}
+			else
+				chunkRemap[i] = *index;
+		}
+	};
+
+	uint32_t frontVertexCount = 0, backVertexCount = 0;
+	uint32_t frontIndexCount = 0, backIndexCount = 0;
+	for (Chunk& chunk : chunks)
+	{
+		Number(chunk.frontKeys, frontRemap, &EdgeSplit::front, chunk.frontRemap, frontVertexCount);
+		Number(chunk.backKeys, backRemap, &EdgeSplit::back, chunk.backRemap, backVertexCount);
+		chunk.frontIndexOffset = frontIndexCount;
+		chunk.backIndexOffset = backIndexCount;
+		frontIndexCount += chunk.front.indices.size();
+		backIndexCount += chunk.back.indices.size();
+	}
+
+	front.vertices.clear();
+	front.indices.clear();
+	back.vertices.clear();
+	back.indices.clear();
+	front.vertices.resize(frontVertexCount);
+	front.indices.resize(frontIndexCount);
+	back.vertices.resize(backVertexCount);
+	back.indices.resize(backIndexCount);
+	if (frontTriangles != nullptr)
+		frontTriangles->resize(frontIndexCount / 3);
+	if (backTriangles != nullptr)
+		backTriangles->resize(backIndexCount / 3);
+
+	// Copy each chunk to its place, vertices only by the chunk that owns them
+	auto Gather = [](const Mesh<VertexType>::Data& in,
+					 const std::vector<uint32_t>& inTriangles,
+					 const std::vector<uint32_t>& remap,
+					 uint32_t indexOffset,
+					 Mesh<VertexType>::Data& out,
+					 std::vector<uint32_t>* outTriangles)
+	{
+		for (uint32_t i = 0; i < in.vertices.size(); ++i)
+		{
+			if (remap[i] & Owned)
+				out.vertices[remap[i] & ~Owned] = in.vertices[i];
+		}
+		for (uint32_t i = 0; i < in.indices.size(); ++i)
+			out.indices[indexOffset + i] = remap[in.indices[i]] & ~Owned;
+		if (outTriangles != nullptr)
+			std::copy(inTriangles.begin(), inTriangles.end(), outTriangles->begin() + indexOffset / 3);
+	};
+	JobSystem::ParallelFor(chunks.size(), 1, [&](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t c = begin; c < end; ++c)
+		{
+			const Chunk& chunk = chunks[c];
+			Gather(chunk.front, chunk.frontTriangles, chunk.frontRemap, chunk.frontIndexOffset, front, frontTriangles);
+			Gather(chunk.back, chunk.backTriangles, chunk.backRemap, chunk.backIndexOffset, back, backTriangles);
+		}
+	});
+}
+
+template<class VertexType>
+void Mesh<VertexType>::ClipTriangles(
+	const Mesh<VertexType>::Data& data,
+	const float* distances,
+	const int* sides,
+	uint32_t firstTriangle,
+	uint32_t lastTriangle,
+	Mesh<VertexType>::Data& front,
+	Mesh<VertexType>::Data& back,
+	std::vector<uint32_t>* frontTriangles,
+	std::vector<uint32_t>* backTriangles,
+	std::vector<uint64_t>* frontKeys,
+	std::vector<uint64_t>* backKeys
+)
+{
+	const uint32_t firstIndex = 3 * firstTriangle, lastIndex = 3 * lastTriangle;
+
+	constexpr uint32_t Unused = ~0u;
+	// Output vertices of an edge the plane splits, keyed by its lower and higher input index
+	struct EdgeSplit
+	{
+		uint64_t key = 0;
+		uint32_t front = 0;
+		uint32_t back = 0;
+	};
+	thread_local std::vector<uint32_t> frontRemap, backRemap;
+	thread_local std::vector<EdgeSplit> edgeSplits;
+
+	// Count first so that the outputs are allocated once. A straddling triangle
+	// leaves at most a quad on each side and splits at most two edges
+	uint32_t frontOnly = 0, backOnly = 0, straddling = 0;
+	uint32_t minVertex = UINT32_MAX, maxVertex = 0;
+	for (uint32_t i = firstIndex; i < lastIndex; i += 3)
+	{
+		const uint32_t* triangle = &data.indices[i];
+		const int s0 = sides[triangle[0]], s1 = sides[triangle[1]], s2 = sides[triangle[2]];
+		const bool anyFront = s0 == Primitives::PointPlaneStatus::Front || s1 == Primitives::PointPlaneStatus::Front ||
+			s2 == Primitives::PointPlaneStatus::Front;
+		const bool anyBack = s0 == Primitives::PointPlaneStatus::Back || s1 == Primitives::PointPlaneStatus::Back ||
+			s2 == Primitives::PointPlaneStatus::Back;
+		frontOnly += !anyBack;
+		backOnly += anyBack && !anyFront;
+		straddling += anyBack && anyFront;
+		minVertex = std::min({ minVertex, triangle[0], triangle[1], triangle[2] });
+		maxVertex = std::max({ maxVertex, triangle[0], triangle[1], triangle[2] });
+	}
+
+	// Ranges of triangles mostly use a range of the vertices, only that is remapped
+	const uint32_t vertexCount = maxVertex - minVertex + 1;
+	frontRemap.assign(vertexCount, Unused);
+	backRemap.assign(vertexCount, Unused);
+
+	front.vertices.clear();
+	front.indices.clear();
+	back.vertices.clear();
+	back.indices.clear();
+	front.vertices.reserve(std::min(vertexCount, 3 * (frontOnly + straddling)) + 2 * straddling);
+	back.vertices.reserve(std::min(vertexCount, 3 * (backOnly + straddling)) + 2 * straddling);
+	front.indices.reserve(3 * frontOnly + 6 * straddling);
+	back.indices.reserve(3 * backOnly + 6 * straddling);
+	if (frontTriangles != nullptr)
+	{
+		frontTriangles->clear();
+		frontTriangles->reserve(frontOnly + 2 * straddling);
+	}
+	if (backTriangles != nullptr)
+	{
+		backTriangles->clear();
+		backTriangles->reserve(backOnly + 2 * straddling);
+	}
+	if (frontKeys != nullptr)
+	{
+		frontKeys->clear();
+		frontKeys->reserve(front.vertices.capacity());
+	}
+	if (backKeys != nullptr)
+	{
+		backKeys->clear();
+		backKeys->reserve(back.vertices.capacity());
+	}
+
+	// Open addressing at most half full, the key of an edge is never 0 as its
+	// higher index is at least 1
+	uint32_t edgeMask = 0;
+	if (straddling > 0)
+	{
+		uint32_t size = 4;
+		while (size < 4 * straddling)
+			size *= 2;
+		edgeSplits.assign(size, EdgeSplit());
+		edgeMask = size - 1;
+	}
+
+	// Input vertices are copied to a side the first time a triangle there uses them
+	auto Keep = [&data, minVertex](Mesh<VertexType>::Data& out,
+								   std::vector<uint32_t>& remap,
+								   std::vector<uint64_t>* keys,
+								   uint32_t vertex)
+	{
+		uint32_t& index = remap[vertex - minVertex];
+		if (index == Unused)
+		{
+			index = out.vertices.size();
+			out.vertices.push_back(data.vertices[vertex]);
+			if (keys != nullptr)
+				keys->push_back((static_cast<uint64_t>(vertex) << 32) | vertex);
+		}
+		return index;
+	};
+
+	// Both triangles sharing an edge get the same intersection, it is always
+	// computed from the lower index so that it doesn't depend on the winding
+	auto Split = [&](uint32_t a, uint32_t b) -> const EdgeSplit&
+	{
+		if (a > b) std::swap(a, b);
+		const uint64_t key = (static_cast<uint64_t>(a) << 32) | b;
+		uint32_t slot = static_cast<uint32_t>((key * 0x9E3779B97F4A7C15ull) >> 32) & edgeMask;
+		while (edgeSplits[slot].key != 0 && edgeSplits[slot].key != key)
+			slot = (slot + 1) & edgeMask;
+
+		EdgeSplit& split = edgeSplits[slot];
+		if (split.key == 0)
+		{
+			const float t = distances[a] / (distances[a] - distances[b]);
+			const VertexType vertex = Interpolate(data.vertices[a], data.vertices[b], t);
+			split = { key, static_cast<uint32_t>(front.vertices.size()), static_cast<uint32_t>(back.vertices.size()) };
+			front.vertices.push_back(vertex);
+			back.vertices.push_back(vertex);
+			if (frontKeys != nullptr)
+				frontKeys->push_back(key);
+			if (backKeys != nullptr)
+				backKeys->push_back(key);
+		}
+		return split;
+	};
+
+	auto Emit = [](const uint32_t* polygon,
+				   uint32_t size,
+				   uint32_t source,
+				   Mesh<VertexType>::Data& out,
+				   std::vector<uint32_t>* sources)
+	{
+		// Fan out from the first vertex, a quad becomes 0 1 2 and 0 2 3
+		for (uint32_t k = 1; k + 1 < size; ++k)
+		{
+			out.indices.insert(out.indices.end(), { polygon[0], polygon[k], polygon[k + 1] });
+			if (sources != nullptr)
+				sources->push_back(source);
+		}
+	};
+
+	for (uint32_t i = firstIndex; i < lastIndex; i += 3)
+	{
+		const uint32_t* triangle = &data.indices[i];
+		const int triangleSides[3] = { sides[triangle[0]], sides[triangle[1]], sides[triangle[2]] };
+		bool anyFront = false, anyBack = false;
+		for (int side : triangleSides)
+		{
+			anyFront |= side == Primitives::PointPlaneStatus::Front;
+			anyBack |= side == Primitives::PointPlaneStatus::Back;
+		}
+
+		// Entirely on one side, coplanar triangles go to the front
+		if (!anyBack || !anyFront)
+		{
+			auto& out = anyBack ? back : front;
+			auto& remap = anyBack ? backRemap : frontRemap;
+			auto* keys = anyBack ? backKeys : frontKeys;
+			const uint32_t polygon[3] = {
+				Keep(out, remap, keys, triangle[0]),
+				Keep(out, remap, keys, triangle[1]),
+				Keep(out, remap, keys, triangle[2])
+			};
+			Emit(polygon, 3, i / 3, out, anyBack ? backTriangles : frontTriangles);
 			continue;
 		}
 
-		auto SplitTriangle =
-			[&](const glm::vec3& a, const glm::vec3& b)
+		// Walk the edges (a, b) and output the part of the triangle on each side
+		uint32_t frontPolygon[4], backPolygon[4];
+		uint32_t frontSize = 0, backSize = 0;
+		for (int j = 0; j < 3; ++j)
+		{
+			const uint32_t a = triangle[j], b = triangle[(j + 1) % 3];
+			const int aSide = triangleSides[j], bSide = triangleSides[(j + 1) % 3];
+			if (bSide == Primitives::PointPlaneStatus::Front)
 			{
-				int aSide = ClassifyPointToPlane(a, plane);
-				int bSide = ClassifyPointToPlane(b, plane);
-				if (bSide == Primitives::PointPlaneStatus::Front)
+				if (aSide == Primitives::PointPlaneStatus::Back)
 				{
-					if (aSide == Primitives::PointPlaneStatus::Back)
-					{
-						Primitives::Ray ray;
-						ray.direction = glm::normalize(b - a);
-						ray.position = a;
-						glm::vec3 i = Primitives::GetRayPlaneIntersection(ray, plane);
-						//ASSERT(ClassifyPointToPlane(i, plane) == Primitives::PointPlaneStatus::Coplanar , "Failed validation of clipping");
-						frontVerts[frontCount++] = backVerts[backCount++] = i;
-						++currentFrontFaceVertCount;
-						++currentBackFaceVertCount;
-					}
-					// In all three cases, output b to the front side
-					frontVerts[frontCount++] = b;
-					++currentFrontFaceVertCount;
+					const EdgeSplit& split = Split(a, b);
+					frontPolygon[frontSize++] = split.front;
+					backPolygon[backSize++] = split.back;
 				}
-				else if (bSide == Primitives::PointPlaneStatus::Back)
+				frontPolygon[frontSize++] = Keep(front, frontRemap, frontKeys, b);
+			}
+			else if (bSide == Primitives::PointPlaneStatus::Back)
+			{
+				if (aSide == Primitives::PointPlaneStatus::Front)
 				{
-					if (aSide == Primitives::PointPlaneStatus::Front)
-					{
-						//float t = da / (da - db);
-						//glm::vec3 i = (1 - t) * a + t * b;
-						Primitives::Ray ray;
-						ray.direction = glm::normalize(b - a);
-						ray.position = a;
-						glm::vec3 i = Primitives::GetRayPlaneIntersection(ray, plane);
-
-						// Edge (a, b) straddles plane, output intersection point
-						//ASSERT(ClassifyPointToPlane(i, plane) == Primitives::PointPlaneStatus::Coplanar, "Failed validation of clipping");
-						frontVerts[frontCount++] = backVerts[backCount++] = i;
-						++currentFrontFaceVertCount;
-						++currentBackFaceVertCount;
-					}
-					else if (aSide == Primitives::PointPlaneStatus::Coplanar)
-					{
-						// Output a when edge (a, b) goes from �on� to �behind� plane
-						backVerts[backCount++] = a;
-						++currentBackFaceVertCount;
-					}
-					// In all three cases, output b to the back side
-					backVerts[backCount++] = b;
-					++currentBackFaceVertCount;
+					const EdgeSplit& split = Split(a, b);
+					frontPolygon[frontSize++] = split.front;
+					backPolygon[backSize++] = split.back;
 				}
-				else
+				else if (aSide == Primitives::PointPlaneStatus::Coplanar)
 				{
-					// b is on the plane. In all three cases output b to the front side
-					frontVerts[frontCount++] = b;
-					++currentFrontFaceVertCount;
-					// In one case, also output b to back side
-					if (aSide == Primitives::PointPlaneStatus::Back)
-					{
-						backVerts[backCount++] = b;
-						++currentBackFaceVertCount;
-					}
+					// Edge going from on the plane to behind it
+					backPolygon[backSize++] = Keep(back, backRemap, backKeys, a);
 				}
-			};
+				backPolygon[backSize++] = Keep(back, backRemap, backKeys, b);
+			}
+			else
+			{
+				// b is on the plane, it goes to the front, and to the back when coming from there
+				frontPolygon[frontSize++] = Keep(front, frontRemap, frontKeys, b);
+				if (aSide == Primitives::PointPlaneStatus::Back)
+					backPolygon[backSize++] = Keep(back, backRemap, backKeys, b);
+			}
+		}
+		ASSERT(frontSize >= 3 && frontSize <= 4, "Invalid number of face points when clipping!");
+		ASSERT(backSize >= 3 && backSize <= 4, "Invalid number of face points when clipping!");
+
+		Emit(frontPolygon, frontSize, i / 3, front, frontTriangles);
+		Emit(backPolygon, backSize, i / 3, back, backTriangles);
+	}
+}
 
-		SplitTriangle(tri[0].pos, tri[1].pos);
-		SplitTriangle(tri[1].pos, tri[2].pos);
-		SplitTriangle(tri[2].pos, tri[0].pos);
-
-		// We have finished this triangle set, output 
-		// whether or not it is a tri or quad
-		ASSERT(currentFrontFaceVertCount == 3 ||
-			   currentFrontFaceVertCount == 4 ||
-			   currentFrontFaceVertCount == 0, "Invalid number of face points when clipping!");
-		ASSERT(currentBackFaceVertCount == 3 ||
-			   currentBackFaceVertCount == 4 ||
-			   currentBackFaceVertCount == 0, "Invalid number of face points when clipping!");
-		if (currentFrontFaceVertCount > 2)
+template<class VertexType>
+bool Mesh<VertexType>::SplitOctants(
+	const Mesh<VertexType>::Data& data,
+	const glm::vec3& center,
+	Mesh<VertexType>::Data* octants,
+	std::vector<uint32_t>* octantTriangles,
+	glm::vec3* minDistances,
+	uint32_t maxSideTriangles
+)
+{
+	const uint32_t vertexCount = data.vertices.size();
+	const uint32_t indexCount = data.indices.size();
+	ASSERT(indexCount % 3 == 0, "Incorrect number of vertices attempted to be split");
+	ASSERT(indexCount != 0, "Non-indexed triangles not supported for octree");
+
+	constexpr uint32_t Unused = ~0u;
+	constexpr uint8_t Straddling = 0xFF;
+	// Vertex a plane creates on an edge, keyed by the edge's lower and higher vertex
+	struct EdgeSplit
+	{
+		uint64_t key = 0;
+		uint32_t axis = 0;
+		uint32_t vertex = 0;
+	};
+	// Part of a triangle, in the octants of the planes clipped by so far
+	struct Piece
+	{
+		uint32_t vertices[3];
+		uint32_t mask;
+		uint32_t source;
+	};
+	// Created vertices are numbered after the input ones. Bits 0-2 of a code are
+	// set in front of each plane and bits 3-5 behind it
+	thread_local std::vector<VertexType> created;
+	thread_local std::vector<glm::vec3> distances;
+	thread_local std::vector<uint8_t> codes;
+	thread_local std::vector<uint8_t> triangleMasks;
+	thread_local std::vector<uint32_t> remap;
+	thread_local std::vector<EdgeSplit> edgeSplits;
+	thread_local std::vector<Piece> pieces, clipped;
+
+	auto Code = [](const glm::vec3& distance)
+	{
+		uint8_t code = 0;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			code |= static_cast<uint8_t>(distance[axis] > Primitives::Plane::thickness) << axis;
+			code |= static_cast<uint8_t>(distance[axis] < -Primitives::Plane::thickness) << (axis + 3);
+		}
+		return code;
+	};
+
+	created.clear();
+	distances.resize(vertexCount);
+	codes.resize(vertexCount);
+	for (uint32_t i = 0; i < vertexCount; ++i)
+	{
+		distances[i] = data.vertices[i].pos - center;
+		codes[i] = Code(distances[i]);
+	}
+	// Output index of each vertex in each octant
+	remap.assign(8 * vertexCount, Unused);
+
+	// Triangles that straddle none of the planes go straight to their octant,
+	// count them so that the outputs are allocated once
+	uint32_t counts[8] = {};
+	// Triangles on each side after the x, y and z planes, the mask of a side
+	// only has the bits of the planes clipped by so far
+	uint32_t sideCounts[3][8] = {};
+	uint32_t straddling = 0;
+	triangleMasks.resize(indexCount / 3);
+	for (uint32_t i = 0; i < indexCount; i += 3)
+	{
+		const uint8_t code = codes[data.indices[i]] | codes[data.indices[i + 1]] | codes[data.indices[i + 2]];
+		const uint8_t front = code & 7, back = code >> 3;
+		if ((front & back) != 0)
 		{
-			frontQuads[frontFaceCount++] = (currentFrontFaceVertCount == 4);
+			triangleMasks[i / 3] = Straddling;
+			++straddling;
+			continue;
 		}
-		if (currentBackFaceVertCount > 2)
+		// Coplanar goes to the front, like in Clip
+		triangleMasks[i / 3] = ~back & 7;
+		++counts[~back & 7];
+	}
+
+	for (uint32_t octant = 0; octant < 8; ++octant)
+	{
+		auto& out = octants[octant];
+		out.vertices.clear();
+		out.indices.clear();
+		out.vertices.reserve(std::min(vertexCount, 3 * counts[octant]));
+		out.indices.reserve(3 * counts[octant]);
+		if (octantTriangles != nullptr)
 		{
-			backQuads[backFaceCount++] = (currentBackFaceVertCount == 4);
+			octantTriangles[octant].clear();
+			octantTriangles[octant].reserve(counts[octant]);
 		}
+		if (minDistances != nullptr)
+			minDistances[octant] = glm::vec3(FLT_MAX);
+	}
+
+	for (uint32_t mask = 0; mask < 8; ++mask)
+		for (uint32_t axis = 0; axis < 3; ++axis)
+			sideCounts[axis][mask & ((2u << axis) - 1)] += counts[mask];
 
-		currentFrontFaceVertCount = 0;
-		currentBackFaceVertCount = 0;
+	// Open addressing at most half full, grown as the planes create vertices
+	uint32_t edgeCount = 0;
+	uint32_t edgeMask = 0;
+	auto Probe = [&](uint64_t key, uint32_t axis)
+	{
+		uint32_t slot = static_cast<uint32_t>((key * 0x9E3779B97F4A7C15ull) >> 32) & edgeMask;
+		while (edgeSplits[slot].key != 0 && (edgeSplits[slot].key != key || edgeSplits[slot].axis != axis))
+			slot = (slot + 1) & edgeMask;
+		return slot;
+	};
+	if (straddling > 0)
+	{
+		uint32_t size = 16;
+		while (size < 8 * straddling)
+			size *= 2;
+		edgeSplits.assign(size, EdgeSplit());
+		edgeMask = size - 1;
 	}
-	frontQuads.resize(frontFaceCount);
-	backQuads.resize(backFaceCount);
 
-	auto SplitQuads =
-		[](
-			const std::vector<bool>& quads,
-			const std::vector<glm::vec3>& input,
-			const int faceVertCount,
-			Mesh<VertexType>::Data& out
-		)
+	auto GetVertex = [&data, &vertexCount](uint32_t vertex) -> const VertexType&
+	{
+		return vertex < vertexCount ? data.vertices[vertex] : created[vertex - vertexCount];
+	};
+
+	auto Side = [](uint8_t code, uint32_t axis)
+	{
+		return (code >> axis) & 1 ? Primitives::PointPlaneStatus::Front :
+			(code >> (axis + 3)) & 1 ? Primitives::PointPlaneStatus::Back :
+			Primitives::PointPlaneStatus::Coplanar;
+	};
+
+	// Both triangles sharing an edge get the same vertex, it is always computed
+	// from the lower index so that it doesn't depend on the winding
+	auto Split = [&](uint32_t a, uint32_t b, uint32_t axis)
+	{
+		if (a > b) std::swap(a, b);
+		if (2 * (edgeCount + 1) > edgeMask + 1)
+		{
+			std::vector<EdgeSplit> splits(2 * (edgeMask + 1));
+			splits.swap(edgeSplits);
+			edgeMask = 2 * edgeMask + 1;
+			for (const EdgeSplit& split : splits)
+				if (split.key != 0)
+					edgeSplits[Probe(split.key, split.axis)] = split;
+		}
+
+		const uint64_t key = (static_cast<uint64_t>(a) << 32) | b;
+		EdgeSplit& split = edgeSplits[Probe(key, axis)];
+		if (split.key == 0)
+		{
+			const float t = distances[a][axis] / (distances[a][axis] - distances[b][axis]);
+			// Copied out first, as adding the vertex can move the created ones
+			const VertexType vertexA = GetVertex(a), vertexB = GetVertex(b);
+			const VertexType vertex = Interpolate(vertexA, vertexB, t);
+			split = { key, axis, static_cast<uint32_t>(vertexCount + created.size()) };
+			created.push_back(vertex);
+			distances.push_back(vertex.pos - center);
+			codes.push_back(Code(distances.back()));
+			remap.insert(remap.end(), 8, Unused);
+			++edgeCount;
+		}
+		return split.vertex;
+	};
+
+	// Vertices are copied to an octant the first time a triangle there uses them
+	auto Keep = [&](uint32_t octant, uint32_t vertex)
+	{
+		uint32_t& index = remap[8 * vertex + octant];
+		if (index == Unused)
 		{
-			int numFaces = quads.size();
+			index = octants[octant].vertices.size();
+			octants[octant].vertices.push_back(GetVertex(vertex));
+			if (minDistances != nullptr)
+				minDistances[octant] = glm::min(minDistances[octant], glm::abs(distances[vertex]));
+		}
+		return index;
+	};
 
-			int numOutputVertices = 0;
-			int numOutputIndices = 0;
-			for (int i = 0; i < numFaces; ++i)
+	auto Emit = [&](const Piece& piece)
+	{
+		auto& out = octants[piece.mask];
+		out.indices.insert(out.indices.end(), {
+			Keep(piece.mask, piece.vertices[0]),
+			Keep(piece.mask, piece.vertices[1]),
+			Keep(piece.mask, piece.vertices[2])
+		});
+		if (octantTriangles != nullptr)
+			octantTriangles[piece.mask].push_back(piece.source);
+	};
+
+	// Clip the straddling triangles by each plane in turn, with the same rules as
+	// Clip. Going plane by plane stops as early as clipping by each would
+	pieces.clear();
+	for (uint32_t i = 0; i < indexCount; i += 3)
+	{
+		if (triangleMasks[i / 3] == Straddling)
+			pieces.push_back({ { data.indices[i], data.indices[i + 1], data.indices[i + 2] }, 0, i / 3 });
+	}
+	for (uint32_t axis = 0; axis < 3 && !pieces.empty(); ++axis)
+	{
+		clipped.clear();
+		for (const Piece& piece : pieces)
+		{
+			const int sides[3] = {
+				Side(codes[piece.vertices[0]], axis),
+				Side(codes[piece.vertices[1]], axis),
+				Side(codes[piece.vertices[2]], axis)
+			};
+			bool anyFront = false, anyBack = false;
+			for (int side : sides)
 			{
-				numOutputVertices += (quads[i] == true) ? 4 : 3;
-				numOutputIndices += (quads[i] == true) ? 6 : 3;
+				anyFront |= side == Primitives::PointPlaneStatus::Front;
+				anyBack |= side == Primitives::PointPlaneStatus::Back;
 			}
 
-			out.vertices.resize(numOutputVertices);
-			out.indices.resize(numOutputIndices);
-
-			for (int i = 0, faceIndex = 0, ii = 0; i < faceVertCount;)
+			if (!anyBack || !anyFront)
 			{
-				bool isQuad = (quads[faceIndex++] == true);
+				clipped.push_back(piece);
+				clipped.back().mask |= static_cast<uint32_t>(!anyBack) << axis;
+				if (++sideCounts[axis][clipped.back().mask] > maxSideTriangles)
+					return false;
+				continue;
+			}
 
-				for (int j = 0; j < 3; ++j)
+			uint32_t frontPolygon[4], backPolygon[4];
+			uint32_t frontSize = 0, backSize = 0;
+			for (int j = 0; j < 3; ++j)
+			{
+				const uint32_t a = piece.vertices[j], b = piece.vertices[(j + 1) % 3];
+				const int aSide = sides[j], bSide = sides[(j + 1) % 3];
+				if (bSide == Primitives::PointPlaneStatus::Front)
 				{
-					out.vertices[i + j].pos = input[i + j];
-					out.indices[ii + j] = i + j;
+					if (aSide == Primitives::PointPlaneStatus::Back)
+					{
+						const uint32_t split = Split(a, b, axis);
+						frontPolygon[frontSize++] = split;
+						backPolygon[backSize++] = split;
+					}
+					frontPolygon[frontSize++] = b;
 				}
-
-				if (isQuad)
+				else if (bSide == Primitives::PointPlaneStatus::Back)
 				{
-					out.vertices[i + 3].pos = input[i + 3];
-					// 0 2 3
-					out.indices[ii + 3] = i + 0;
-					out.indices[ii + 4] = i + 2;
-					out.indices[ii + 5] = i + 3;
-					i += 4;
-					ii += 6;
+					if (aSide == Primitives::PointPlaneStatus::Front)
+					{
+						const uint32_t split = Split(a, b, axis);
+						frontPolygon[frontSize++] = split;
+						backPolygon[backSize++] = split;
+					}
+					else if (aSide == Primitives::PointPlaneStatus::Coplanar)
+						backPolygon[backSize++] = a;
+					backPolygon[backSize++] = b;
 				}
 				else
 				{
-					i += 3;
-					ii += 3;
+					frontPolygon[frontSize++] = b;
+					if (aSide == Primitives::PointPlaneStatus::Back)
+						backPolygon[backSize++] = b;
 				}
 			}
-		};
-	if (frontCount > 0)
-	{
-		SplitQuads(frontQuads, frontVerts, frontCount, front);
+			ASSERT(frontSize >= 3 && frontSize <= 4, "Invalid number of face points when clipping!");
+			ASSERT(backSize >= 3 && backSize <= 4, "Invalid number of face points when clipping!");
+
+			// Fan out from the first vertex, a quad becomes 0 1 2 and 0 2 3
+			const uint32_t frontMask = piece.mask | (1u << axis), backMask = piece.mask;
+			sideCounts[axis][frontMask] += frontSize - 2;
+			sideCounts[axis][backMask] += backSize - 2;
+			if (sideCounts[axis][frontMask] > maxSideTriangles || sideCounts[axis][backMask] > maxSideTriangles)
+				return false;
+			for (uint32_t k = 1; k + 1 < frontSize; ++k)
+				clipped.push_back({ { frontPolygon[0], frontPolygon[k], frontPolygon[k + 1] }, frontMask, piece.source });
+			for (uint32_t k = 1; k + 1 < backSize; ++k)
+				clipped.push_back({ { backPolygon[0], backPolygon[k], backPolygon[k + 1] }, backMask, piece.source });
+		}
+		pieces.swap(clipped);
 	}
-	if (backCount > 0)
+
+	// Output in the order of the input triangles, the pieces of each are in order
+	auto piece = pieces.begin();
+	for (uint32_t i = 0; i < indexCount; i += 3)
 	{
-		SplitQuads(backQuads, backVerts, backCount, back);
+		if (triangleMasks[i / 3] != Straddling)
+		{
+			Emit({ { data.indices[i], data.indices[i + 1], data.indices[i + 2] }, triangleMasks[i / 3], i / 3 });
+			continue;
+		}
+		for (; piece != pieces.end() && piece->source == i / 3; ++piece)
+			Emit(*piece);
 	}
 
-	ASSERT(front.indices.size() % 3 == 0, "Incorrect number of indices in front output triangles");
-	ASSERT(back.indices.size() % 3 == 0, "Incorrect number of indices in back output triangles");
+	return true;
 }
 
 template<class VertexType>
@@ -0,0 +1,378 @@
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define BK_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC emits any intrinsic without flags, the caller checks the CPU
+#define BK_TARGET_AVX2
+#else
+#define BK_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace bk {
+namespace MeshKernels {
+namespace {
+
+// What has been seen of one plane so far
+struct PlaneState
+{
+	bool positive = false;
+	bool negative = false;
+	float minDistance = FLT_MAX;
+};
+
+// The plane in the form every kernel evaluates, dot(normal, position - point)
+struct PlaneTerms
+{
+	float nx, ny, nz;
+	float px, py, pz;
+};
+
+PlaneTerms GetTerms(const Primitives::Plane& plane)
+{
+	return { plane.normal.x, plane.normal.y, plane.normal.z, plane.position.x, plane.position.y, plane.position.z };
+}
+
+const float* Element(const float* stream, uint32_t index, uint32_t stride)
+{
+	return reinterpret_cast<const float*>(reinterpret_cast<const char*>(stream) + static_cast<size_t>(index) * stride);
+}
+
+// Scalar code finishes what the vector kernels leave over, from begin on
+void ClassifyScalar(const PositionView& positions,
+					uint32_t begin,
+					const PlaneTerms* planes,
+					uint32_t planeCount,
+					PlaneState* states)
+{
+	const float thickness = Primitives::Plane::thickness;
+	for (uint32_t i = begin; i < positions.count; ++i)
+	{
+		const float x = *Element(positions.x, i, positions.stride);
+		const float y = *Element(positions.y, i, positions.stride);
+		const float z = *Element(positions.z, i, positions.stride);
+		for (uint32_t p = 0; p < planeCount; ++p)
+		{
+			const PlaneTerms& plane = planes[p];
+			const float distance = plane.nx * (x - plane.px) + plane.ny * (y - plane.py) + plane.nz * (z - plane.pz);
+			PlaneState& state = states[p];
+			state.positive |= distance > thickness;
+			state.negative |= distance < -thickness;
+			const float absDistance = std::abs(distance);
+			if (absDistance < state.minDistance)
+				state.minDistance = absDistance;
+		}
+	}
+}
+
+void BoundsScalar(const PositionView& positions, uint32_t begin, glm::vec3& min, glm::vec3& max)
+{
+	for (uint32_t i = begin; i < positions.count; ++i)
+	{
+		const glm::vec3 position(*Element(positions.x, i, positions.stride),
+								 *Element(positions.y, i, positions.stride),
+								 *Element(positions.z, i, positions.stride));
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			if (position[axis] < min[axis]) min[axis] = position[axis];
+			if (position[axis] > max[axis]) max[axis] = position[axis];
+		}
+	}
+}
+
+#ifdef BK_X86
+// Min and max take the new values first, so that a NaN position is skipped
+// the way the scalar comparisons skip it
+
+float HorizontalMin(__m128 v)
+{
+	v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtss_f32(v);
+}
+
+float HorizontalMax(__m128 v)
+{
+	v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtss_f32(v);
+}
+
+__m128 Load4(const float* stream, uint32_t index, uint32_t stride)
+{
+	if (stride == sizeof(float))
+		return _mm_loadu_ps(stream + index);
+	return _mm_setr_ps(*Element(stream, index + 0, stride), *Element(stream, index + 1, stride),
+					   *Element(stream, index + 2, stride), *Element(stream, index + 3, stride));
+}
+
+uint32_t ClassifySSE2(const PositionView& positions, const PlaneTerms* planes, uint32_t planeCount, PlaneState* states)
+{
+	const uint32_t end = positions.count & ~3u;
+	if (end == 0) return 0;
+
+	const __m128 thickness = _mm_set1_ps(Primitives::Plane::thickness);
+	const __m128 negativeThickness = _mm_set1_ps(-Primitives::Plane::thickness);
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	__m128 positive[MaxPlanes], negative[MaxPlanes], minDistance[MaxPlanes];
+	for (uint32_t p = 0; p < planeCount; ++p)
+	{
+		positive[p] = negative[p] = _mm_setzero_ps();
+		minDistance[p] = _mm_set1_ps(FLT_MAX);
+	}
+
+	for (uint32_t i = 0; i < end; i += 4)
+	{
+		const __m128 x = Load4(positions.x, i, positions.stride);
+		const __m128 y = Load4(positions.y, i, positions.stride);
+		const __m128 z = Load4(positions.z, i, positions.stride);
+		for (uint32_t p = 0; p < planeCount; ++p)
+		{
+			const PlaneTerms& plane = planes[p];
+			__m128 distance = _mm_mul_ps(_mm_set1_ps(plane.nx), _mm_sub_ps(x, _mm_set1_ps(plane.px)));
+			distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane.ny), _mm_sub_ps(y, _mm_set1_ps(plane.py))));
+			distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane.nz), _mm_sub_ps(z, _mm_set1_ps(plane.pz))));
+			positive[p] = _mm_or_ps(positive[p], _mm_cmpgt_ps(distance, thickness));
+			negative[p] = _mm_or_ps(negative[p], _mm_cmplt_ps(distance, negativeThickness));
+			minDistance[p] = _mm_min_ps(_mm_and_ps(distance, absMask), minDistance[p]);
+		}
+	}
+
+	for (uint32_t p = 0; p < planeCount; ++p)
+	{
+		states[p].positive |= _mm_movemask_ps(positive[p]) != 0;
+		states[p].negative |= _mm_movemask_ps(negative[p]) != 0;
+		states[p].minDistance = std::min(states[p].minDistance, HorizontalMin(minDistance[p]));
+	}
+	return end;
+}
+
+uint32_t BoundsSSE2(const PositionView& positions, glm::vec3& min, glm::vec3& max)
+{
+	const uint32_t end = positions.count & ~3u;
+	if (end == 0) return 0;
+
+	__m128 minX = _mm_set1_ps(FLT_MAX), minY = minX, minZ = minX;
+	__m128 maxX = _mm_set1_ps(-FLT_MAX), maxY = maxX, maxZ = maxX;
+	for (uint32_t i = 0; i < end; i += 4)
+	{
+		const __m128 x = Load4(positions.x, i, positions.stride);
+		const __m128 y = Load4(positions.y, i, positions.stride);
+		const __m128 z = Load4(positions.z, i, positions.stride);
+		minX = _mm_min_ps(x, minX); maxX = _mm_max_ps(x, maxX);
+		minY = _mm_min_ps(y, minY); maxY = _mm_max_ps(y, maxY);
+		minZ = _mm_min_ps(z, minZ); maxZ = _mm_max_ps(z, maxZ);
+	}
+
+	min = glm::min(min, glm::vec3(HorizontalMin(minX), HorizontalMin(minY), HorizontalMin(minZ)));
+	max = glm::max(max, glm::vec3(HorizontalMax(maxX), HorizontalMax(maxY), HorizontalMax(maxZ)));
+	return end;
+}
+
+BK_TARGET_AVX2 __m128 Min4(__m256 v)
+{
+	return _mm_min_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+}
+
+BK_TARGET_AVX2 __m128 Max4(__m256 v)
+{
+	return _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+}
+
+// Interleaved positions are gathered, offsets holds the byte offset of each lane
+BK_TARGET_AVX2 __m256 Load8(const float* stream, uint32_t index, uint32_t stride, __m256i offsets)
+{
+	if (stride == sizeof(float))
+		return _mm256_loadu_ps(stream + index);
+	return _mm256_i32gather_ps(Element(stream, index, stride), offsets, 1);
+}
+
+BK_TARGET_AVX2 __m256i LaneOffsets(uint32_t stride)
+{
+	return _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(static_cast<int>(stride)));
+}
+
+BK_TARGET_AVX2 uint32_t ClassifyAVX2(const PositionView& positions,
+									 const PlaneTerms* planes,
+									 uint32_t planeCount,
+									 PlaneState* states)
+{
+	const uint32_t end = positions.count & ~7u;
+	if (end == 0) return 0;
+
+	const __m256i offsets = LaneOffsets(positions.stride);
+	const __m256 thickness = _mm256_set1_ps(Primitives::Plane::thickness);
+	const __m256 negativeThickness = _mm256_set1_ps(-Primitives::Plane::thickness);
+	const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+	__m256 positive[MaxPlanes], negative[MaxPlanes], minDistance[MaxPlanes];
+	for (uint32_t p = 0; p < planeCount; ++p)
+	{
+		positive[p] = negative[p] = _mm256_setzero_ps();
+		minDistance[p] = _mm256_set1_ps(FLT_MAX);
+	}
+
+	for (uint32_t i = 0; i < end; i += 8)
+	{
+		const __m256 x = Load8(positions.x, i, positions.stride, offsets);
+		const __m256 y = Load8(positions.y, i, positions.stride, offsets);
+		const __m256 z = Load8(positions.z, i, positions.stride, offsets);
+		for (uint32_t p = 0; p < planeCount; ++p)
+		{
+			// Multiplies and adds stay separate, a fused multiply-add would round
+			// differently from the scalar code
+			const PlaneTerms& plane = planes[p];
+			__m256 distance = _mm256_mul_ps(_mm256_set1_ps(plane.nx), _mm256_sub_ps(x, _mm256_set1_ps(plane.px)));
+			distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(plane.ny), _mm256_sub_ps(y, _mm256_set1_ps(plane.py))));
+			distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(plane.nz), _mm256_sub_ps(z, _mm256_set1_ps(plane.pz))));
+			positive[p] = _mm256_or_ps(positive[p], _mm256_cmp_ps(distance, thickness, _CMP_GT_OQ));
+			negative[p] = _mm256_or_ps(negative[p], _mm256_cmp_ps(distance, negativeThickness, _CMP_LT_OQ));
+			minDistance[p] = _mm256_min_ps(_mm256_and_ps(distance, absMask), minDistance[p]);
+		}
+	}
+
+	for (uint32_t p = 0; p < planeCount; ++p)
+	{
+		states[p].positive |= _mm256_movemask_ps(positive[p]) != 0;
+		states[p].negative |= _mm256_movemask_ps(negative[p]) != 0;
+		states[p].minDistance = std::min(states[p].minDistance, HorizontalMin(Min4(minDistance[p])));
+	}
+	return end;
+}
+
+BK_TARGET_AVX2 uint32_t BoundsAVX2(const PositionView& positions, glm::vec3& min, glm::vec3& max)
+{
+	const uint32_t end = positions.count & ~7u;
+	if (end == 0) return 0;
+
+	const __m256i offsets = LaneOffsets(positions.stride);
+	__m256 minX = _mm256_set1_ps(FLT_MAX), minY = minX, minZ = minX;
+	__m256 maxX = _mm256_set1_ps(-FLT_MAX), maxY = maxX, maxZ = maxX;
+	for (uint32_t i = 0; i < end; i += 8)
+	{
+		const __m256 x = Load8(positions.x, i, positions.stride, offsets);
+		const __m256 y = Load8(positions.y, i, positions.stride, offsets);
+		const __m256 z = Load8(positions.z, i, positions.stride, offsets);
+		minX = _mm256_min_ps(x, minX); maxX = _mm256_max_ps(x, maxX);
+		minY = _mm256_min_ps(y, minY); maxY = _mm256_max_ps(y, maxY);
+		minZ = _mm256_min_ps(z, minZ); maxZ = _mm256_max_ps(z, maxZ);
+	}
+
+	min = glm::min(min, glm::vec3(HorizontalMin(Min4(minX)), HorizontalMin(Min4(minY)), HorizontalMin(Min4(minZ))));
+	max = glm::max(max, glm::vec3(HorizontalMax(Max4(maxX)), HorizontalMax(Max4(maxY)), HorizontalMax(Max4(maxZ))));
+	return end;
+}
+#endif
+
+InstructionSet DetectInstructionSet()
+{
+#ifndef BK_X86
+	return InstructionSet::Scalar;
+#elif defined(_MSC_VER)
+	// AVX2 needs the CPU to have it and the OS to save the wide registers
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return InstructionSet::SSE2;
+	__cpuid(info, 1);
+	const bool osSavesAvx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+	__cpuidex(info, 7, 0);
+	return osSavesAvx && (info[1] & (1 << 5)) ? InstructionSet::AVX2 : InstructionSet::SSE2;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") ? InstructionSet::AVX2 : InstructionSet::SSE2;
+#endif
+}
+
+const InstructionSet supported = DetectInstructionSet();
+std::atomic<InstructionSet> current{ supported };
+
+}
+
+InstructionSet GetInstructionSet()
+{
+	return current.load(std::memory_order_relaxed);
+}
+
+InstructionSet GetSupportedInstructionSet()
+{
+	return supported;
+}
+
+void SetInstructionSet(InstructionSet set)
+{
+	current.store(std::min(set, supported), std::memory_order_relaxed);
+}
+
+const char* GetName(InstructionSet set)
+{
+	switch (set)
+	{
+	case InstructionSet::SSE2: return "SSE2";
+	case InstructionSet::AVX2: return "AVX2";
+	default: return "Scalar";
+	}
+}
+
+int ClassifyPlane(const PositionView& positions, const Primitives::Plane& plane, float* minDistance)
+{
+	int result;
+	ClassifyPlanes(positions, &plane, 1, &result, minDistance);
+	return result;
+}
+
+void ClassifyPlanes(
+	const PositionView& positions,
+	const Primitives::Plane* planes,
+	uint32_t planeCount,
+	int* results,
+	float* minDistances
+)
+{
+	ASSERT(planeCount <= MaxPlanes, "Too many planes to classify in one pass");
+
+	PlaneTerms terms[MaxPlanes];
+	PlaneState states[MaxPlanes];
+	for (uint32_t p = 0; p < planeCount; ++p)
+		terms[p] = GetTerms(planes[p]);
+
+	uint32_t done = 0;
+#ifdef BK_X86
+	switch (GetInstructionSet())
+	{
+	case InstructionSet::AVX2: done = ClassifyAVX2(positions, terms, planeCount, states); break;
+	case InstructionSet::SSE2: done = ClassifySSE2(positions, terms, planeCount, states); break;
+	default: break;
+	}
+#endif
+	ClassifyScalar(positions, done, terms, planeCount, states);
+
+	for (uint32_t p = 0; p < planeCount; ++p)
+	{
+		// Nothing off the plane counts as in front, like coplanar triangles do
+		const PlaneState& state = states[p];
+		results[p] = (!state.positive && !state.negative) ? 1 :
+			static_cast<int>(!state.negative) - static_cast<int>(!state.positive);
+		if (minDistances != nullptr)
+			minDistances[p] = state.minDistance;
+	}
+}
+
+void GetBounds(const PositionView& positions, glm::vec3& min, glm::vec3& max)
+{
+	min = glm::vec3(FLT_MAX);
+	max = glm::vec3(-FLT_MAX);
+
+	uint32_t done = 0;
+#ifdef BK_X86
+	switch (GetInstructionSet())
+	{
+	case InstructionSet::AVX2: done = BoundsAVX2(positions, min, max); break;
+	case InstructionSet::SSE2: done = BoundsSSE2(positions, min, max); break;
+	default: break;
+	}
+#endif
+	BoundsScalar(positions, done, min, max);
+}
+
+}
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+namespace bk {
+
+// Positions read one float stream per axis. The streams are strided, so the same
+// view covers separate arrays per axis as well as the pos member of vertices
+struct PositionView
+{
+	const float* x = nullptr;
+	const float* y = nullptr;
+	const float* z = nullptr;
+	uint32_t count = 0;
+	// Bytes from one position to the next within a stream
+	uint32_t stride = sizeof(float);
+
+	template<class VertexType>
+	static PositionView FromVertices(const VertexType* vertices, uint32_t count)
+	{
+		if (count == 0)
+			return {};
+		return { &vertices->pos.x, &vertices->pos.y, &vertices->pos.z, count, sizeof(VertexType) };
+	}
+};
+
+// Positions stored per axis, the layout the kernels read fastest
+struct PositionArrays
+{
+	std::vector<float> x, y, z;
+
+	template<class VertexType>
+	void Assign(const VertexType* vertices, uint32_t count)
+	{
+		x.resize(count);
+		y.resize(count);
+		z.resize(count);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			x[i] = vertices[i].pos.x;
+			y[i] = vertices[i].pos.y;
+			z[i] = vertices[i].pos.z;
+		}
+	}
+
+	PositionView View() const
+	{
+		return { x.data(), y.data(), z.data(), static_cast<uint32_t>(x.size()), sizeof(float) };
+	}
+};
+
+// Plane classification and bounds over many positions, in SSE2 or AVX2 when the
+// CPU has it. Every instruction set gives the same results as the scalar code
+namespace MeshKernels {
+
+enum class InstructionSet
+{
+	Scalar = 0,
+	SSE2,
+	AVX2
+};
+
+// The best one the CPU supports, unless lowered with SetInstructionSet
+InstructionSet GetInstructionSet();
+InstructionSet GetSupportedInstructionSet();
+// Clamped to what the CPU supports, to compare results or timings
+void SetInstructionSet(InstructionSet set);
+const char* GetName(InstructionSet set);
+
+// Below this many positions the vector kernels don't pay for their call
+static constexpr uint32_t MinimumCount = 8;
+
+// -1 if all behind the plane, 0 if straddling and 1 if all in front or on it.
+// Optionally outputs the smallest distance of a position to the plane
+int ClassifyPlane(const PositionView& positions, const Primitives::Plane& plane, float* minDistance = nullptr);
+
+// ClassifyPlane for several planes in a single pass over the positions
+static constexpr uint32_t MaxPlanes = 8;
+void ClassifyPlanes(
+	const PositionView& positions,
+	const Primitives::Plane* planes,
+	uint32_t planeCount,
+	int* results,
+	float* minDistances = nullptr
+);
+
+void GetBounds(const PositionView& positions, glm::vec3& min, glm::vec3& max);
+
+}
+}
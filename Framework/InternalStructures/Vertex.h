@@ -11,6 +11,11 @@ struct PosVertex
 {
 	glm::vec3 pos = glm::vec3(0.0f);
 	inline static const uint32_t NUM_ATTRIBS = 1;
+
+	static constexpr auto Attributes()
+	{
+		return std::make_tuple(&PosVertex::pos);
+	}
 };
 
 
@@ -20,6 +25,11 @@ struct ColorVertex
 	glm::vec3 color;
 
 	inline static const uint32_t NUM_ATTRIBS = 2;
+
+	static constexpr auto Attributes()
+	{
+		return std::make_tuple(&ColorVertex::pos, &ColorVertex::color);
+	}
 };
 
 struct TexVertex
@@ -28,6 +38,11 @@ struct TexVertex
 	glm::vec2 texPos;
 
 	inline static const uint32_t NUM_ATTRIBS = 2;
+
+	static constexpr auto Attributes()
+	{
+		return std::make_tuple(&TexVertex::pos, &TexVertex::texPos);
+	}
 };
 
 struct Vertex
@@ -43,6 +58,28 @@ struct Vertex
 	}
 
 	inline static const uint32_t NUM_ATTRIBS = 4;
+
+	static constexpr auto Attributes()
+	{
+		return std::make_tuple(&Vertex::pos, &Vertex::normal, &Vertex::color, &Vertex::texPos);
+	}
 };
 
+// Vertex at t along the way from a to b. Every attribute the vertex type lists in
+// Attributes is interpolated, so clipping keeps normals, colors and UVs
+template<class VertexType>
+VertexType Interpolate(const VertexType& a, const VertexType& b, float t)
+{
+	constexpr auto attributes = VertexType::Attributes();
+	static_assert(std::tuple_size_v<decltype(attributes)> == VertexType::NUM_ATTRIBS,
+				  "Attributes has to list every attribute of the vertex");
+
+	VertexType vertex = a;
+	std::apply([&](auto... attribute)
+	{
+		((vertex.*attribute = a.*attribute + t * (b.*attribute - a.*attribute)), ...);
+	}, attributes);
+	return vertex;
+}
+
 }
\ No newline at end of file
@@ -3,11 +3,12 @@
 
 void JobSystem::Initialize()
 {
+	// Set before the dispatcher starts, it exits as soon as it sees it unset
+	active = true;
+
 	dispatcher = new std::thread(Dispatch);
 	// -1 for our dispatcher
 	ThreadCount = std::thread::hardware_concurrency() - 1;
-
-	active = true;
 }
 
 Job JobSystem::Push(const JobFunc jobFunction, 
@@ -159,6 +160,43 @@ Job JobSystem::Combine(const std::vector<Job>& jobs)
 	return Combine(jobs.data(), jobs.size());
 }
 
+void JobSystem::ParallelFor(const uint32_t count,
+							const uint32_t batchSize,
+							const RangeFunc& function)
+{
+	ASSERT(batchSize > 0, "Invalid batch size for parallel for");
+
+	// Run inline if there is nothing to spread out, or if we are already
+	// inside of a job since pushing is only valid from outside of the workers
+	if (!active || isWorker || ThreadCount <= 1 || count <= batchSize)
+	{
+		if (count > 0)
+			function(0, count);
+		return;
+	}
+
+	std::vector<Job> jobs;
+	for (uint32_t begin = 0; begin < count; begin += batchSize)
+	{
+		uint32_t end = std::min(begin + batchSize, count);
+		jobs.emplace_back(Push(
+			[&function, begin, end]
+			{
+				isWorker = true;
+				function(begin, end);
+			}));
+	}
+
+	Execute();
+	Wait(jobs);
+}
+
+void JobSystem::ParallelFor(const uint32_t count, const RangeFunc& function)
+{
+	uint32_t batchCount = std::max(ThreadCount, 1u);
+	ParallelFor(count, std::max((count + batchCount - 1) / batchCount, 1u), function);
+}
+
 bool JobSystem::IsFutureReady(const std::future<void>& future)
 {
 	return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
@@ -222,9 +260,13 @@ void JobSystem::Dispatch()
 			{
 				JobData& data = kv.second;
 
-				// Get job and assign to future
+				// Get job and assign to future, nested parallel fors run inline
 				JobFunc jobFunc = data.function;
-				auto future = std::async(std::launch::async, jobFunc);
+				auto future = std::async(std::launch::async, [jobFunc]
+				{
+					isWorker = true;
+					jobFunc();
+				});
 
 
 				futures.insert({ kv.first,
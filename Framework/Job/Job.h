@@ -10,6 +10,7 @@ struct Job
 class JobSystem
 {
 	using JobFunc = std::function<void(void)>;
+	using RangeFunc = std::function<void(uint32_t begin, uint32_t end)>;
 
 public:
 	inline static uint32_t ThreadCount = 1;
@@ -68,11 +69,30 @@ public:
 	static Job Combine(const Job* jobs, const uint32_t jobCount);
 	static Job Combine(const std::vector<Job>& jobs);
 
+	// Run a function over [0, count) in batches spread across the workers,
+	// returning once every batch is complete
+	static void ParallelFor(const uint32_t count,
+							const uint32_t batchSize,
+							const RangeFunc& function);
+
+	// Same as above, with one batch per worker
+	static void ParallelFor(const uint32_t count,
+							const RangeFunc& function);
+
+	// True on threads running a job, where ParallelFor runs inline
+	static bool IsWorker()
+	{
+		return isWorker;
+	}
+
 
 private:
 	// Worker thread active
 	inline static std::atomic_bool active = false;
 
+	// Set on threads running a job, jobs can only be pushed from outside of them
+	inline static thread_local bool isWorker = false;
+
 	// Our dispatcher thread
 	inline static std::thread* dispatcher;
 
@@ -0,0 +1,95 @@
+#include "SpatialStatsEditorBlock.h"
+
+SpatialStatsEditorBlock::SpatialStatsEditorBlock()
+{
+
+}
+
+SpatialStatsEditorBlock::~SpatialStatsEditorBlock()
+{
+
+}
+
+void SpatialStatsEditorBlock::AddStats(const std::string& name, const SpatialStats& stats)
+{
+	m_stats.emplace_back(name, &stats);
+}
+
+void SpatialStatsEditorBlock::UpdateQuery(const char* name, SpatialStats::Query& query)
+{
+	uint64_t count = query.count;
+	if (count == 0)
+	{
+		ImGui::Text("%s: None", name);
+		return;
+	}
+
+	ImGui::Text("%s: %llu, %.1f Nodes, %.1f Narrow-Phase Tests per Query", name,
+				static_cast<unsigned long long>(count),
+				static_cast<double>(query.visitedNodes) / count,
+				static_cast<double>(query.narrowPhaseTests) / count);
+}
+
+void SpatialStatsEditorBlock::Update(float dt)
+{
+	for (auto& [name, stats] : m_stats)
+	{
+		if (!ImGui::TreeNode(name.c_str()))
+			continue;
+
+		ImGui::Text("Nodes: %u, Leaves: %u, Objects: %u",
+					stats->nodeCount, stats->leafCount, stats->objectCount);
+		ImGui::Text("Triangles: %llu Source, %llu Stored, %.3fx Duplication",
+					static_cast<unsigned long long>(stats->sourceTriangles),
+					static_cast<unsigned long long>(stats->storedTriangles),
+					stats->DuplicationRatio());
+		if (stats->overBudget)
+			ImGui::Text("Stopped splitting over the triangle budget");
+		ImGui::Text("Memory: %.2f MB", stats->memoryBytes / (1024.0 * 1024.0));
+		if (stats->buildCost > 0.0f)
+			ImGui::Text("SAH Cost: %.2f, %.2fx Built, Refits: %u, Rebuilds: %u",
+						stats->cost, stats->cost / stats->buildCost, stats->refits, stats->rebuilds);
+
+		if (ImGui::TreeNode("Nodes per Depth"))
+		{
+			for (uint32_t depth = 0; depth < stats->nodesPerDepth.size(); ++depth)
+				ImGui::Text("%u: %u", depth, stats->nodesPerDepth[depth]);
+			ImGui::TreePop();
+		}
+
+		if (ImGui::TreeNode("Leaf Triangles"))
+		{
+			float histogram[SpatialStats::HistogramBuckets];
+			for (uint32_t i = 0; i < SpatialStats::HistogramBuckets; ++i)
+				histogram[i] = static_cast<float>(stats->leafTriangles[i]);
+			ImGui::PlotHistogram("##LeafTriangles", histogram, SpatialStats::HistogramBuckets,
+								 0, "Leaves by log2(triangles)", 0.0f, FLT_MAX, ImVec2(0, 80));
+			for (uint32_t i = 0; i < SpatialStats::HistogramBuckets; ++i)
+			{
+				if (stats->leafTriangles[i] != 0)
+					ImGui::Text("[%u, %u): %u", i == 0 ? 0u : 1u << i, 2u << i, stats->leafTriangles[i]);
+			}
+			ImGui::TreePop();
+		}
+
+		if (ImGui::TreeNode("Build Phases"))
+		{
+			float total = 0.0f;
+			for (const auto& phase : stats->phases)
+			{
+				ImGui::Text("%s: %.2f ms", phase.name.c_str(), phase.milliseconds);
+				total += phase.milliseconds;
+			}
+			ImGui::Text("Total: %.2f ms", total);
+			ImGui::TreePop();
+		}
+
+		UpdateQuery("Frustum Queries", stats->frustum);
+		UpdateQuery("Ray Queries", stats->ray);
+		UpdateQuery("Collision Queries", stats->collision);
+		if (ImGui::Button(("Reset Queries##" + name).c_str()))
+			stats->ResetQueries();
+
+		ImGui::TreePop();
+	}
+}
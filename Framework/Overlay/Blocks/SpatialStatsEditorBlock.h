@@ -0,0 +1,18 @@
+#pragma once
+#include "Overlay/EditorBlock.h"
+#include "Stats/SpatialStats.h"
+
+class SpatialStatsEditorBlock : public EditorBlock
+{
+public:
+	SpatialStatsEditorBlock();
+	~SpatialStatsEditorBlock();
+	void AddStats(const std::string& name, const SpatialStats& stats);
+	void Update(float dt) override;
+
+private:
+	void UpdateQuery(const char* name, SpatialStats::Query& query);
+
+	// Owned by the structures, they have to outlive the block
+	std::vector<std::pair<std::string, const SpatialStats*>> m_stats;
+};
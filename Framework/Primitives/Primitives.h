@@ -27,6 +27,12 @@ namespace Primitives
 		inline static float thickness = glm::epsilon<float>();
 	};
 
+	// Planes face inwards, a point is inside if dot(normal, point) >= D for all six
+	struct Frustum
+	{
+		Plane planes[6];
+	};
+
 	struct Point
 	{
 		glm::vec3 position;
@@ -83,6 +89,58 @@ namespace Primitives
 
 
 
+	// Extract the frustum planes from a view-projection matrix, clip depth is [0, 1]
+	static Frustum GenerateFrustum(const glm::mat4& viewProjection)
+	{
+		const glm::mat4 m = glm::transpose(viewProjection);
+		const glm::vec4 rows[6] = {
+			m[3] + m[0], m[3] - m[0],
+			m[3] + m[1], m[3] - m[1],
+			m[2], m[3] - m[2]
+		};
+
+		Frustum frustum;
+		for (int i = 0; i < 6; ++i)
+		{
+			float length = glm::length(glm::vec3(rows[i]));
+			Plane& plane = frustum.planes[i];
+			plane.normal = glm::vec3(rows[i]) / length;
+			plane.D = -rows[i].w / length;
+			plane.position = plane.normal * plane.D;
+		}
+		return frustum;
+	}
+
+	// Mask of the planes a box straddles, planes outside the mask are already passed
+	static uint32_t FrustumBox(const Frustum& frustum,
+							  uint32_t planeMask,
+							  const glm::vec3& min,
+							  const glm::vec3& max,
+							  bool& outside)
+	{
+		const glm::vec3 center = (min + max) * 0.5f;
+		const glm::vec3 extent = (max - min) * 0.5f;
+
+		uint32_t straddling = 0;
+		for (uint32_t p = 0; p < 6; ++p)
+		{
+			if ((planeMask & (1u << p)) == 0) continue;
+
+			const Plane& plane = frustum.planes[p];
+			float d = glm::dot(plane.normal, center) - plane.D;
+			float r = glm::dot(glm::abs(plane.normal), extent);
+			if (d + r < 0.0f)
+			{
+				outside = true;
+				return 0;
+			}
+			straddling |= static_cast<uint32_t>(d - r < 0.0f) << p;
+		}
+
+		outside = false;
+		return straddling;
+	}
+
 	static int ClassifyPointToPlane(const glm::vec3& point, const Plane& plane)
 	{
 		float distance = glm::dot(plane.normal, point - plane.position);
@@ -347,55 +405,35 @@ namespace Primitives
 
 	}
 
-	static bool TriangleRay(Triangle& tri, Point& point)
+	// Moller-Trumbore, t is in units of the ray direction
+	static bool RayTriangle(const Ray& ray, const Triangle& tri, float& t)
 	{
-		//// compute plane's normal
-		//Vec3f v0v1 = v1 - v0;
-		//Vec3f v0v2 = v2 - v0;
-		//// no need to normalize
-		//Vec3f N = v0v1.crossProduct(v0v2); // N 
-		//float area2 = N.length();
-
-		//// Step 1: finding P
-
-		//// check if ray and plane are parallel ?
-		//float NdotRayDirection = N.dotProduct(dir);
-		//if (fabs(NdotRayDirection) < kEpsilon) // almost 0 
-		//	return false; // they are parallel so they don't intersect ! 
-
-		//// compute d parameter using equation 2
-		//float d = N.dotProduct(v0);
-
-		//// compute t (equation 3)
-		//t = (N.dotProduct(orig) + d) / NdotRayDirection;
-		//// check if the triangle is in behind the ray
-		//if (t < 0) return false; // the triangle is behind 
-
-		//// compute the intersection point using equation 1
-		//Vec3f P = orig + t * dir;
-
-		//// Step 2: inside-outside test
-		//Vec3f C; // vector perpendicular to triangle's plane 
+		glm::vec3 e1 = tri.positions[1] - tri.positions[0];
+		glm::vec3 e2 = tri.positions[2] - tri.positions[0];
+		glm::vec3 p = glm::cross(ray.direction, e2);
+		float det = glm::dot(e1, p);
+		// Parallel to the triangle
+		if (std::abs(det) <= 1e-12f)
+			return false;
 
-		//// edge 0
-		//Vec3f edge0 = v1 - v0;
-		//Vec3f vp0 = P - v0;
-		//C = edge0.crossProduct(vp0);
-		//if (N.dotProduct(C) < 0) return false; // P is on the right side 
+		float invDet = 1.0f / det;
+		glm::vec3 s = ray.position - tri.positions[0];
+		float u = glm::dot(s, p) * invDet;
+		if (u < 0.0f || u > 1.0f)
+			return false;
 
-		//// edge 1
-		//Vec3f edge1 = v2 - v1;
-		//Vec3f vp1 = P - v1;
-		//C = edge1.crossProduct(vp1);
-		//if (N.dotProduct(C) < 0)  return false; // P is on the right side 
+		glm::vec3 q = glm::cross(s, e1);
+		float v = glm::dot(ray.direction, q) * invDet;
+		if (v < 0.0f || u + v > 1.0f)
+			return false;
 
-		//// edge 2
-		//Vec3f edge2 = v0 - v2;
-		//Vec3f vp2 = P - v2;
-		//C = edge2.crossProduct(vp2);
-		//if (N.dotProduct(C) < 0) return false; // P is on the right side; 
+		t = glm::dot(e2, q) * invDet;
+		return t >= 0.0f;
+	}
 
-		//return true; // this ray hits the triangle 
+	static bool TriangleRay(const Triangle& tri, const Ray& ray, float& t)
+	{
+		return RayTriangle(ray, tri, t);
 	}
 
 }
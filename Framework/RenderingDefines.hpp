@@ -13,9 +13,11 @@ constexpr std::string_view ASSET_DIR = "Assets/";
 constexpr size_t MAX_FRAME_DRAWS = 2;
 
 
+#ifndef BK_HEADLESS
 const std::vector<const char*> deviceExtensions = {
 	VK_KHR_SWAPCHAIN_EXTENSION_NAME
 };
+#endif
 
 
 template<class Type>
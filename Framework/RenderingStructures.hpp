@@ -6,7 +6,16 @@
 //
 //------------------------------------------------------------------------------
 #pragma once
-    
+
+#ifdef BK_HEADLESS
+// Only what meshes need to hold and read their geometry
+#include "Primitives/Primitives.h"
+#include "InternalStructures/Device.h"
+#include "InternalStructures/Vertex.h"
+#include "InternalStructures/Buffer.h"
+#include "InternalStructures/MeshKernels.h"
+#include "InternalStructures/Mesh.h"
+#else
 #include <vk_mem_alloc.h>
 #include "Primitives/Primitives.h"
 #include "InternalStructures/Instance.h"
@@ -14,6 +23,7 @@
 #include "InternalStructures/Device.h"
 #include "InternalStructures/Vertex.h"
 #include "InternalStructures/Buffer.h"
+#include "InternalStructures/MeshKernels.h"
 #include "InternalStructures/Mesh.h"
 #include "InternalStructures/Sampler.h"
 #include "InternalStructures/Image.h"
@@ -35,4 +45,5 @@
 #include "InternalStructures/Model.h"
 #include "InternalStructures/RenderQueue.h"
 #include "RenderingContext/RenderingContext.h"
+#endif
 
@@ -0,0 +1,118 @@
+#pragma once
+
+// What a spatial partitioning structure built and how much work its queries do.
+// Build stats are gathered when the structure is created or loaded, query stats
+// accumulate until they are reset
+struct SpatialStats
+{
+	// Bucket i counts leaves holding [2^i, 2^(i+1)) triangles, empty leaves go in bucket 0
+	static constexpr uint32_t HistogramBuckets = 16;
+
+	struct Phase
+	{
+		std::string name;
+		float milliseconds = 0.0f;
+	};
+
+	// Work done by a single query, added to the totals once it is finished
+	struct Counters
+	{
+		uint64_t visitedNodes = 0;
+		uint64_t narrowPhaseTests = 0;
+	};
+
+	// Totals of every query of one kind, safe to add to from several threads
+	struct Query
+	{
+		std::atomic<uint64_t> count{ 0 };
+		std::atomic<uint64_t> visitedNodes{ 0 };
+		std::atomic<uint64_t> narrowPhaseTests{ 0 };
+
+		void Add(const Counters& counters)
+		{
+			count.fetch_add(1, std::memory_order_relaxed);
+			visitedNodes.fetch_add(counters.visitedNodes, std::memory_order_relaxed);
+			narrowPhaseTests.fetch_add(counters.narrowPhaseTests, std::memory_order_relaxed);
+		}
+
+		void Reset()
+		{
+			count = 0;
+			visitedNodes = 0;
+			narrowPhaseTests = 0;
+		}
+	};
+
+	void ResetBuild()
+	{
+		nodesPerDepth.clear();
+		leafTriangles.fill(0);
+		nodeCount = 0;
+		leafCount = 0;
+		objectCount = 0;
+		sourceTriangles = 0;
+		storedTriangles = 0;
+		overBudget = false;
+		memoryBytes = 0;
+		phases.clear();
+		buildCost = 0.0f;
+		cost = 0.0f;
+		refits = 0;
+		rebuilds = 0;
+	}
+
+	void ResetQueries() const
+	{
+		frustum.Reset();
+		ray.Reset();
+		collision.Reset();
+	}
+
+	void AddPhase(const std::string& name, std::chrono::steady_clock::time_point start)
+	{
+		std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		phases.push_back({ name, elapsed.count() });
+	}
+
+	void AddLeaf(uint64_t triangleCount)
+	{
+		uint32_t bucket = 0;
+		while (triangleCount > 1 && bucket < HistogramBuckets - 1)
+		{
+			triangleCount >>= 1;
+			++bucket;
+		}
+		++leafTriangles[bucket];
+		++leafCount;
+	}
+
+	// Stored triangles per source triangle, above 1 when clipping duplicated geometry
+	float DuplicationRatio() const
+	{
+		return sourceTriangles == 0 ? 0.0f : static_cast<float>(storedTriangles) / sourceTriangles;
+	}
+
+	std::vector<uint32_t> nodesPerDepth;
+	std::array<uint32_t, HistogramBuckets> leafTriangles = {};
+	uint32_t nodeCount = 0;
+	uint32_t leafCount = 0;
+	uint32_t objectCount = 0;
+	uint64_t sourceTriangles = 0;
+	uint64_t storedTriangles = 0;
+	// The build stopped splitting as clipping stored too many triangles
+	bool overBudget = false;
+	size_t memoryBytes = 0;
+	std::vector<Phase> phases;
+
+	// Surface area heuristic cost when last built and now, refitting moved
+	// geometry without rebuilding raises it
+	float buildCost = 0.0f;
+	float cost = 0.0f;
+	uint32_t refits = 0;
+	uint32_t rebuilds = 0;
+
+	// Queries only read the structure, so they are counted through a const reference
+	mutable Query frustum;
+	mutable Query ray;
+	mutable Query collision;
+};
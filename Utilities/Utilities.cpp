@@ -8,6 +8,14 @@
 #include <string>
 #include <fstream>
 #include <assert.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 
 
@@ -42,10 +50,102 @@ namespace utils
         return buffer;
     }
 
+#ifndef BK_HEADLESS
     void AssertVkBase(VkResult result)
     {
         assert(result == VK_SUCCESS);
     }
+#endif
+
+    MappedFile::MappedFile(const std::string& filename)
+    {
+#ifdef _WIN32
+        HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return;
+
+        LARGE_INTEGER size;
+        HANDLE mapping = nullptr;
+        if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+            mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+        if (mapping == nullptr)
+        {
+            CloseHandle(file);
+            return;
+        }
+
+        m_data = static_cast<uint8_t*>(MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0));
+        if (m_data == nullptr)
+        {
+            CloseHandle(mapping);
+            CloseHandle(file);
+            return;
+        }
+        m_size = static_cast<size_t>(size.QuadPart);
+        m_file = file;
+        m_mapping = mapping;
+#else
+        int file = open(filename.c_str(), O_RDONLY);
+        if (file == -1)
+            return;
+
+        struct stat info;
+        if (fstat(file, &info) == 0 && info.st_size > 0)
+        {
+            void* data = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+            if (data != MAP_FAILED)
+            {
+                m_data = static_cast<uint8_t*>(data);
+                m_size = static_cast<size_t>(info.st_size);
+            }
+        }
+        // The mapping stays valid after the descriptor is closed
+        close(file);
+#endif
+    }
+
+    MappedFile::~MappedFile()
+    {
+        Close();
+    }
+
+    MappedFile::MappedFile(MappedFile&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+    {
+        if (this == &other)
+            return *this;
+
+        Close();
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+#ifdef _WIN32
+        std::swap(m_file, other.m_file);
+        std::swap(m_mapping, other.m_mapping);
+#endif
+        return *this;
+    }
+
+    void MappedFile::Close()
+    {
+        if (m_data == nullptr)
+            return;
+#ifdef _WIN32
+        UnmapViewOfFile(m_data);
+        CloseHandle(m_mapping);
+        CloseHandle(m_file);
+        m_file = nullptr;
+        m_mapping = nullptr;
+#else
+        munmap(m_data, m_size);
+#endif
+        m_data = nullptr;
+        m_size = 0;
+    }
 
 }
 
@@ -28,6 +28,7 @@ int RandomInt(int min = 0, int max = 1, int offset = 0);
 std::vector<char> ReadFile(const std::string& filename);
 
 
+#ifndef BK_HEADLESS
 inline void CheckVkResult(vk::Result result)
 {
 	ASSERT(result == vk::Result::eSuccess, "Assertion failed when testing VkResult!");
@@ -56,6 +57,36 @@ inline void PushIdentityModel(
 		0, sizeof(glm::mat4), &identity
 	);
 }
+#endif
+
+// Whole file mapped into memory. Pages are copy-on-write, so the contents can be
+// modified in place without ever being written back to the file
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	explicit MappedFile(const std::string& filename);
+	~MappedFile();
+
+	MappedFile(const MappedFile& other) = delete;
+	MappedFile& operator=(const MappedFile& other) = delete;
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+
+	bool IsOpen() const { return m_data != nullptr; }
+	uint8_t* Data() const { return m_data; }
+	size_t Size() const { return m_size; }
+
+	void Close();
+
+private:
+	uint8_t* m_data = nullptr;
+	size_t m_size = 0;
+#ifdef _WIN32
+	void* m_file = nullptr;
+	void* m_mapping = nullptr;
+#endif
+};
 
 template<class T>
 void VectorDestroyer(std::vector<T>& vec)
@@ -8,12 +8,18 @@
 #include <entt/single_include/entt/entt.hpp>
 #include <stdexcept>
 #include <cstdlib>
+#include <cstring>
+#include <cfloat>
 #include <thread>
 #include <optional>
 #include <memory>
 #include <vector>
 #include <array>
 #include <queue>
+#include <deque>
+#include <unordered_set>
+#include <atomic>
+#include <chrono>
 #include <algorithm>
 #include <stack>
 #include <future>
@@ -37,21 +43,31 @@
 #endif
 
 
+// Headless builds have no Vulkan at all, meshes keep their data in system memory
+// and everything that records commands is left out
+#ifndef BK_HEADLESS
 #define VULKAN_HPP_DISPATCH_LOADER_DYNAMIC 1
 #define NOMINMAX 1
 #include <vulkan/vulkan.h>
 #include <vulkan.hpp>
+#else
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#endif
 
 // Other
 #include "Utilities.h"
 #include "Job/Job.h"
+#include "Stats/SpatialStats.h"
 
 
 // Rendering
 #include "RenderingDefines.hpp"
 #include "RenderingStructures.hpp"
+#ifndef BK_HEADLESS
 #include "imgui/backends/imgui_impl_vulkan.h"
 #include "Overlay/Overlay.h"
+#endif
 
 // ECS
 #include "ECS/Components/ComponentSystem.hpp"
@@ -64,6 +80,8 @@
 #include "ECS/Components/Render/RenderComponentSystem.h"
 
 #include "ECS/Components/Physics/PhysicsComponent.h"
+#include "ECS/Components/Physics/SpatialHashGrid.h"
+#include "ECS/Components/Physics/SweepAndPrune.h"
 #include "ECS/Components/Physics/PhysicsComponentSystem.h"
 
 